@@ -0,0 +1,516 @@
+//
+//  CodeCache.cpp
+//	See CodeCache.h.  The cache file format is simple and native-endian
+//	(it's a cache, not an interchange format): a fixed header, then the
+//	code, with values written as a type byte, a flags byte, and whatever
+//	data that type needs.
+//
+
+#include "CodeCache.h"
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <iostream>
+#include <string>
+#include "MiniScript/UnitTest.h"
+#include "MiniScript/MiniscriptParser.h"
+#include "MiniScript/MiniscriptErrors.h"
+#include "MiniScript/MiniscriptIntrinsics.h"
+#include "MiniScript/MiniscriptOptimizer.h"
+
+#if _WIN32 || _WIN64
+	#define WINDOWS 1
+	#include <direct.h>
+	#include <sys/stat.h>
+#else
+	#include <fcntl.h>
+	#include <unistd.h>
+	#include <sys/stat.h>
+	#include <sys/mman.h>
+#endif
+
+using namespace MiniScript;
+
+namespace CodeCache {
+
+bool enabled = true;
+
+// Bump this whenever the TAC ops or the format below change.
+static const uint32_t formatVersion = 2;
+static const char magic[4] = {'S', 'B', 'C', '1'};
+static const uint32_t endianCheck = 0x01020304;
+
+struct Header {
+	char magic[4];
+	uint32_t version;
+	uint32_t endianCheck;
+	uint32_t sizeofDouble;
+	uint32_t compileOptions;	// see CompileOptions
+	uint64_t sourceSize;
+	int64_t sourceTime;
+	uint64_t sourceHash;
+};
+
+// Compiler settings that change the code produced, as bits of Header::compileOptions.
+// (Code compiled one way must not be loaded when running another way.)
+enum : uint32_t {
+	optionOptimize = 1,		// Optimizer::enabled (which includes specialization)
+};
+
+static uint32_t CompileOptions() {
+	uint32_t result = 0;
+	if (Optimizer::enabled) result |= optionOptimize;
+	return result;
+}
+
+// Fill in the parts of a header that describe this build and its settings
+// (everything but the source info).
+static void FillHeader(Header& header) {
+	memset(&header, 0, sizeof(Header));		// (so padding bytes are written as zeros)
+	memcpy(header.magic, magic, 4);
+	header.version = formatVersion;
+	header.endianCheck = endianCheck;
+	header.sizeofDouble = sizeof(double);
+	header.compileOptions = CompileOptions();
+}
+
+// Whether a header read from a cache file fits this build and its settings.
+static bool HeaderMatches(const Header& header) {
+	return memcmp(header.magic, magic, 4) == 0 and header.version == formatVersion
+		and header.endianCheck == endianCheck and header.sizeofDouble == sizeof(double)
+		and header.compileOptions == CompileOptions();
+}
+
+//--------------------------------------------------------------------------------
+// Source file info
+//--------------------------------------------------------------------------------
+
+static bool GetFileStats(String path, uint64_t *outSize, int64_t *outTime) {
+#if WINDOWS
+	struct _stati64 stats;
+	if (_stati64(path.c_str(), &stats) != 0) return false;
+#else
+	struct stat stats;
+	if (stat(path.c_str(), &stats) != 0) return false;
+#endif
+	*outSize = stats.st_size;
+	*outTime = stats.st_mtime;
+	return true;
+}
+
+static bool ReadWholeFile(String path, std::string& outData) {
+	FILE *f = fopen(path.c_str(), "rb");
+	if (f == nullptr) return false;
+	char buf[4096];
+	size_t got;
+	outData.clear();
+	while ((got = fread(buf, 1, sizeof(buf), f)) > 0) outData.append(buf, got);
+	fclose(f);
+	return true;
+}
+
+// 64-bit FNV-1a hash.
+static uint64_t Hash(const std::string& data) {
+	uint64_t h = 14695981039346656037ULL;
+	for (size_t i=0; i<data.size(); i++) {
+		h ^= (unsigned char)data[i];
+		h *= 1099511628211ULL;
+	}
+	return h;
+}
+
+//--------------------------------------------------------------------------------
+// Writing
+//--------------------------------------------------------------------------------
+
+class Writer {
+public:
+	std::string data;
+
+	void Bytes(const void *p, size_t n) { data.append((const char*)p, n); }
+	void U8(uint8_t v) { Bytes(&v, 1); }
+	void U32(uint32_t v) { Bytes(&v, 4); }
+	void I32(int32_t v) { Bytes(&v, 4); }
+	void Double(double v) { Bytes(&v, sizeof(double)); }
+	void Str(const String& s) { U32((uint32_t)s.LengthB()); Bytes(s.c_str(), s.LengthB()); }
+
+	bool Val(Value v) {
+		U8((uint8_t)v.type);
+		U8((v.noInvoke ? 1 : 0) | ((uint8_t)v.localOnly << 1));
+		switch (v.type) {
+			case ValueType::Null:
+				return true;
+			case ValueType::Number:
+				Double(v.data.number);
+				return true;
+			case ValueType::Temp:
+				I32(v.data.tempNum);
+				return true;
+			case ValueType::String:
+			case ValueType::Var:
+				Str(v.GetString());
+				return true;
+			case ValueType::SeqElem:
+			{
+				SeqElemStorage *se = (SeqElemStorage*)(v.data.ref);
+				return Val(se->sequence) and Val(se->index);
+			}
+			case ValueType::List:
+			{
+				ValueList list = v.GetList();
+				U32((uint32_t)list.Count());
+				for (long i=0; i<list.Count(); i++) if (not Val(list[i])) return false;
+				return true;
+			}
+			case ValueType::Map:
+			{
+				ValueDict map = v.GetDict();
+				if (map.HasAssignOverride()) return false;
+				U32((uint32_t)map.Count());
+				for (ValueDictIterator kv = map.GetIterator(); !kv.Done(); kv.Next()) {
+					if (not Val(kv.Key()) or not Val(kv.Value())) return false;
+				}
+				return true;
+			}
+			case ValueType::Function:
+			{
+				FunctionStorage *fs = (FunctionStorage*)(v.data.ref);
+				if (fs->intrinsic) {
+					// (e.g. the slice intrinsic, which the compiler calls directly)
+					U8(1);
+					Str(fs->intrinsic->name);
+					return true;
+				}
+				// Otherwise, a function literal (which is not yet bound to anything).
+				if (not fs->outerVars.empty()) return false;
+				U8(0);
+				U32((uint32_t)fs->parameters.Count());
+				for (long i=0; i<fs->parameters.Count(); i++) {
+					Str(fs->parameters[i].name);
+					if (not Val(fs->parameters[i].defaultValue)) return false;
+				}
+				return Code(fs->code);
+			}
+			default:
+				return false;
+		}
+	}
+
+	bool Code(List<TACLine>& code) {
+		U32((uint32_t)code.Count());
+		for (long i=0; i<code.Count(); i++) {
+			TACLine& line = code[i];
+			// (intrinsic IDs depend on registration order, so don't save those)
+			if (line.op == TACLine::Op::CallIntrinsicA) return false;
+			U8((uint8_t)line.op);
+			if (not Val(line.lhs) or not Val(line.rhsA) or not Val(line.rhsB)) return false;
+			I32(line.location.lineNum);
+		}
+		return true;
+	}
+};
+
+//--------------------------------------------------------------------------------
+// Reading
+//--------------------------------------------------------------------------------
+
+class Reader {
+public:
+	Reader(const char *data, size_t size, String errorContext)
+	: p(data), end(data + size), ok(true), errorContext(errorContext) {}
+
+	const char *p;
+	const char *end;
+	bool ok;
+	String errorContext;
+
+	bool Bytes(void *out, size_t n) {
+		if (not ok or (size_t)(end - p) < n) return ok = false;
+		memcpy(out, p, n);
+		p += n;
+		return true;
+	}
+	uint8_t U8() { uint8_t v = 0; Bytes(&v, 1); return v; }
+	uint32_t U32() { uint32_t v = 0; Bytes(&v, 4); return v; }
+	int32_t I32() { int32_t v = 0; Bytes(&v, 4); return v; }
+	double Double() { double v = 0; Bytes(&v, sizeof(double)); return v; }
+	String Str() {
+		uint32_t len = U32();
+		if (not ok or (size_t)(end - p) < len) { ok = false; return String(); }
+		String s(p, len);
+		p += len;
+		return s.Intern();		// (as the lexer does for identifiers and literals)
+	}
+
+	Value Val() {
+		ValueType type = (ValueType)U8();
+		uint8_t flags = U8();
+		if (not ok) return Value::null;
+		Value result;
+		switch (type) {
+			case ValueType::Null:
+				break;
+			case ValueType::Number:
+				result = Value(Double());
+				break;
+			case ValueType::Temp:
+				result = Value::Temp(I32());
+				break;
+			case ValueType::String:
+				result = Value(Str());
+				break;
+			case ValueType::Var:
+				result = Value::Var(Str());
+				break;
+			case ValueType::SeqElem:
+			{
+				Value seq = Val();
+				Value idx = Val();
+				result = Value::SeqElem(seq, idx);
+			} break;
+			case ValueType::List:
+			{
+				uint32_t count = U32();
+				ValueList list;
+				for (uint32_t i=0; i<count and ok; i++) list.Add(Val());
+				result = list;
+			} break;
+			case ValueType::Map:
+			{
+				uint32_t count = U32();
+				ValueDict map;
+				for (uint32_t i=0; i<count and ok; i++) {
+					Value key = Val();
+					Value value = Val();
+					map.SetValue(key, value);
+				}
+				result = map;
+			} break;
+			case ValueType::Function:
+			{
+				if (U8() == 1) {
+					Intrinsic *intrinsic = Intrinsic::GetByName(Str());
+					if (intrinsic == nullptr) ok = false;
+					else result = intrinsic->GetFunc();
+					break;
+				}
+				FunctionStorage *fs = new FunctionStorage();
+				result = Value(fs);
+				uint32_t count = U32();
+				for (uint32_t i=0; i<count and ok; i++) {
+					String name = Str();
+					Value defaultValue = Val();
+					fs->parameters.Add(FuncParam(name, defaultValue));
+				}
+				Code(fs->code);
+			} break;
+			default:
+				ok = false;
+				return Value::null;
+		}
+		result.noInvoke = (flags & 1) != 0;
+		result.localOnly = (LocalOnlyMode)((flags >> 1) & 3);
+		return result;
+	}
+
+	void Code(List<TACLine>& code) {
+		uint32_t count = U32();
+		for (uint32_t i=0; i<count and ok; i++) {
+			uint8_t op = U8();
+			if (op > (uint8_t)TACLine::Op::LoadLocalA or op == (uint8_t)TACLine::Op::CallIntrinsicA) ok = false;
+			Value lhs = Val();
+			Value rhsA = Val();
+			Value rhsB = Val();
+			TACLine line(lhs, (TACLine::Op)op, rhsA, rhsB);
+			line.location = SourceLoc(errorContext, I32());
+			if (ok) code.Add(line);
+		}
+	}
+};
+
+// Parse a cache file's contents (header already checked).
+static bool ReadCode(const char *data, size_t size, String errorContext, List<TACLine>& outCode) {
+	Reader reader(data, size, errorContext);
+	List<TACLine> code;
+	reader.Code(code);
+	if (not reader.ok or reader.p != reader.end) return false;
+	outCode = code;
+	return true;
+}
+
+//--------------------------------------------------------------------------------
+// Public interface
+//--------------------------------------------------------------------------------
+
+// Directory the cache files for sources in the given file's directory go in.
+static String CacheDir(String sourcePath) {
+	long slash = sourcePath.LengthB() - 1;
+	while (slash >= 0 and sourcePath[slash] != '/' and sourcePath[slash] != '\\') slash--;
+	return sourcePath.SubstringB(0, slash + 1) + ".sodacache";
+}
+
+String CachePath(String sourcePath) {
+	long slash = sourcePath.LengthB() - 1;
+	while (slash >= 0 and sourcePath[slash] != '/' and sourcePath[slash] != '\\') slash--;
+	return CacheDir(sourcePath) + "/" + sourcePath.SubstringB(slash + 1) + "c";
+}
+
+bool Load(String sourcePath, String errorContext, List<TACLine>& outCode) {
+	if (not enabled) return false;
+	uint64_t sourceSize;
+	int64_t sourceTime;
+	if (not GetFileStats(sourcePath, &sourceSize, &sourceTime)) return false;
+	String cachePath = CachePath(sourcePath);
+
+	// Map the cache file into memory (or on Windows, just read it).
+#if WINDOWS
+	std::string buffer;
+	if (not ReadWholeFile(cachePath, buffer)) return false;
+	const char *data = buffer.data();
+	size_t size = buffer.size();
+#else
+	int fd = open(cachePath.c_str(), O_RDONLY);
+	if (fd < 0) return false;
+	struct stat stats;
+	if (fstat(fd, &stats) != 0 or stats.st_size < (off_t)sizeof(Header)) { close(fd); return false; }
+	size_t size = stats.st_size;
+	void *mapped = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (mapped == MAP_FAILED) return false;
+	const char *data = (const char*)mapped;
+#endif
+
+	bool result = false;
+	Header header;
+	if (size >= sizeof(Header)) {
+		memcpy(&header, data, sizeof(Header));
+		bool valid = HeaderMatches(header) and header.sourceSize == sourceSize;
+		if (valid and header.sourceTime != sourceTime) {
+			// The source was touched (or copied); check whether it actually changed.
+			std::string source;
+			valid = ReadWholeFile(sourcePath, source) and Hash(source) == header.sourceHash;
+		}
+		if (valid) {
+			try {
+				result = ReadCode(data + sizeof(Header), size - sizeof(Header), errorContext, outCode);
+			} catch (MiniscriptException&) {
+				result = false;
+			}
+		}
+	}
+#if !WINDOWS
+	munmap(mapped, size);
+#endif
+	return result;
+}
+
+bool Store(String sourcePath, List<TACLine> code) {
+	if (not enabled) return false;
+	Header header;
+	FillHeader(header);
+	std::string source;
+	if (not ReadWholeFile(sourcePath, source)) return false;
+	if (not GetFileStats(sourcePath, &header.sourceSize, &header.sourceTime)) return false;
+	if (header.sourceSize != source.size()) return false;	// (changed under us)
+	header.sourceHash = Hash(source);
+
+	Writer writer;
+	writer.Bytes(&header, sizeof(Header));
+	if (not writer.Code(code)) return false;
+
+	String cachePath = CachePath(sourcePath);
+#if WINDOWS
+	_mkdir(CacheDir(sourcePath).c_str());
+#else
+	mkdir(CacheDir(sourcePath).c_str(), 0755);
+#endif
+	// Write to a temporary file and rename it into place, so that a reader
+	// never sees a partly-written cache file.
+	String tempPath = cachePath + ".tmp";
+	FILE *f = fopen(tempPath.c_str(), "wb");
+	if (f == nullptr) return false;
+	bool ok = fwrite(writer.data.data(), 1, writer.data.size(), f) == writer.data.size();
+	ok = (fclose(f) == 0) and ok;
+#if WINDOWS
+	if (ok) remove(cachePath.c_str());
+#endif
+	if (ok) ok = rename(tempPath.c_str(), cachePath.c_str()) == 0;
+	if (not ok) remove(tempPath.c_str());
+	return ok;
+}
+
+bool Compile(String sourcePath) {
+	std::string data;
+	if (not ReadWholeFile(sourcePath, data)) {
+		std::cerr << "Error opening file: " << sourcePath.c_str() << std::endl;
+		return false;
+	}
+	String source(data.data(), data.size());
+	// Comment out the first line, if it's a hashbang (as when running it)
+	if (source.StartsWith("#!")) source = "// " + source;
+	Parser parser;
+	parser.errorContext = sourcePath;
+	try {
+		parser.Parse(source);
+	} catch (MiniscriptException& mse) {
+		std::cerr << mse.Description().c_str() << std::endl;
+		return false;
+	}
+	if (not Store(sourcePath, parser.output->code)) {
+		std::cerr << "Unable to write " << CachePath(sourcePath).c_str() << std::endl;
+		return false;
+	}
+	return true;
+}
+
+//--------------------------------------------------------------------------------
+// Unit tests
+//--------------------------------------------------------------------------------
+
+class TestCodeCache : public UnitTest
+{
+public:
+	TestCodeCache() : UnitTest("CodeCache") {}
+	virtual void Run();
+};
+
+void TestCodeCache::Run()
+{
+	ErrorIf(CachePath("foo.ms") != ".sodacache/foo.msc");
+	ErrorIf(CachePath("lib/foo.ms") != "lib/.sodacache/foo.msc");
+
+	// Round-trip some code through the writer and reader.
+	Parser parser;
+	parser.Parse("x = [1, \"two\", {\"k\": 3}]\n"
+				 "f = function(a, b=\"b\")\n"
+				 "  return a + b + x[0]\n"
+				 "end function\n"
+				 "print f(@x)\n"
+				 "y = x[1:]\n");
+	List<TACLine> code = parser.output->code;
+	Writer writer;
+	ErrorIf(not writer.Code(code));
+	List<TACLine> loaded;
+	ErrorIf(not ReadCode(writer.data.data(), writer.data.size(), "test", loaded));
+	ErrorIf(loaded.Count() != code.Count());
+	for (long i=0; i<code.Count() and i<loaded.Count(); i++) {
+		ErrorIf(loaded[i].ToString() != code[i].ToString());
+		ErrorIf(loaded[i].location.lineNum != code[i].location.lineNum);
+	}
+
+	// Truncated data must be rejected, not misread.
+	ErrorIf(ReadCode(writer.data.data(), writer.data.size() - 1, "test", loaded));
+
+	// Code cached with different compiler settings must not be used.
+	Header header;
+	FillHeader(header);
+	ErrorIf(not HeaderMatches(header));
+	bool wasOptimizing = Optimizer::enabled;
+	Optimizer::enabled = not wasOptimizing;
+	ErrorIf(HeaderMatches(header));
+	Optimizer::enabled = wasOptimizing;
+}
+
+RegisterUnitTest(TestCodeCache);
+
+}
@@ -0,0 +1,44 @@
+//
+//  CodeCache.h
+//	This module saves compiled TAC code for script files (the main script
+//	and imports), so that later runs can skip lexing, parsing and compiling.
+//	Each cache file is stored in a ".sodacache" directory next to the source,
+//	and records a format version, the compiler settings used (e.g. whether the
+//	optimizer ran), and the size, modification time and hash of the source it
+//	came from; if any of that doesn't check out, the entry is ignored and the
+//	caller compiles from source as usual.
+//
+
+#ifndef CODECACHE_H
+#define CODECACHE_H
+
+#include "MiniScript/SimpleString.h"
+#include "MiniScript/List.h"
+#include "MiniScript/MiniscriptTAC.h"
+
+namespace CodeCache {
+
+// Set to false to neither read nor write the cache.
+extern bool enabled;
+
+// Path of the cache file for the given source file.
+MiniScript::String CachePath(MiniScript::String sourcePath);
+
+// Load the compiled code for the given source file, if the cache has an
+// up-to-date entry for it.  Every line's location gets the given context
+// (file name for error messages).  Returns false if there is no usable entry.
+bool Load(MiniScript::String sourcePath, MiniScript::String errorContext,
+		  MiniScript::List<MiniScript::TACLine>& outCode);
+
+// Store compiled code (as it was right after compiling, before running)
+// for the given source file.  Returns false if the code can't be cached
+// or the cache file can't be written.
+bool Store(MiniScript::String sourcePath, MiniScript::List<MiniScript::TACLine> code);
+
+// Compile the given source file and store the result; used by `soda --compile`.
+// Returns false (after printing why) on failure.
+bool Compile(MiniScript::String sourcePath);
+
+}
+
+#endif // CODECACHE_H
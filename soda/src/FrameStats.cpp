@@ -0,0 +1,191 @@
+//
+//  FrameStats.cpp
+//  soda
+//
+//	See FrameStats.h.  Stage times are added up under a lock (as they come
+//	from several threads), and moved into the history at the end of each frame.
+//
+
+#include "FrameStats.h"
+#include "SdlGlue.h"
+#include "SceneRenderer.h"
+
+using namespace MiniScript;
+
+namespace SdlGlue {
+
+struct FrameRecord {
+	long frameNum;
+	double time;				// when the frame was submitted (seconds since Setup)
+	double interval;			// seconds since the previous frame
+	double stage[stageCount];	// seconds spent in each stage
+};
+
+// public data
+bool showFrameOverlay = false;
+
+// private data
+static const char *stageNames[stageCount] = {
+	"events", "capture", "submit", "script", "gc", "sprites", "tiles", "text", "present", "audio"
+};
+static const int historySize = 600;			// frames of history kept
+static const int graphFrames = 120;			// frames shown in the overlay graph
+static FrameRecord history[historySize];
+static long recorded = 0;					// frames recorded so far (history wraps around)
+static double pending[stageCount];			// stage times so far this frame (guarded by statsLock)
+static SDL_mutex *statsLock = nullptr;
+static double secondsPerCount = 0;
+static FILE *csvFile = nullptr;
+
+// forward declarations of private methods:
+static long HistoryCount();
+static const FrameRecord& RecentFrame(long framesAgo);
+
+//--------------------------------------------------------------------------------
+// Public method implementations
+//--------------------------------------------------------------------------------
+
+StageTimer::~StageTimer() {
+	if (statsLock == nullptr) return;
+	double elapsed = (SDL_GetPerformanceCounter() - start) * secondsPerCount;
+	SDL_LockMutex(statsLock);
+	pending[stage] += elapsed;
+	SDL_UnlockMutex(statsLock);
+}
+
+const char *StageName(FrameStage stage) {
+	return stageNames[stage];
+}
+
+void StartFrameStats(String csvPath) {
+	secondsPerCount = 1.0 / SDL_GetPerformanceFrequency();
+	recorded = 0;
+	for (int i=0; i<stageCount; i++) pending[i] = 0;
+	statsLock = SDL_CreateMutex();
+	if (!csvPath.empty()) {
+		csvFile = fopen(csvPath.c_str(), "w");
+		if (csvFile == nullptr) {
+			printf("Couldn't open %s for frame stats\n", csvPath.c_str());
+		} else {
+			fprintf(csvFile, "frame,time,ms");
+			for (int i=0; i<stageCount; i++) fprintf(csvFile, ",%s", stageNames[i]);
+			fprintf(csvFile, "\n");
+		}
+	}
+}
+
+void StopFrameStats() {
+	if (csvFile) fclose(csvFile);
+	csvFile = nullptr;
+	SDL_DestroyMutex(statsLock);
+	statsLock = nullptr;
+}
+
+void EndFrameStats(long frameNum, double frameTime, double deltaTime) {
+	if (statsLock == nullptr) return;
+	FrameRecord& rec = history[recorded % historySize];
+	rec.frameNum = frameNum;
+	rec.time = frameTime;
+	rec.interval = deltaTime;
+	SDL_LockMutex(statsLock);
+	for (int i=0; i<stageCount; i++) {
+		rec.stage[i] = pending[i];
+		pending[i] = 0;
+	}
+	SDL_UnlockMutex(statsLock);
+	recorded++;
+
+	if (csvFile) {
+		fprintf(csvFile, "%ld,%.4f,%.3f", frameNum, frameTime, deltaTime * 1000);
+		for (int i=0; i<stageCount; i++) fprintf(csvFile, ",%.3f", rec.stage[i] * 1000);
+		fprintf(csvFile, "\n");
+	}
+}
+
+double FrameTimePercentile(double fraction) {
+	long count = HistoryCount();
+	if (count == 0) return 0;
+	SimpleVector<double> times;
+	for (long i=0; i<count; i++) times.push_back(history[i].interval);
+	times.sort();
+	long idx = (long)(fraction * (count - 1) + 0.5);
+	if (idx < 0) idx = 0;
+	if (idx >= count) idx = count - 1;
+	return times[idx];
+}
+
+double StageAverage(FrameStage stage) {
+	long count = HistoryCount();
+	if (count == 0) return 0;
+	double sum = 0;
+	for (long i=0; i<count; i++) sum += history[i].stage[stage];
+	return sum / count;
+}
+
+void AddFrameOverlay(Scene *scene) {
+	const int cellWidth = 14, cellHeight = 22;		// (as in the text display)
+	const int textRows = 4, textCols = 60;
+	const int graphTop = textRows * cellHeight + 4, graphHeight = 60, barWidth = 2;
+	const Color backing(0x000000C0), textColor(0xFFFF00FF), targetColor(0xFFFFFF80);
+	const Color okColor(0x00CC00FF), slowColor(0xFFCC00FF), verySlowColor(0xFF0000FF), scriptColor(0xFFFFFFA0);
+
+	RectDraw back = { 0, 0, textCols * cellWidth, graphTop + graphHeight + 4, backing };
+	scene->overlayRects.push_back(back);
+
+	// Graph of recent frame times (with the script's part of each), scaled so
+	// the full height is two refresh intervals, with a line at one interval.
+	double target = FrameInterval();
+	double scale = graphHeight / (2 * target);
+	int baseline = graphTop + graphHeight;
+	long count = HistoryCount();
+	for (long i = 0; i < graphFrames and i < count; i++) {
+		const FrameRecord& rec = RecentFrame(i);
+		int x = (graphFrames - 1 - (int)i) * barWidth;
+		int h = (int)(rec.interval * scale + 0.5);
+		if (h > graphHeight) h = graphHeight;
+		Color c = rec.interval < target * 1.1 ? okColor : (rec.interval < target * 2 ? slowColor : verySlowColor);
+		RectDraw bar = { x, baseline - h, barWidth, h, c };
+		scene->overlayRects.push_back(bar);
+		int sh = (int)(rec.stage[stageScript] * scale + 0.5);
+		if (sh > h) sh = h;
+		RectDraw scriptBar = { x, baseline - sh, barWidth, sh, scriptColor };
+		if (sh > 0) scene->overlayRects.push_back(scriptBar);
+	}
+	RectDraw targetLine = { 0, baseline - (int)(target * scale + 0.5), graphFrames * barWidth, 1, targetColor };
+	scene->overlayRects.push_back(targetLine);
+
+	// Text: percentiles, and average ms per frame in each stage.
+	String lines[textRows];
+	lines[0] = "frame ms  p50 " + String::Format(FrameTimePercentile(0.5) * 1000, "%.1f")
+		+ "  p95 " + String::Format(FrameTimePercentile(0.95) * 1000, "%.1f")
+		+ "  p99 " + String::Format(FrameTimePercentile(0.99) * 1000, "%.1f")
+		+ "  max " + String::Format(FrameTimePercentile(1) * 1000, "%.1f");
+	for (int i=0; i<stageCount; i++) {
+		String &line = lines[1 + i / 4];
+		if (!line.empty()) line += "  ";
+		line += String(stageNames[i]) + " " + String::Format(StageAverage((FrameStage)i) * 1000, "%.2f");
+	}
+	int topRow = scene->windowHeight / cellHeight - 1;
+	for (int r=0; r<textRows; r++) {
+		const char *s = lines[r].c_str();
+		for (int col=0; s[col] and col < textCols; col++) {
+			if (s[col] == ' ') continue;
+			TextDraw cell = { topRow - r, col, (Uint8)s[col], textColor };
+			scene->overlayText.push_back(cell);
+		}
+	}
+}
+
+//--------------------------------------------------------------------------------
+// Private method implementations
+//--------------------------------------------------------------------------------
+
+static long HistoryCount() {
+	return recorded < historySize ? recorded : historySize;
+}
+
+static const FrameRecord& RecentFrame(long framesAgo) {
+	return history[(recorded - 1 - framesAgo) % historySize];
+}
+
+}	// end of namespace SdlGlue
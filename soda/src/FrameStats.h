@@ -0,0 +1,75 @@
+//
+//  FrameStats.h
+//  soda
+//
+//	Frame timing: how long each stage of each frame took.  Stages are timed
+//	with a StageTimer, on whatever thread does them (main, render, or audio).
+//	At the end of each frame, Service calls EndFrameStats, which files the
+//	stage times since the previous frame in a ring buffer (and a CSV file, if
+//	one was given).  An optional overlay shows a graph of recent frame times,
+//	percentiles, and the average time per frame in each stage.
+//
+//	Note that with the render thread, drawing a frame overlaps running the
+//	script for the next one; drawing times are counted in the frame during
+//	which they finish.
+//
+
+#ifndef FRAMESTATS_H
+#define FRAMESTATS_H
+
+#include "SdlUtils.h"
+#include "MiniScript/SimpleString.h"
+
+namespace SdlGlue {
+
+struct Scene;
+
+enum FrameStage {
+	stageEvents,		// pumping SDL events
+	stageCapture,		// capturing the screen contents into a scene
+	stageSubmit,		// handing the scene off (when not threaded, this includes drawing it)
+	stageScript,		// running the script
+	stageGC,			// collecting garbage cycles
+	stageSprites,		// drawing sprites
+	stageTiles,			// drawing the pixel display
+	stageText,			// drawing the text display
+	stagePresent,		// presenting the frame (which may wait for vsync)
+	stageAudio,			// mixing audio
+	stageCount
+};
+
+// Adds the time from its construction to its destruction to the given stage.
+class StageTimer {
+public:
+	StageTimer(FrameStage stage) : stage(stage), start(SDL_GetPerformanceCounter()) {}
+	~StageTimer();
+private:
+	FrameStage stage;
+	Uint64 start;
+};
+
+// Short name of a stage (as in the CSV header), e.g. "script".
+const char *StageName(FrameStage stage);
+
+// Start and stop collecting stats; if csvPath is not empty, write a line
+// there for each frame (times in milliseconds).
+void StartFrameStats(MiniScript::String csvPath);
+void StopFrameStats();
+
+// Note the end of a frame (called by Service).
+void EndFrameStats(long frameNum, double frameTime, double deltaTime);
+
+// Frame time (in seconds) at the given fraction (e.g. 0.95) of recent frames,
+// and average time per frame in the given stage.
+double FrameTimePercentile(double fraction);
+double StageAverage(FrameStage stage);
+
+// Add the stats overlay to the given scene.
+void AddFrameOverlay(Scene *scene);
+
+// if true, Service draws the stats overlay on each frame
+extern bool showFrameOverlay;
+
+}
+
+#endif // FRAMESTATS_H
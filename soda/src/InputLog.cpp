@@ -0,0 +1,200 @@
+//
+//  InputLog.cpp
+//  soda
+//
+//	See InputLog.h.  Records are a tag byte followed by their data:
+//
+//		'K' key code (Sint32), down (Uint8)
+//		'M' x, y (Sint32), buttons (Uint32)
+//		'N' number of controllers (Uint8)
+//		'C' controller index (Uint8), buttons (Uint32), axes (Sint16 each)
+//		'T' key event length (Uint8), then its bytes
+//		'F' end of frame
+//
+
+#include "InputLog.h"
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <string>
+#include "MiniScript/MiniscriptIntrinsics.h"
+
+using namespace MiniScript;
+
+namespace SdlGlue {
+
+static const char magic[8] = {'S', 'o', 'd', 'a', 'I', 'n', 'p', '1'};
+
+// recording
+static FILE *recordFile = nullptr;
+static MouseState recordedMouse;						// as of the last frame recorded
+static SimpleVector<ControllerState> recordedControllers;
+
+// replaying
+static std::string replayData;
+static size_t replayPos = 0;
+static bool replaying = false;
+
+static void Write(const void *p, size_t n) {
+	fwrite(p, 1, n, recordFile);
+}
+
+static bool Read(void *out, size_t n) {
+	if (replayData.size() - replayPos < n) return false;
+	memcpy(out, replayData.data() + replayPos, n);
+	replayPos += n;
+	return true;
+}
+
+//--------------------------------------------------------------------------------
+// Public method implementations
+//--------------------------------------------------------------------------------
+
+bool StartRecording(String path, double timestep) {
+	recordFile = fopen(path.c_str(), "wb");
+	if (recordFile == nullptr) {
+		printf("Couldn't open %s to record input\n", path.c_str());
+		return false;
+	}
+	Uint32 seed = (Uint32)time(nullptr);
+	InitRand(seed);
+	Write(magic, sizeof(magic));
+	Write(&seed, sizeof(seed));
+	Write(&timestep, sizeof(timestep));
+	memset(&recordedMouse, 0, sizeof(recordedMouse));
+	recordedControllers.resize(0);
+	return true;
+}
+
+bool StartReplay(String path, double *outTimestep) {
+	FILE *f = fopen(path.c_str(), "rb");
+	if (f == nullptr) {
+		printf("Couldn't open %s to replay input\n", path.c_str());
+		return false;
+	}
+	replayData.clear();
+	char buf[4096];
+	size_t got;
+	while ((got = fread(buf, 1, sizeof(buf), f)) > 0) replayData.append(buf, got);
+	fclose(f);
+
+	replayPos = 0;
+	char fileMagic[sizeof(magic)];
+	Uint32 seed;
+	if (!Read(fileMagic, sizeof(fileMagic)) or memcmp(fileMagic, magic, sizeof(magic)) != 0
+			or !Read(&seed, sizeof(seed)) or !Read(outTimestep, sizeof(double))) {
+		printf("%s is not an input recording\n", path.c_str());
+		return false;
+	}
+	InitRand(seed);
+	replaying = true;
+	return true;
+}
+
+void StopInputLog() {
+	if (recordFile) fclose(recordFile);
+	recordFile = nullptr;
+	replaying = false;
+	replayData.clear();
+}
+
+bool Recording() {
+	return recordFile != nullptr;
+}
+
+bool Replaying() {
+	return replaying;
+}
+
+void RecordKey(Sint32 keyCode, bool down) {
+	if (!recordFile) return;
+	Uint8 downByte = down;
+	Write("K", 1);
+	Write(&keyCode, sizeof(keyCode));
+	Write(&downByte, 1);
+}
+
+void RecordKeyEvent(const std::string& event) {
+	if (!recordFile) return;
+	Uint8 len = (Uint8)(event.size() < 255 ? event.size() : 255);
+	Write("T", 1);
+	Write(&len, 1);
+	Write(event.data(), len);
+}
+
+void RecordInputFrame(const MouseState& mouse, const SimpleVector<ControllerState>& controllers) {
+	if (!recordFile) return;
+	if (memcmp(&mouse, &recordedMouse, sizeof(mouse)) != 0) {
+		Sint32 xy[2] = { mouse.x, mouse.y };
+		Write("M", 1);
+		Write(xy, sizeof(xy));
+		Write(&mouse.buttons, sizeof(mouse.buttons));
+		recordedMouse = mouse;
+	}
+	if (controllers.size() != recordedControllers.size()) {
+		Uint8 count = (Uint8)controllers.size();
+		Write("N", 1);
+		Write(&count, 1);
+		recordedControllers.resize(controllers.size());
+		for (long i=0; i<controllers.size(); i++) memset(&recordedControllers[i], 0, sizeof(ControllerState));
+	}
+	for (long i=0; i<controllers.size(); i++) {
+		const ControllerState& c = controllers[i];
+		if (memcmp(&c, &recordedControllers[i], sizeof(c)) == 0) continue;
+		Uint8 index = (Uint8)i;
+		Write("C", 1);
+		Write(&index, 1);
+		Write(&c.buttons, sizeof(c.buttons));
+		Write(c.axes, sizeof(c.axes));
+		recordedControllers[i] = c;
+	}
+	Write("F", 1);
+}
+
+bool ReplayInputFrame(KeyDownMap& keyDownMap, MouseState *mouse, SimpleVector<ControllerState> *controllers,
+					  KeyEventFunc onKeyEvent) {
+	if (!replaying) return false;
+	char tag;
+	while (Read(&tag, 1)) {
+		switch (tag) {
+			case 'F':
+				return true;
+			case 'K': {
+				Sint32 keyCode;
+				Uint8 down;
+				if (!Read(&keyCode, sizeof(keyCode)) or !Read(&down, 1)) return false;
+				keyDownMap.SetValue(keyCode, down != 0);
+			} break;
+			case 'M': {
+				Sint32 xy[2];
+				if (!Read(xy, sizeof(xy)) or !Read(&mouse->buttons, sizeof(mouse->buttons))) return false;
+				mouse->x = xy[0];
+				mouse->y = xy[1];
+			} break;
+			case 'N': {
+				Uint8 count;
+				if (!Read(&count, 1)) return false;
+				controllers->resize(count);
+				for (long i=0; i<count; i++) memset(&(*controllers)[i], 0, sizeof(ControllerState));
+			} break;
+			case 'C': {
+				Uint8 index;
+				if (!Read(&index, 1) or index >= controllers->size()) return false;
+				ControllerState& c = (*controllers)[index];
+				if (!Read(&c.buttons, sizeof(c.buttons)) or !Read(c.axes, sizeof(c.axes))) return false;
+			} break;
+			case 'T': {
+				Uint8 len;
+				char buf[255];
+				if (!Read(&len, 1) or !Read(buf, len)) return false;
+				onKeyEvent(std::string(buf, len));
+			} break;
+			default:
+				printf("Input recording is corrupt (at byte %ld)\n", (long)replayPos - 1);
+				return false;
+		}
+	}
+	return false;
+}
+
+}	// end of namespace SdlGlue
@@ -0,0 +1,76 @@
+//
+//  InputLog.h
+//  soda
+//
+//	Input recording and replay.  When recording, we log all the input a
+//	script can see (keys, mouse, and game controllers), frame by frame,
+//	along with the random seed; a replay feeds that back in place of real
+//	input, so the same session can be run again (e.g. headless, with
+//	--frame-stats) to compare builds.  Both use a fixed timestep: frameTime
+//	and deltaTime advance by the same amount every frame, however long the
+//	frames really take.
+//
+//	Replays match the recording only as far as the script is deterministic
+//	given its input: a script that yields every frame and doesn't look at
+//	the wall clock (time) will do the same thing on every replay.
+//
+//	The log is native-endian binary: a header (magic, seed, timestep), then
+//	for each frame, a record for each change in input, and an end-of-frame
+//	marker.  So a frame where nothing changes takes one byte.
+//
+
+#ifndef INPUTLOG_H
+#define INPUTLOG_H
+
+#include "SdlUtils.h"
+#include "MiniScript/SimpleString.h"
+#include "MiniScript/SimpleVector.h"
+#include "MiniScript/Dictionary.h"
+#include <string>
+
+namespace SdlGlue {
+
+// Mouse state, as from SDL_GetMouseState (so y is down from the top).
+struct MouseState {
+	int x, y;
+	Uint32 buttons;
+};
+
+// Game controller state: a bit for each SDL_GameControllerButton, and
+// the raw value of each axis.
+struct ControllerState {
+	Uint32 buttons;
+	Sint16 axes[SDL_CONTROLLER_AXIS_MAX];
+};
+
+typedef MiniScript::Dictionary<Sint32, bool, MiniScript::hashInt> KeyDownMap;
+
+// Called on replay with each recorded key event (see RecordKeyEvent).
+typedef void (*KeyEventFunc)(const std::string& event);
+
+// Start recording to (or replaying from) the given file.  Either one seeds
+// the random number generator (with a new seed when recording, or the
+// recorded one on replay) and sets the timestep.  They return false (after
+// printing why) if the file can't be used.
+bool StartRecording(MiniScript::String path, double timestep);
+bool StartReplay(MiniScript::String path, double *outTimestep);
+void StopInputLog();
+
+bool Recording();
+bool Replaying();
+
+// While recording: note a key going up or down, an event queued for
+// key.get, and (once all the events for a frame are handled) the mouse
+// and controller state for the frame.
+void RecordKey(Sint32 keyCode, bool down);
+void RecordKeyEvent(const std::string& event);
+void RecordInputFrame(const MouseState& mouse, const SimpleVector<ControllerState>& controllers);
+
+// While replaying: update the given state to the next frame's, passing
+// any key events to onKeyEvent.  Returns false when the log runs out.
+bool ReplayInputFrame(KeyDownMap& keyDownMap, MouseState *mouse, SimpleVector<ControllerState> *controllers,
+					  KeyEventFunc onKeyEvent);
+
+}
+
+#endif // INPUTLOG_H
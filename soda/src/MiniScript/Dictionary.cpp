@@ -12,6 +12,8 @@
 
 namespace MiniScript {
 	
+	thread_local unsigned long dictWatchEpoch = 0;
+	
 	class TestDictionary : public UnitTest
 	{
 	public:
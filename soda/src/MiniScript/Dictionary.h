@@ -17,7 +17,92 @@ namespace MiniScript {
 	// samples: 101, 521, 1009
 	#define TABLE_SIZE 251
 
+	// Maximum number of keys a dictionary may hold while in shape mode
+	// (see DictShape below); adding more converts it to a hash table.
+	#define MAX_SHAPE_KEYS 32
+
 	template <class K, class V, unsigned int HASH(const K&)> class Dictionary;
+
+	// Counter bumped whenever a "watched" dictionary is changed or destroyed.
+	// Anything that caches facts about particular dictionaries (such as the
+	// inline caches on TAC lines) watches them, and treats a change in this
+	// counter as invalidating whatever it remembered.
+	extern thread_local unsigned long dictWatchEpoch;
+
+	// Whether the given key may be stored in a shape-mode dictionary.
+	// By default, no; key types that want shapes provide an overload
+	// (found by argument-dependent lookup), e.g. IsShapeKey(const Value&).
+	template <class K>
+	inline bool IsShapeKey(const K& key) { return false; }
+	
+	// DictShape: a shared, immutable key layout ("hidden class") for small
+	// dictionaries.  A dictionary in shape mode stores its values in a flat
+	// array, and the shape maps each key to a slot index in that array.
+	// Shapes form a tree: adding a key to a dictionary moves it from its
+	// current shape to a child shape, and dictionaries that get the same keys
+	// added in the same order end up sharing the same shape object.
+	template <class K>
+	class DictShape {
+	public:
+		DictShape() : refCount(1), parent(nullptr), count(0), keys(nullptr), hashes(nullptr) {}
+		
+		void retain() { refCount++; }
+		void release() { if (--refCount == 0) delete this; }
+		
+		// Return the slot index of the given key, or -1 if not found.
+		long IndexOf(const K& key, unsigned int hash) const {
+			for (long i=count-1; i>=0; i--) {
+				if (hashes[i] == hash and keys[i] == key) return i;
+			}
+			return -1;
+		}
+		
+		// Return the shape we get by adding the given key to this one,
+		// creating it if it doesn't exist yet.  The caller owns a reference
+		// to the result.
+		DictShape *Child(const K& key, unsigned int hash) {
+			VecIterate(i, transitions) {
+				DictShape *child = transitions[i];
+				if (child->hashes[count] == hash and child->keys[count] == key) {
+					child->retain();
+					return child;
+				}
+			}
+			DictShape *child = new DictShape(this, key, hash);
+			transitions.push_back(child);
+			return child;
+		}
+		
+		long refCount;
+		DictShape *parent;		// shape we transitioned from (retained)
+		long count;				// number of keys (and value slots)
+		K *keys;				// key for each slot
+		unsigned int *hashes;	// full hash of each key
+		SimpleVector<DictShape*> transitions;	// child shapes (not retained)
+
+	private:
+		DictShape(DictShape *parent, const K& key, unsigned int hash) : refCount(1), parent(parent), count(parent->count + 1) {
+			parent->retain();
+			keys = new K[count];
+			hashes = new unsigned int[count];
+			for (long i=0; i<parent->count; i++) {
+				keys[i] = parent->keys[i];
+				hashes[i] = parent->hashes[i];
+			}
+			keys[count-1] = key;
+			hashes[count-1] = hash;
+		}
+		
+		~DictShape() {
+			if (parent) {
+				long idx = parent->transitions.indexOf(this);
+				if (idx >= 0) parent->transitions.deleteIdx(idx);
+				parent->release();
+			}
+			delete[] keys;
+			delete[] hashes;
+		}
+	};
 	
 	template <class K, class V>
 	class HashMapEntry
@@ -26,6 +111,9 @@ namespace MiniScript {
 		HashMapEntry() : next(nullptr) {}
 		~HashMapEntry() { if (next) delete next; }
 		
+		static void *operator new(size_t size) { return SlabAllocator::Allocate(size); }
+		static void operator delete(void *p, size_t size) { SlabAllocator::Free(p, size); }
+		
 		HashMapEntry *Clone() {
 			HashMapEntry *result = new HashMapEntry();
 			result->key = key;
@@ -42,10 +130,20 @@ namespace MiniScript {
 	template <class K, class V>
 	class DictionaryStorage : public RefCountedStorage {
 	private:
-		DictionaryStorage() : RefCountedStorage(), mSize(0), assignOverride(nullptr), evalOverride(nullptr) { for (int i=0; i<TABLE_SIZE; i++) mTable[i] = nullptr; }
-		~DictionaryStorage() { RemoveAll(); }
+		DictionaryStorage() : RefCountedStorage(), mSize(0), shape(nullptr), slots(nullptr), slotCapacity(0), watched(false), assignOverride(nullptr), evalOverride(nullptr) {
+			for (int i=0; i<TABLE_SIZE; i++) mTable[i] = nullptr;
+			if (HoldsValues<K>::value and HoldsValues<V>::value) gcKind = GCKind::Map;
+		}
+		~DictionaryStorage() { if (watched) dictWatchEpoch++; RemoveAll(); }
 
 		void RemoveAll() {
+			if (shape) {
+				shape->release();
+				shape = nullptr;
+				delete[] slots;
+				slots = nullptr;
+				slotCapacity = 0;
+			}
 			for (int i = 0; i < TABLE_SIZE; i++) {
 				if (mTable[i]) {
 					delete mTable[i];
@@ -55,8 +153,50 @@ namespace MiniScript {
 			mSize = 0;
 		}
 		
+		// Shape mode: append a new key/value, transitioning to a child shape.
+		void AddShapeSlot(const K& key, unsigned int hash, const V& value) {
+			DictShape<K> *next = shape->Child(key, hash);
+			shape->release();
+			shape = next;
+			if (mSize >= slotCapacity) {
+				long newCapacity = slotCapacity < 4 ? 4 : slotCapacity * 2;
+				V *newSlots = new V[newCapacity];
+				for (long i=0; i<mSize; i++) newSlots[i] = slots[i];
+				delete[] slots;
+				slots = newSlots;
+				slotCapacity = newCapacity;
+			}
+			slots[mSize++] = value;
+		}
+		
+		// Leave shape mode, moving all our entries into the hash table.
+		void ConvertToTable() {
+			if (!shape) return;
+			for (long i=mSize-1; i>=0; i--) {
+				int bin = hashes()[i] % TABLE_SIZE;
+				HashMapEntry<K, V> *entry = new HashMapEntry<K, V>();
+				entry->key = shape->keys[i];
+				entry->value = slots[i];
+				entry->next = mTable[bin];
+				mTable[bin] = entry;
+			}
+			shape->release();
+			shape = nullptr;
+			delete[] slots;
+			slots = nullptr;
+			slotCapacity = 0;
+		}
+		
+		unsigned int *hashes() const { return shape->hashes; }
+		
 		long mSize;
 		HashMapEntry<K, V> *mTable[TABLE_SIZE];
+		
+		DictShape<K> *shape;	// if not null, we're in shape mode (and mTable is unused)
+		V *slots;				// shape mode: values, indexed by shape slot
+		long slotCapacity;		// shape mode: allocated size of slots
+		
+		bool watched;			// if true, bump dictWatchEpoch on any change
 
 		void *assignOverride;
 		void *evalOverride;
@@ -64,14 +204,15 @@ namespace MiniScript {
 		template <class K2, class V2, unsigned int HASH(const K2&)> friend class Dictionary;
 		template <class K2, class V2> friend class DictIterator;
 		friend class Value;
+		friend class CycleCollector;
 	};
 	
 	template <class K, class V>
 	class DictIterator {
 	public:
-		bool Done() const { return entry == nullptr; }
-		K Key() const { return entry->key;}
-		V Value() const { return entry->value; }
+		bool Done() const { return shapeMode() ? binIndex >= storage->mSize : entry == nullptr; }
+		K Key() const { return shapeMode() ? storage->shape->keys[binIndex] : entry->key;}
+		V Value() const { return shapeMode() ? storage->slots[binIndex] : entry->value; }
 		void Next();
 		
 		bool operator==(const DictIterator<K, V>& other) {
@@ -84,6 +225,7 @@ namespace MiniScript {
 		
 	private:
 		DictIterator(DictionaryStorage<K, V> *storage);
+		bool shapeMode() const { return storage and storage->shape; }	// (in which case binIndex is the slot index)
 		DictionaryStorage<K, V> *storage;
 		int binIndex;
 		HashMapEntry<K, V> *entry;
@@ -109,7 +251,7 @@ namespace MiniScript {
 		/// OPERATORS
 		
 		// Assignment Operator
-		Dictionary& operator=(const Dictionary &other) { ((Dictionary&)other).ensureStorage(); other.ds->refCount++; release(); ds = other.ds; isTemp = false; return *this; }
+		Dictionary& operator=(const Dictionary &other) { ((Dictionary&)other).ensureStorage(); other.ds->retain(); release(); ds = other.ds; isTemp = false; return *this; }
 		
 		/// OPERATIONS
 		inline void SetValue(const K& key, const V& value);
@@ -131,9 +273,32 @@ namespace MiniScript {
 		/// ITERATION
 		DictIterator<K,V> GetIterator() const { return DictIterator<K,V>(ds); }
 		
+		/// SHAPES
+		// Switch an empty dictionary into shape mode.  It stays that way
+		// until a key is removed, or a key that is not a shape key (or more
+		// than MAX_SHAPE_KEYS keys) is added.
+		void UseShapes() { ensureStorage(); if (ds->mSize == 0 and !ds->shape) { ds->shape = RootShape(); ds->shape->retain(); } }
+		DictShape<K> *Shape() const { return ds ? ds->shape : nullptr; }
+		long ShapeSlotOf(const K& key) const { return ds and ds->shape ? ds->shape->IndexOf(key, HASH(key)) : -1; }
+		const V& SlotValue(long slot) const { return ds->slots[slot]; }		// (shape mode only)
+		
+		/// WATCHING
+		// Mark this dictionary as watched, so that any change to it (or its
+		// destruction) bumps dictWatchEpoch.
+		void Watch() { ensureStorage(); ds->watched = true; }
+		
+		// Root (empty) shape for this dictionary type, shared by all
+		// dictionaries on the current thread.
+		static DictShape<K> *RootShape() {
+			static thread_local DictShape<K> *root = nullptr;
+			if (!root) root = new DictShape<K>();
+			return root;
+		}
+		
 		/// ASSIGNMENT OVERRIDE
 		typedef bool (*AssignOverrideCallback)(Dictionary<K,V,HASH> &dict, K key, V value);
 		void SetAssignOverride(AssignOverrideCallback callback) { ensureStorage(); ds->assignOverride = (void*)callback; }
+		bool HasAssignOverride() const { return ds and ds->assignOverride; }
 		bool ApplyAssignOverride(K key, V value) {
 			if (ds == nullptr or ds->assignOverride == nullptr) return false;
 			AssignOverrideCallback cb = (AssignOverrideCallback)(ds->assignOverride);
@@ -143,6 +308,7 @@ namespace MiniScript {
 		/// LOOKUP OVERRIDE
 		typedef bool (*EvalOverrideCallback)(Dictionary<K,V,HASH> &dict, K key, V& outValue);
 		void SetEvalOverride(EvalOverrideCallback callback) { ensureStorage(); ds->evalOverride = (void*)callback; }
+		bool HasEvalOverride() const { return ds and ds->evalOverride; }
 		bool ApplyEvalOverride(K key, V& outValue) {
 			if (ds == nullptr or ds->evalOverride == nullptr) return false;
 			EvalOverrideCallback cb = (EvalOverrideCallback)(ds->evalOverride);
@@ -157,6 +323,7 @@ namespace MiniScript {
 
 	private:
 		friend class Value;
+		friend class CycleCollector;
 		
 		inline int hashKey(const K& key) const;
 
@@ -177,6 +344,20 @@ namespace MiniScript {
 
 	template <class K, class V, unsigned int HASH(const K&)>
 	void Dictionary<K, V, HASH>::SetValue(const K& key, const V& value) {
+		if (ds and ds->watched) dictWatchEpoch++;
+		if (ds and ds->shape) {
+			unsigned int fullHash = HASH(key);
+			long slot = ds->shape->IndexOf(key, fullHash);
+			if (slot >= 0) {
+				ds->slots[slot] = value;
+				return;
+			}
+			if (IsShapeKey(key) and ds->mSize < MAX_SHAPE_KEYS) {
+				ds->AddShapeSlot(key, fullHash, value);
+				return;
+			}
+			ds->ConvertToTable();
+		}
 		int hash = hashKey(key);
 		ensureStorage();
 		HashMapEntry<K, V> *entry = ds->mTable[hash];
@@ -204,6 +385,11 @@ namespace MiniScript {
 	template <class K, class V, unsigned int HASH(const K&)>
 	bool Dictionary<K, V, HASH>::Remove(const K& key, V *output) {
 		if (!ds) return false;
+		if (ds->watched) dictWatchEpoch++;
+		if (ds->shape) {
+			if (ds->shape->IndexOf(key, HASH(key)) < 0) return false;
+			ds->ConvertToTable();
+		}
 		int hash = hashKey(key);
 		HashMapEntry<K, V> *entry = ds->mTable[hash];
 		HashMapEntry<K, V> *prev = nullptr;
@@ -225,12 +411,17 @@ namespace MiniScript {
 
 	template <class K, class V, unsigned int HASH(const K&)>
 	void Dictionary<K, V, HASH>::RemoveAll() {
+		if (ds and ds->watched) dictWatchEpoch++;
 		if (ds) ds->RemoveAll();
 	}
 
 	template <class K, class V, unsigned int HASH(const K&)>
 	V Dictionary<K, V, HASH>::Lookup(const K& key, const V& defaultValue) const {
 		if (!ds) return defaultValue;
+		if (ds->shape) {
+			long slot = ds->shape->IndexOf(key, HASH(key));
+			return slot < 0 ? defaultValue : ds->slots[slot];
+		}
 		int hash = hashKey(key);
 		HashMapEntry<K, V> *entry = ds->mTable[hash];
 		while (entry) {
@@ -244,6 +435,12 @@ namespace MiniScript {
 	template <class K, class V, unsigned int HASH(const K&)>
 	bool Dictionary<K, V, HASH>::Get(const K& key, V *outValue) const {
 		if (!ds) return false;
+		if (ds->shape) {
+			long slot = ds->shape->IndexOf(key, HASH(key));
+			if (slot < 0) return false;
+			*outValue = ds->slots[slot];
+			return true;
+		}
 		int hash = hashKey(key);
 		HashMapEntry<K, V> *entry = ds->mTable[hash];
 		while (entry) {
@@ -260,6 +457,12 @@ namespace MiniScript {
 	template <class K, class V, unsigned int HASH(const K&)>
 	const V Dictionary<K, V, HASH>::operator[](const K& key) const {
 		Assert(ds);
+		if (ds->shape) {
+			long slot = ds->shape->IndexOf(key, HASH(key));
+			if (slot >= 0) return ds->slots[slot];
+			Error("Dictionary key not found");
+			return V();
+		}
 		int hash = hashKey(key);
 		HashMapEntry<K, V> *entry = ds->mTable[hash];
 		while (entry) {
@@ -279,6 +482,10 @@ namespace MiniScript {
 	List<K> Dictionary<K, V, HASH>::Keys() const {
 		List<K> keys;
 		if (!ds) return keys;
+		if (ds->shape) {
+			for (long i=0; i<ds->mSize; i++) keys.Add(ds->shape->keys[i]);
+			return keys;
+		}
 		
 		for (int i=0; i<TABLE_SIZE; i++) {
 			HashMapEntry<K, V> *entry = ds->mTable[i];
@@ -295,6 +502,10 @@ namespace MiniScript {
 	List<V> Dictionary<K, V, HASH>::Values() const {
 		List<K> values;
 		if (!ds) return values;
+		if (ds->shape) {
+			for (long i=0; i<ds->mSize; i++) values.Add(ds->slots[i]);
+			return values;
+		}
 		
 		for (int i=0; i<TABLE_SIZE; i++) {
 			HashMapEntry<K, V> *entry = ds->mTable[i];
@@ -310,6 +521,7 @@ namespace MiniScript {
 	template <class K, class V, unsigned int HASH(const K&)>
 	bool Dictionary<K, V, HASH>::ContainsKey(const K& key) const {
 		if (!ds) return false;
+		if (ds->shape) return ds->shape->IndexOf(key, HASH(key)) >= 0;
 		int hash = hashKey(key);
 		HashMapEntry<K, V> *entry = ds->mTable[hash];
 		while (entry) {
@@ -322,7 +534,7 @@ namespace MiniScript {
 	
 	template <class K, class V, unsigned int HASH(const K&)>
 	int Dictionary<K, V, HASH>::BinEntries(int binNum) const {
-		if (!ds) return 0;
+		if (!ds or ds->shape) return 0;
 		int count = 0;
 		HashMapEntry<K, V> *entry = ds->mTable[binNum];
 		while (entry) {
@@ -346,7 +558,8 @@ namespace MiniScript {
 	template <class K, class V>
 	DictIterator<K, V>::DictIterator(DictionaryStorage<K, V> *storage) : storage(storage), binIndex(0) {
 		// Find and attach to the first bin with any data in it.
-		if (storage) {
+		// (Or in shape mode, just start at slot 0.)
+		if (storage and !storage->shape) {
 			for (int i=0; i<TABLE_SIZE; i++) {
 				if (storage->mTable[i]) {
 					binIndex = i;
@@ -360,6 +573,10 @@ namespace MiniScript {
 
 	template <class K, class V>
 	void DictIterator<K, V>::Next() {
+		if (shapeMode()) {
+			binIndex++;
+			return;
+		}
 		entry = entry->next;
 		if (!entry) {
 			// Advance to the next bin with any data in it.
@@ -21,11 +21,12 @@ namespace MiniScript {
 	template <class T>
 	class ListStorage : public RefCountedStorage, public SimpleVector<T> {
 	private:
-		ListStorage() {}
-		ListStorage(long slots) : SimpleVector<T>(slots) {}
+		ListStorage() { if (HoldsValues<T>::value) gcKind = GCKind::List; }
+		ListStorage(long slots) : SimpleVector<T>(slots) { if (HoldsValues<T>::value) gcKind = GCKind::List; }
 		virtual ~ListStorage() {}
 		
 		template <class T2> friend class List;
+		friend class CycleCollector;
 	};
 
 	template <class T>
@@ -34,7 +35,7 @@ namespace MiniScript {
 		// constructors and assignment-op
 		List(long sizeHint=0) : ls(nullptr), isTemp(false) { if (sizeHint) ls = new ListStorage<T>(sizeHint); }
 		List(const List& other) : isTemp(false) { ((List&)other).ensureStorage(); ls = other.ls; retain(); }
-		List& operator= (const List& other) { ((List&)other).ensureStorage(); other.ls->refCount++; release(); ls = other.ls; isTemp = false; return *this; }
+		List& operator= (const List& other) { ((List&)other).ensureStorage(); other.ls->retain(); release(); ls = other.ls; isTemp = false; return *this; }
 
 		// inspectors
 		long Count() const { return ls ? ls->size() : 0; }
@@ -54,6 +55,7 @@ namespace MiniScript {
 		void Resize(long newLength) { if (newLength == 0) Clear(); else { ensureStorage(); ls->resize(newLength); } }
 		void Reverse() { if (ls) ls->reverse(); }
 		void EnsureStorage() { ensureStorage(); }	// (call before copying a reference, if you want both to refer to same object)
+		void MakeImmortal() { if (ls) ls->MakeImmortal(); }	// (the list only; see Value::MakeImmortal for its contents)
 		
 		// array-like access (both read and write)
 		inline T& operator[](const long idx) { Assert(ls); return (*ls)[idx]; }
@@ -72,8 +74,8 @@ namespace MiniScript {
 		List(ListStorage<T>* storage, bool temp=true) : ls(storage), isTemp(temp) { retain(); }
 		void forget() { ls = nullptr; }
 		
-		void retain() { if (ls and !isTemp) ls->refCount++; }
-		void release() { if (ls and !isTemp and --(ls->refCount) == 0) { delete ls; ls = nullptr; } }
+		void retain() { if (ls and !isTemp) ls->retain(); }
+		void release() { if (ls and !isTemp) { ls->release(); ls = nullptr; } }
 		void ensureStorage() { if (!ls) ls = new ListStorage<T>(); }
 		ListStorage<T> *ls;
 		bool isTemp;	// indicates temp wrapper which does not participate in ref counting
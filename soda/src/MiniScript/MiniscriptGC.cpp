@@ -0,0 +1,273 @@
+//
+//  MiniscriptGC.cpp
+//  MiniScript
+//
+//  See MiniscriptGC.h.  Colors, as in Bacon & Rajan: black (in use, or
+//  not yet looked at), gray (possible member of a garbage cycle), white
+//  (member of a garbage cycle), purple (possible root).  The traversals
+//  use an explicit stack, so a long linked structure can't overflow ours.
+//
+
+#include "MiniscriptGC.h"
+#include "MiniscriptTypes.h"
+#include "SimpleVector.h"
+#include "UnitTest.h"
+#include <chrono>
+
+namespace MiniScript {
+
+	bool CycleCollector::enabled = true;
+	thread_local long CycleCollector::runs = 0;
+	thread_local long CycleCollector::freed = 0;
+	thread_local double CycleCollector::time = 0;
+	thread_local double CycleCollector::lastTime = 0;
+
+	enum Color : unsigned char { black = 0, gray, white, purple };
+
+	static const long batchSize = 256;		// roots per batch of trial deletion
+	static const unsigned int beingFreed = ~0u;	// gcIndex of garbage while we free it
+
+	// Possible roots (or null, if since freed).  This is allocated on first use
+	// and never destroyed, as containers may still be released during static
+	// destruction, after thread-local objects are gone.
+	static thread_local SimpleVector<RefCountedStorage*>& roots = *new SimpleVector<RefCountedStorage*>();
+	static thread_local long compactAt = 1024;						// roots.size() at which to squeeze out nulls
+	static thread_local SimpleVector<RefCountedStorage*> work;		// traversal stack
+	static thread_local SimpleVector<RefCountedStorage*> garbage;	// white objects found by CollectWhite
+
+	// Squeeze the nulls (roots freed since being noted) out of the roots buffer.
+	void CycleCollector::CompactRoots() {
+		long count = 0;
+		VecIterate(i, roots) {
+			RefCountedStorage *s = roots[i];
+			if (s == nullptr) continue;
+			roots[count++] = s;
+		}
+		while ((long)roots.size() > count) roots.pop_back();
+		VecIterate(i, roots) roots[i]->gcIndex = (unsigned int)(i + 1);
+		compactAt = (count < 512 ? 1024 : count * 2);
+	}
+
+	void AddPossibleCycleRoot(RefCountedStorage *storage) {
+		if (!CycleCollector::enabled) return;
+		if ((long)roots.size() >= compactAt) CycleCollector::CompactRoots();
+		storage->gcColor = purple;
+		roots.push_back(storage);
+		storage->gcIndex = (unsigned int)roots.size();
+	}
+
+	void ForgetPossibleCycleRoot(RefCountedStorage *storage) {
+		if (storage->gcIndex != beingFreed) roots[storage->gcIndex - 1] = nullptr;
+		storage->gcIndex = 0;
+	}
+
+	long CycleCollector::PendingRoots() {
+		long count = 0;
+		VecIterate(i, roots) if (roots[i]) count++;
+		return count;
+	}
+
+	// Call visit(child) for each list, map or function directly referenced
+	// by the given one.  (Keys of a map in shape mode belong to its shape,
+	// and are strings anyway, so only its values count.)
+	template <class F> void CycleCollector::ForEachChild(RefCountedStorage *s, F visit) {
+		#define VISIT(v) do { const Value& v_ = (v); \
+			if ((v_.type == ValueType::List or v_.type == ValueType::Map or v_.type == ValueType::Function) \
+				and v_.data.ref != nullptr and v_.data.ref->gcKind != GCKind::None) visit(v_.data.ref); \
+		} while (0)
+		switch (s->gcKind) {
+			case GCKind::List: {
+				ValueListStorage *ls = static_cast<ValueListStorage*>(s);
+				for (unsigned long i=0; i<ls->size(); i++) VISIT((*ls)[i]);
+				break;
+			}
+			case GCKind::Map: {
+				ValueDictStorage *ds = static_cast<ValueDictStorage*>(s);
+				if (ds->shape) {
+					for (long i=0; i<ds->mSize; i++) VISIT(ds->slots[i]);
+				} else {
+					for (int bin=0; bin<TABLE_SIZE; bin++) {
+						for (HashMapEntry<Value, Value> *e = ds->mTable[bin]; e; e = e->next) {
+							VISIT(e->key);
+							VISIT(e->value);
+						}
+					}
+				}
+				break;
+			}
+			case GCKind::Function: {
+				ValueDictStorage *outer = static_cast<FunctionStorage*>(s)->outerVars.ds;
+				if (outer != nullptr and outer->gcKind != GCKind::None) visit(outer);
+				break;
+			}
+			default:
+				break;
+		}
+		#undef VISIT
+	}
+
+	// Subtract the references held within the subgraph reachable from s.
+	void CycleCollector::MarkGray(RefCountedStorage *s) {
+		if (s->gcColor == gray) return;
+		s->gcColor = gray;
+		work.push_back(s);
+		while (!work.empty()) {
+			ForEachChild(work.pop_back(), [](RefCountedStorage *child) {
+				child->refCount--;
+				if (child->gcColor != gray) {
+					child->gcColor = gray;
+					work.push_back(child);
+				}
+			});
+		}
+	}
+
+	// Anything gray still referenced from outside is in use, along with
+	// everything it refers to; the rest of the gray subgraph is garbage.
+	void CycleCollector::Scan(RefCountedStorage *s) {
+		work.push_back(s);
+		while (!work.empty()) {
+			RefCountedStorage *t = work.pop_back();
+			if (t->gcColor != gray) continue;
+			if (t->refCount > 0) {
+				ScanBlack(t);
+			} else {
+				t->gcColor = white;
+				ForEachChild(t, [](RefCountedStorage *child) { work.push_back(child); });
+			}
+		}
+	}
+
+	// Restore the counts subtracted by MarkGray, for s and all it refers to.
+	void CycleCollector::ScanBlack(RefCountedStorage *s) {
+		SimpleVector<RefCountedStorage*> stack;		// (separate, as Scan is using work)
+		s->gcColor = black;
+		stack.push_back(s);
+		while (!stack.empty()) {
+			ForEachChild(stack.pop_back(), [&stack](RefCountedStorage *child) {
+				child->refCount++;
+				if (child->gcColor != black) {
+					child->gcColor = black;
+					stack.push_back(child);
+				}
+			});
+		}
+	}
+
+	// Gather the white subgraph reachable from s into garbage.
+	void CycleCollector::CollectWhite(RefCountedStorage *s) {
+		work.push_back(s);
+		while (!work.empty()) {
+			RefCountedStorage *t = work.pop_back();
+			if (t->gcColor != white) continue;
+			t->gcColor = black;
+			if (t->gcIndex) ForgetPossibleCycleRoot(t);		// (in a later batch)
+			t->gcIndex = beingFreed;		// (so releases while freeing don't re-buffer it)
+			garbage.push_back(t);
+			ForEachChild(t, [](RefCountedStorage *child) { work.push_back(child); });
+		}
+	}
+
+	// Release everything the given container refers to.
+	void CycleCollector::ClearContents(RefCountedStorage *s) {
+		switch (s->gcKind) {
+			case GCKind::List:		static_cast<ValueListStorage*>(s)->deleteAll(); break;
+			case GCKind::Map:		static_cast<ValueDictStorage*>(s)->RemoveAll(); break;
+			case GCKind::Function:	static_cast<FunctionStorage*>(s)->outerVars.release(); break;
+			default: break;
+		}
+	}
+
+	long CycleCollector::CollectBatch(long maxRoots) {
+		SimpleVector<RefCountedStorage*> batch;
+		while (!roots.empty() and (long)batch.size() < maxRoots) {
+			RefCountedStorage *s = roots.pop_back();
+			if (s == nullptr) continue;
+			s->gcIndex = 0;
+			// (Anything no longer purple was found to be in use by an earlier batch.)
+			if (s->gcColor == purple) batch.push_back(s);
+		}
+
+		// Trial deletion.
+		VecIterate(i, batch) MarkGray(batch[i]);
+		VecIterate(i, batch) Scan(batch[i]);
+		VecIterate(i, batch) CollectWhite(batch[i]);
+
+		// Free the garbage: put back the counts MarkGray took for its references,
+		// and hold an extra reference to each object while we clear them all
+		// out (releasing anything else they refer to), then let go.
+		VecIterate(i, garbage) {
+			ForEachChild(garbage[i], [](RefCountedStorage *child) { child->refCount++; });
+			garbage[i]->refCount++;
+		}
+		VecIterate(i, garbage) ClearContents(garbage[i]);
+		VecIterate(i, garbage) {
+			garbage[i]->gcIndex = 0;
+			garbage[i]->release();
+		}
+		long result = garbage.size();
+		garbage.deleteAll();
+		return result;
+	}
+
+	long CycleCollector::Collect(double timeBudget) {
+		if (roots.empty()) return 0;
+		typedef std::chrono::steady_clock Clock;
+		Clock::time_point start = Clock::now();
+		double elapsed = 0;
+		long result = 0;
+		do {
+			result += CollectBatch(batchSize);
+			elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+		} while (!roots.empty() and elapsed < timeBudget);
+		runs++;
+		freed += result;
+		time += elapsed;
+		lastTime = elapsed;
+		return result;
+	}
+
+	long CycleCollector::CollectAll() {
+		long result = 0;
+		while (!roots.empty()) result += Collect(1);
+		return result;
+	}
+
+	//--------------------------------------------------------------------------------
+
+	class TestCycleCollector : public UnitTest
+	{
+	public:
+		TestCycleCollector() : UnitTest("CycleCollector") {}
+		virtual void Run();
+	};
+
+	void TestCycleCollector::Run()
+	{
+		CycleCollector::CollectAll();
+		long before = CycleCollector::freed;
+		ValueList keep;
+		{
+			// a list containing itself
+			ValueList a;
+			a.Add(Value(a));
+			// two maps referring to each other
+			ValueDict m1, m2;
+			m1.SetValue(Value("other"), Value(m2));
+			m2.SetValue(Value("other"), Value(m1));
+			// a cycle that's still in use
+			ValueList b;
+			b.Add(Value(b));
+			keep.Add(Value(b));
+		}
+		ErrorIf(CycleCollector::PendingRoots() == 0);
+		CycleCollector::CollectAll();
+		ErrorIf(CycleCollector::freed - before != 3);
+		ErrorIf(CycleCollector::PendingRoots() != 0);
+		ValueList b = keep[0].GetList();
+		ErrorIf(b.Count() != 1);
+		ErrorIf(b[0].GetList()[0].GetList().Count() != 1);
+	}
+
+	RegisterUnitTest(TestCycleCollector);
+}
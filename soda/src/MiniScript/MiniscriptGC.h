@@ -0,0 +1,58 @@
+//
+//  MiniscriptGC.h
+//  MiniScript
+//
+//  A cycle collector for lists, maps and functions.  Reference counting
+//  frees most things promptly, but never frees a structure that refers to
+//  itself (a child map with a back-pointer to its parent, a function whose
+//  outerVars holds the function, etc.).  So whenever a container's count
+//  drops without reaching zero, we note it as a possible root of a garbage
+//  cycle; Collect then does trial deletion (Bacon & Rajan's synchronous
+//  algorithm) on those roots, in batches, to find and free such cycles.
+//
+//  Collect must only be called while no script code is running (e.g. in
+//  between frames), since native code may hold uncounted references.
+//
+
+#ifndef MINISCRIPTGC_H
+#define MINISCRIPTGC_H
+
+#include "RefCountedStorage.h"
+
+namespace MiniScript {
+
+	class CycleCollector {
+	public:
+		// Process possible roots, a batch at a time, until there are none left
+		// or the given time (in seconds) is up.  Returns the number of objects freed.
+		static long Collect(double timeBudget);
+
+		// Process all possible roots, however long that takes.
+		static long CollectAll();
+
+		// Number of possible roots waiting to be processed.
+		static long PendingRoots();
+
+		// Set to false to stop noting possible roots (cycles then just leak).
+		static bool enabled;
+
+		// Totals on this thread, for the `gc` intrinsic.
+		static thread_local long runs;			// calls to Collect that had work to do
+		static thread_local long freed;			// objects freed by the cycle collector
+		static thread_local double time;			// seconds spent collecting
+		static thread_local double lastTime;		// seconds spent by the last run
+
+	private:
+		template <class F> static void ForEachChild(RefCountedStorage *s, F visit);
+		static void MarkGray(RefCountedStorage *s);
+		static void Scan(RefCountedStorage *s);
+		static void ScanBlack(RefCountedStorage *s);
+		static void CollectWhite(RefCountedStorage *s);
+		static void ClearContents(RefCountedStorage *s);
+		static long CollectBatch(long maxRoots);
+		static void CompactRoots();
+		friend void AddPossibleCycleRoot(RefCountedStorage *storage);
+	};
+}
+
+#endif /* MINISCRIPTGC_H */
@@ -9,21 +9,22 @@
 #include "MiniscriptInterpreter.h"
 #include "MiniscriptParser.h"
 #include "SplitJoin.h"
+#include "MiniscriptProfiler.h"
 
 namespace MiniScript {
 	
 	Interpreter::Interpreter() : standardOutput(nullptr), errorOutput(nullptr), implicitOutput(nullptr),
-								parser(nullptr), vm(nullptr), hostData(nullptr) {
+								parser(nullptr), vm(nullptr), hostData(nullptr), errorCount(0) {
 		
 	}
 
 	Interpreter::Interpreter(String source) : standardOutput(nullptr), errorOutput(nullptr), implicitOutput(nullptr),
-	parser(nullptr), vm(nullptr), hostData(nullptr) {
+	parser(nullptr), vm(nullptr), hostData(nullptr), errorCount(0) {
 		Reset(source);
 	}
 	
 	Interpreter::Interpreter(List<String> source) : standardOutput(nullptr), errorOutput(nullptr), implicitOutput(nullptr),
-	parser(nullptr), vm(nullptr), hostData(nullptr) {
+	parser(nullptr), vm(nullptr), hostData(nullptr), errorCount(0) {
 		Reset(source);
 	}
 
@@ -46,10 +47,19 @@ namespace MiniScript {
 			vm = parser->CreateVM(standardOutput);
 			vm->interpreter = this;
 		} catch (const MiniscriptException& mse) {
+			errorCount++;
 			ReportError(mse);
 		}
 	}
 	
+	void Interpreter::Compile(List<TACLine> code) {
+		if (vm) return;		// already compiled
+		if (not parser) parser = new Parser();
+		parser->output->code = code;
+		vm = parser->CreateVM(standardOutput);
+		vm->interpreter = this;
+	}
+	
 	/// <summary>
 	/// Run one step of the virtual machine.  This method is not very useful
 	/// except in special cases; usually you will use RunUntilDone (above) instead.
@@ -59,6 +69,7 @@ namespace MiniScript {
 			Compile();
 			if (vm) vm->Step();
 		} catch (const MiniscriptException& mse) {
+			errorCount++;
 			ReportError(mse);
 		}
 	}
@@ -88,17 +99,21 @@ namespace MiniScript {
 			}
 			startImpResultCount = vm->GetGlobalContext()->implicitResultCounter;
 			double startTime = vm->RunTime();
+			if (Profiler::enabled) Profiler::Resume(startTime);
 			vm->yielding = false;
 			int checkRuntimeIn = 15;		// (because vm->RunTime() is expensive on many machines)
 			while (not vm->Done() && !vm->yielding) {
 				if (checkRuntimeIn-- == 0) {
-					if (vm->RunTime() - startTime > timeLimit) return;	// time's up for now!
+					double now = vm->RunTime();
+					if (now - startTime > timeLimit) return;	// time's up for now!
+					if (Profiler::enabled) Profiler::Tick(vm, now);
 					checkRuntimeIn = 15;
 				}
 				vm->Step();		// update the machine
 				if (returnEarly and not vm->GetTopContext()->partialResult.Done()) return;	// waiting for something
 			}
 		} catch (const MiniscriptException& mse) {
+			errorCount++;
 			ReportError(mse);
 			vm->GetTopContext()->JumpToEnd();
 		}
@@ -145,6 +160,7 @@ namespace MiniScript {
 			}
 			
 		} catch (const MiniscriptException& mse) {
+			errorCount++;
 			ReportError(mse);
 			// Attempt to recover from an error by jumping to the end of the code.
 			vm->GetTopContext()->JumpToEnd();
@@ -181,6 +197,7 @@ namespace MiniScript {
             return globalContext->GetVar(varName);
 
 		} catch (const MiniscriptException& mse) {
+            errorCount++;
             ReportError(mse);
             return Value::null;
         }
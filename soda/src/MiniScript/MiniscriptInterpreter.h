@@ -44,6 +44,11 @@ namespace MiniScript {
 		/// not need to access this, but it's provided for advanced users.
 		Machine *vm;
 		
+		/// errorCount: how many errors (compile or runtime) have been reported so
+		/// far.  Compare it before and after running something to tell whether
+		/// that code ended in an error, rather than by reaching its end.
+		long errorCount;
+		
 		/// Constructors
 		Interpreter();
 		Interpreter(String source);
@@ -89,6 +94,12 @@ namespace MiniScript {
 		/// </summary>
 		void Compile();
 
+		/// <summary>
+		/// Use the given already-compiled code (e.g. from a code cache) in
+		/// place of compiling our source, so that we are ready to run.
+		/// </summary>
+		void Compile(List<TACLine> code);
+
 		/// <summary>
 		/// Run one step of the virtual machine.  This method is not very useful
 		/// except in special cases; usually you will use RunUntilDone (above) instead.
@@ -21,20 +21,25 @@ namespace MiniScript {
 	String hostInfo = "";
 	double hostVersion = 0;
 	
-	static Value _functionType;
-	static Value _listType;
-	static Value _mapType;
-	static Value _numberType;
-	static Value _stringType;
+	// (Each thread has its own type maps, so scripts on different threads
+	// can't see each other's changes to them.)
+	static thread_local Value _functionType;
+	static thread_local Value _listType;
+	static thread_local Value _mapType;
+	static thread_local Value _numberType;
+	static thread_local Value _stringType;
 	static Value _EOL("\n");
 
 	List<Intrinsic*> Intrinsic::all;
 	Dictionary<String, Intrinsic*, hashString> Intrinsic::nameMap;
+	thread_local bool Intrinsic::threadSafeOnly = false;
+	bool Intrinsic::registrationClosed = false;
 	IntrinsicResult IntrinsicResult::Null;	// represents a completed, null result
 	IntrinsicResult IntrinsicResult::EmptyString(Value("")); // represents an empty string result
 
 	bool Intrinsics::initialized = false;
-	static ValueDict _intrinsicsMap;
+	bool Intrinsics::preparedForThreads = false;
+	static thread_local ValueDict _intrinsicsMap;
 
 	static bool randInitialized = false;
 
@@ -51,67 +56,67 @@ namespace MiniScript {
 		randInitialized = true;
 	}
 
-	static IntrinsicResult intrinsic_abs(Context *context, IntrinsicResult partialResult) {
-		Value x = context->GetVar("x");
-		return IntrinsicResult(fabs(x.DoubleValue()));
+	static Value intrinsic_abs(Context *context, const Value *args) {
+		Value x = args[0];
+		return fabs(x.DoubleValue());
 	}
 	
-	static IntrinsicResult intrinsic_acos(Context *context, IntrinsicResult partialResult) {
-		Value x = context->GetVar("x");
-		return IntrinsicResult(acos(x.DoubleValue()));
+	static Value intrinsic_acos(Context *context, const Value *args) {
+		Value x = args[0];
+		return acos(x.DoubleValue());
 	}
 	
-	static IntrinsicResult intrinsic_asin(Context *context, IntrinsicResult partialResult) {
-		Value x = context->GetVar("x");
-		return IntrinsicResult(asin(x.DoubleValue()));
+	static Value intrinsic_asin(Context *context, const Value *args) {
+		Value x = args[0];
+		return asin(x.DoubleValue());
 	}
 	
-	static IntrinsicResult intrinsic_atan(Context *context, IntrinsicResult partialResult) {
-		double y = context->GetVar("y").DoubleValue();
-		double x = context->GetVar("x").DoubleValue();
-		if (x == 1.0) return IntrinsicResult(atan(y));
-		return IntrinsicResult(atan2(y, x));
+	static Value intrinsic_atan(Context *context, const Value *args) {
+		double y = args[0].DoubleValue();
+		double x = args[1].DoubleValue();
+		if (x == 1.0) return atan(y);
+		return atan2(y, x);
 	}
 
 	static std::pair<bool, uint64_t> doubleToUnsignedSplit(double val) {
 		return { std::signbit(val), std::abs(val) };
 	}
 	
-	static IntrinsicResult intrinsic_bitAnd(Context *context, IntrinsicResult partialResult) {
-		auto i = doubleToUnsignedSplit(context->GetVar("i").DoubleValue());
-		auto j = doubleToUnsignedSplit(context->GetVar("j").DoubleValue());
+	static Value intrinsic_bitAnd(Context *context, const Value *args) {
+		auto i = doubleToUnsignedSplit(args[0].DoubleValue());
+		auto j = doubleToUnsignedSplit(args[1].DoubleValue());
 		auto sign = i.first & j.first;
 		double val = i.second & j.second;
-		return IntrinsicResult(sign ? -val : val);
+		return sign ? -val : val;
 	}
 	
-	static IntrinsicResult intrinsic_bitOr(Context *context, IntrinsicResult partialResult) {
-		auto i = doubleToUnsignedSplit(context->GetVar("i").DoubleValue());
-		auto j = doubleToUnsignedSplit(context->GetVar("j").DoubleValue());
+	static Value intrinsic_bitOr(Context *context, const Value *args) {
+		auto i = doubleToUnsignedSplit(args[0].DoubleValue());
+		auto j = doubleToUnsignedSplit(args[1].DoubleValue());
 		auto sign = i.first | j.first;
 		double val = i.second | j.second;
-		return IntrinsicResult(sign ? -val : val);
+		return sign ? -val : val;
 	}
 	
-	static IntrinsicResult intrinsic_bitXor(Context *context, IntrinsicResult partialResult) {
-		auto i = doubleToUnsignedSplit(context->GetVar("i").DoubleValue());
-		auto j = doubleToUnsignedSplit(context->GetVar("j").DoubleValue());
+	static Value intrinsic_bitXor(Context *context, const Value *args) {
+		auto i = doubleToUnsignedSplit(args[0].DoubleValue());
+		auto j = doubleToUnsignedSplit(args[1].DoubleValue());
 		auto sign = i.first ^ j.first;
 		double val = i.second ^ j.second;
-		return IntrinsicResult(sign ? -val : val);
+		return sign ? -val : val;
 	}
 
-	static IntrinsicResult intrinsic_char(Context *context, IntrinsicResult partialResult) {
-		long codePoint = context->GetVar("codePoint").IntValue();
+	static Value intrinsic_char(Context *context, const Value *args) {
+		long codePoint = args[0].IntValue();
 		char buf[5];
 		long len = UTF8Encode((unsigned long)codePoint, (unsigned char*)buf);
 		String s(buf, (size_t)len);
-		return IntrinsicResult(s);
+		return s;
 	}
 
-	static IntrinsicResult intrinsic_ceil(Context *context, IntrinsicResult partialResult) {
-		Value x = context->GetVar("x");
-		return IntrinsicResult(ceil(x.DoubleValue()));
+	static Value intrinsic_ceil(Context *context, const Value *args) {
+		Value x = args[0];
+		return ceil(x.DoubleValue());
 	}
 	
 	static IntrinsicResult intrinsic_code(Context *context, IntrinsicResult partialResult) {
@@ -121,14 +126,14 @@ namespace MiniScript {
 		return IntrinsicResult(codepoint);
 	}
 	
-	static IntrinsicResult intrinsic_cos(Context *context, IntrinsicResult partialResult) {
-		Value radians = context->GetVar("radians");
-		return IntrinsicResult(cos(radians.DoubleValue()));
+	static Value intrinsic_cos(Context *context, const Value *args) {
+		Value radians = args[0];
+		return cos(radians.DoubleValue());
 	}
 
-	static IntrinsicResult intrinsic_floor(Context *context, IntrinsicResult partialResult) {
-		Value x = context->GetVar("x");
-		return IntrinsicResult(floor(x.DoubleValue()));
+	static Value intrinsic_floor(Context *context, const Value *args) {
+		Value x = args[0];
+		return floor(x.DoubleValue());
 	}
 	
 	static IntrinsicResult intrinsic_function(Context *context, IntrinsicResult partialResult) {
@@ -143,28 +148,28 @@ namespace MiniScript {
 		return IntrinsicResult(obj.Hash());
 	}
 	
-	static IntrinsicResult intrinsic_hasIndex(Context *context, IntrinsicResult partialResult) {
-		Value self = context->GetVar("self");
-		Value index = context->GetVar("index");
+	static Value intrinsic_hasIndex(Context *context, const Value *args) {
+		Value self = args[0];
+		Value index = args[1];
 		if (self.type == ValueType::List) {
 			if (index.type == ValueType::Number) {
 				ValueList list = self.GetList();
 				long i = index.IntValue();
-				return IntrinsicResult(Value::Truth(i >= -list.Count() and i < list.Count()));
+				return Value::Truth(i >= -list.Count() and i < list.Count());
 			}
-			return IntrinsicResult(Value::zero);
+			return Value::zero;
 		} else if (self.type == ValueType::String) {
 			if (index.type == ValueType::Number) {
 				String str = self.GetString();
 				long i = index.IntValue();
-				return IntrinsicResult(Value::Truth(i >= -str.Length() and i < str.Length()));
+				return Value::Truth(i >= -str.Length() and i < str.Length());
 			}
-			return IntrinsicResult(Value::zero);
+			return Value::zero;
 		} else if (self.type == ValueType::Map) {
 			ValueDict map = self.GetDict();
-			return IntrinsicResult(Value::Truth(map.ContainsKey(index)));
+			return Value::Truth(map.ContainsKey(index));
 		}
-		return IntrinsicResult::Null;
+		return Value::null;
 	}
 
 	static IntrinsicResult intrinsic_indexes(Context *context, IntrinsicResult partialResult) {
@@ -188,19 +193,19 @@ namespace MiniScript {
 		return IntrinsicResult::Null;
 	}
 
-	static IntrinsicResult intrinsic_indexOf(Context *context, IntrinsicResult partialResult) {
-		Value self = context->GetVar("self");
-		Value value = context->GetVar("value");
-		Value after = context->GetVar("after");
+	static Value intrinsic_indexOf(Context *context, const Value *args) {
+		Value self = args[0];
+		Value value = args[1];
+		Value after = args[2];
 		if (self.type == ValueType::List) {
 			ValueList list = self.GetList();
 			long count = list.Count();
 			long afterIdx = -1;
 			if (!after.IsNull()) afterIdx = after.IntValue();
 			if (afterIdx < -1) afterIdx += count;
-			if (afterIdx < -1 || afterIdx > count-1) return IntrinsicResult::Null;
+			if (afterIdx < -1 || afterIdx > count-1) return Value::null;
 			for (long i=afterIdx+1; i<count; i++) {
-				if (Value::Equality(list[i], value) == 1) return IntrinsicResult(i);
+				if (Value::Equality(list[i], value) == 1) return i;
 			}
 		} else if (self.type == ValueType::String) {
 			String str = self.GetString();
@@ -209,7 +214,7 @@ namespace MiniScript {
 			if (!after.IsNull()) afterIdx = after.IntValue();
 			if (afterIdx < -1) afterIdx += str.Length();
 			long idx = str.IndexOf(s, afterIdx+1);
-			if (idx >= 0) return IntrinsicResult(idx);
+			if (idx >= 0) return idx;
 		} else if (self.type == ValueType::Map) {
 			ValueDict dict = self.GetDict();
 			bool sawAfter = after.IsNull();
@@ -217,17 +222,17 @@ namespace MiniScript {
 				if (!sawAfter) {
 					if (Value::Equality(kv.Key(), after) == 1) sawAfter = true;
 				} else {
-					if (Value::Equality(kv.Value(), value) == 1) return IntrinsicResult(kv.Key());
+					if (Value::Equality(kv.Value(), value) == 1) return kv.Key();
     			}
 			}
 		}
-		return IntrinsicResult::Null;
+		return Value::null;
 	}
 
-	static IntrinsicResult intrinsic_insert(Context *context, IntrinsicResult partialResult) {
-		Value self = context->GetVar("self");
-		Value index = context->GetVar("index");
-		Value value = context->GetVar("value");
+	static Value intrinsic_insert(Context *context, const Value *args) {
+		Value self = args[0];
+		Value index = args[1];
+		Value value = args[2];
 		if (index.IsNull()) RuntimeException("insert: index argument required").raise();
 		if (index.type != ValueType::Number) RuntimeException("insert: number required for index argument").raise();
 		long idx = index.IntValue();
@@ -237,16 +242,16 @@ namespace MiniScript {
 			if (idx < 0) idx += count + 1;	// +1 because we are inserting AND counting from the end.
 			CheckRange(idx, 0, count);		// and allowing all the way up to .Count here, because insert.
 			list.Insert(value, idx);
-			return IntrinsicResult(self);
+			return self;
 		} else if (self.type == ValueType::String) {
 			String s = self.ToString();
 			if (idx < 0) idx += s.Length() + 1;
 			CheckRange(idx, 0, s.Length());
 			s = s.Substring(0, idx) + value.ToString() + s.Substring(idx);
-			return IntrinsicResult(s);
+			return s;
 		} else {
 			RuntimeException("insert called on invalid type").raise();
-			return IntrinsicResult::Null;
+			return Value::null;
 		}
 	}
 
@@ -256,6 +261,7 @@ namespace MiniScript {
 		for (int i=0; i<Intrinsic::all.Count(); i++) {
 			Intrinsic* intrinsic = Intrinsic::all[i];
 			if (intrinsic == nullptr || intrinsic->name.empty()) continue;
+			if (Intrinsic::threadSafeOnly and !intrinsic->threadSafe) continue;
 			_intrinsicsMap.SetValue(intrinsic->name, intrinsic->GetFunc());
 		}
 		
@@ -275,18 +281,18 @@ namespace MiniScript {
 		return IntrinsicResult(result);
 	}
 	
-	static IntrinsicResult intrinsic_len(Context *context, IntrinsicResult partialResult) {
-		Value val = context->GetVar("self");
+	static Value intrinsic_len(Context *context, const Value *args) {
+		Value val = args[0];
 		if (val.type == ValueType::List) {
 			ValueList list = val.GetList();
-			return IntrinsicResult(list.Count());
+			return list.Count();
 		} else if (val.type == ValueType::String) {
 			String str = val.GetString();
-			return IntrinsicResult(str.Length());
+			return str.Length();
 		} else if (val.type == ValueType::Map) {
-			return IntrinsicResult(val.GetDict().Count());
+			return val.GetDict().Count();
 		}
-		return IntrinsicResult::Null;
+		return Value::null;
 	}
 	
 	static IntrinsicResult intrinsic_list(Context *context, IntrinsicResult partialResult) {
@@ -297,22 +303,22 @@ namespace MiniScript {
 	};
 	
 	
-	static IntrinsicResult intrinsic_log(Context *context, IntrinsicResult partialResult) {
-		double x = context->GetVar("x").DoubleValue();
-		double base = context->GetVar("base").DoubleValue();
+	static Value intrinsic_log(Context *context, const Value *args) {
+		double x = args[0].DoubleValue();
+		double base = args[1].DoubleValue();
 		double result;
 		if (fabs(base - 2.718282) < 0.000001) result = log(x);
 		else result = log(x) / log(base);
-		return IntrinsicResult(result);
+		return result;
 	}
 	
-	static IntrinsicResult intrinsic_lower(Context *context, IntrinsicResult partialResult) {
-		Value val = context->GetVar("self");
+	static Value intrinsic_lower(Context *context, const Value *args) {
+		Value val = args[0];
 		if (val.type == ValueType::String) {
 			String str = val.GetString();
-			return IntrinsicResult(str.ToLower());
+			return str.ToLower();
 		}
-		return IntrinsicResult(val);
+		return val;
 	}
 
 	static IntrinsicResult intrinsic_map(Context *context, IntrinsicResult partialResult) {
@@ -331,8 +337,8 @@ namespace MiniScript {
 	};
 	
 	
-	static IntrinsicResult intrinsic_pi(Context *context, IntrinsicResult partialResult) {
-		return IntrinsicResult(M_PI);
+	static Value intrinsic_pi(Context *context, const Value *args) {
+		return M_PI;
 	}
 
 	static IntrinsicResult intrinsic_print(Context *context, IntrinsicResult partialResult) {
@@ -349,69 +355,69 @@ namespace MiniScript {
 		return IntrinsicResult::Null;
 	}
 	
-	static IntrinsicResult intrinsic_pop(Context *context, IntrinsicResult partialResult) {
-		Value self = context->GetVar("self");
+	static Value intrinsic_pop(Context *context, const Value *args) {
+		Value self = args[0];
 		if (self.type == ValueType::List) {
 			ValueList list = self.GetList();
 			long count = list.Count();
-			if (count < 1) return IntrinsicResult::Null;
+			if (count < 1) return Value::null;
 			Value result = list[count-1];
 			list.RemoveAt(count-1);
-			return IntrinsicResult(result);
+			return result;
 		} else if (self.type == ValueType::Map) {
 			ValueDict map = self.GetDict();
-			if (map.Count() < 1) return IntrinsicResult::Null;
+			if (map.Count() < 1) return Value::null;
 			ValueDictIterator kv = map.GetIterator();
 			if (!kv.Done()) {
 				Value key = kv.Key();
 				map.Remove(key);
-				return IntrinsicResult(key);
+				return key;
 			}
 		}
-		return IntrinsicResult::Null;
+		return Value::null;
 	}
 	
-	static IntrinsicResult intrinsic_pull(Context *context, IntrinsicResult partialResult) {
-		Value self = context->GetVar("self");
+	static Value intrinsic_pull(Context *context, const Value *args) {
+		Value self = args[0];
 		if (self.type == ValueType::List) {
 			ValueList list = self.GetList();
 			long count = list.Count();
-			if (count < 1) return IntrinsicResult::Null;
+			if (count < 1) return Value::null;
 			Value result = list[0];
 			list.RemoveAt(0);
-			return IntrinsicResult(result);
+			return result;
 		} else if (self.type == ValueType::Map) {
 			ValueDict map = self.GetDict();
-			if (map.Count() < 1) return IntrinsicResult::Null;
+			if (map.Count() < 1) return Value::null;
 			ValueDictIterator kv = map.GetIterator();
 			if (!kv.Done()) {
 				Value key = kv.Key();
 				map.Remove(key);
-				return IntrinsicResult(key);
+				return key;
 			}
 		}
-		return IntrinsicResult::Null;
+		return Value::null;
 	}
 	
-	static IntrinsicResult intrinsic_push(Context *context, IntrinsicResult partialResult) {
-		Value self = context->GetVar("self");
-		Value value = context->GetVar("value");
+	static Value intrinsic_push(Context *context, const Value *args) {
+		Value self = args[0];
+		Value value = args[1];
 		if (self.type == ValueType::List) {
 			ValueList list = self.GetList();
 			list.Add(value);
-			return IntrinsicResult(self);
+			return self;
 		} else if (self.type == ValueType::Map) {
 			ValueDict map = self.GetDict();
 			map.SetValue(value, Value::one);
-			return IntrinsicResult(self);
+			return self;
 		}
-		return IntrinsicResult::Null;
+		return Value::null;
 	}
 	
-	static IntrinsicResult intrinsic_range(Context *context, IntrinsicResult partialResult) {
-		Value p0 = context->GetVar("from");
-		Value p1 = context->GetVar("to");
-		Value p2 = context->GetVar("step");
+	static Value intrinsic_range(Context *context, const Value *args) {
+		Value p0 = args[0];
+		Value p1 = args[1];
+		Value p2 = args[2];
 		double fromVal = p0.DoubleValue();
 		double toVal = p1.DoubleValue();
 		double step = (toVal >= fromVal ? 1 : -1);
@@ -424,12 +430,35 @@ namespace MiniScript {
 			for (double v = fromVal; step > 0 ? (v <= toVal) : (v >= toVal); v += step) {
 				values.Add(v);
 			}
-			return IntrinsicResult(values);
+			return values;
 		} catch (std::bad_alloc e) {
 			LimitExceededException("range() error").raise();
-			return IntrinsicResult::Null;
+			return Value::null;
 		}
 	}
+	
+	// range() as used by a 'for' loop: returns a lazy RangeStorage instead
+	// of building the list, when we can reproduce exactly the values range()
+	// would produce (i.e. integral from and step, with every value exact).
+	// Otherwise, falls back to the ordinary list.
+	static Value intrinsic_rangeIter(Context *context, const Value *args) {
+		double fromVal = args[0].DoubleValue();
+		double toVal = args[1].DoubleValue();
+		double step = (toVal >= fromVal ? 1 : -1);
+		if (args[2].type == ValueType::Number) step = args[2].DoubleValue();
+		if (step == 0) RuntimeException("range() error (step==0)").raise();
+		const double exactLimit = 9007199254740992.0;	// 2^53
+		if (fromVal != floor(fromVal) or step != floor(step) or fabs(fromVal) >= exactLimit
+			or not std::isfinite(toVal)) return intrinsic_range(context, args);
+		// Count the values v = from + i*step that satisfy the loop test in
+		// intrinsic_range; start from an estimate, then correct it exactly.
+		double n = floor((toVal - fromVal) / step);
+		if (n < -1) n = -1;
+		if (fabs(fromVal) + fabs(step) * (n + 2) >= exactLimit) return intrinsic_range(context, args);
+		while (n >= 0 and (step > 0 ? fromVal + n*step > toVal : fromVal + n*step < toVal)) n--;
+		while (step > 0 ? fromVal + (n+1)*step <= toVal : fromVal + (n+1)*step >= toVal) n++;
+		return Value::NewHandle(new RangeStorage(fromVal, step, (long)(n + 1)));
+	}
 
 	static IntrinsicResult intrinsic_refEquals(Context *context, IntrinsicResult partialResult) {
 		Value a = context->GetVar("a");
@@ -453,17 +482,17 @@ namespace MiniScript {
 		return IntrinsicResult(Value::Truth(result));
 	}
 	
-	static IntrinsicResult intrinsic_remove(Context *context, IntrinsicResult partialResult) {
-		Value self = context->GetVar("self");
-		Value k = context->GetVar("k");
+	static Value intrinsic_remove(Context *context, const Value *args) {
+		Value self = args[0];
+		Value k = args[1];
 		if (self.IsNull()) RuntimeException("argument to 'remove' must not be null").raise();
 		if (self.type == ValueType::Map) {
 			ValueDict selfMap = self.GetDict();
 			if (selfMap.ContainsKey(k)) {
 				selfMap.Remove(k);
-				return IntrinsicResult(Value::one);
+				return Value::one;
 			}
-			return IntrinsicResult(Value::zero);
+			return Value::zero;
 		} else if (self.type == ValueType::List) {
 			if (k.IsNull()) RuntimeException("argument to 'remove' must not be null").raise();
 			ValueList selfList = self.GetList();
@@ -471,17 +500,17 @@ namespace MiniScript {
 			if (idx < 0) idx += selfList.Count();
 			CheckRange(idx, 0, selfList.Count()-1);
 			selfList.RemoveAt(idx);
-			return IntrinsicResult::Null;
+			return Value::null;
 		} else if (self.type == ValueType::String) {
 			if (k.IsNull()) RuntimeException("argument to 'remove' must not be null").raise();
 			String selfStr = self.GetString();
 			String substr = k.ToString();
 			long foundPosB = selfStr.IndexOfB(substr);
-			if (foundPosB < 0) return IntrinsicResult(self);
-			return IntrinsicResult(selfStr.ReplaceB(foundPosB, substr.LengthB(), String()));
+			if (foundPosB < 0) return self;
+			return selfStr.ReplaceB(foundPosB, substr.LengthB(), String());
 		}
 		TypeException("Type Error: 'remove' requires map, list, or string").raise();
-		return IntrinsicResult::Null;
+		return Value::null;
 	}
 	
 	static IntrinsicResult intrinsic_replace(Context *context, IntrinsicResult partialResult) {
@@ -537,12 +566,12 @@ namespace MiniScript {
 		return IntrinsicResult::Null;
 	}
 	
-	static IntrinsicResult intrinsic_round(Context *context, IntrinsicResult partialResult) {
-		double num = context->GetVar("x").DoubleValue();
-		long decimalPlaces = context->GetVar("decimalPlaces").IntValue();
-		if (decimalPlaces == 0) return IntrinsicResult(round(num));	// easy case
+	static Value intrinsic_round(Context *context, const Value *args) {
+		double num = args[0].DoubleValue();
+		long decimalPlaces = args[1].IntValue();
+		if (decimalPlaces == 0) return round(num);	// easy case
 		double f = pow(10, decimalPlaces);
-		return IntrinsicResult(round(num*f) / f);
+		return round(num*f) / f;
 	};
 	
 	static IntrinsicResult intrinsic_rnd(Context *context, IntrinsicResult partialResult) {
@@ -553,22 +582,22 @@ namespace MiniScript {
 		return IntrinsicResult(d);
 	};
 
-	static IntrinsicResult intrinsic_sign(Context *context, IntrinsicResult partialResult) {
-		double num = context->GetVar("x").DoubleValue();
-		if (num < 0) return IntrinsicResult(-1);
-		if (num > 0) return IntrinsicResult(Value::one);
-		return IntrinsicResult(Value::zero);
+	static Value intrinsic_sign(Context *context, const Value *args) {
+		double num = args[0].DoubleValue();
+		if (num < 0) return -1;
+		if (num > 0) return Value::one;
+		return Value::zero;
 	};
 
-	static IntrinsicResult intrinsic_sin(Context *context, IntrinsicResult partialResult) {
-		Value radians = context->GetVar("radians");
-		return IntrinsicResult(sin(radians.DoubleValue()));
+	static Value intrinsic_sin(Context *context, const Value *args) {
+		Value radians = args[0];
+		return sin(radians.DoubleValue());
 	}
 	
-	static IntrinsicResult intrinsic_slice(Context *context, IntrinsicResult partialResult) {
-		Value seq = context->GetVar("seq");
-		long fromIdx = context->GetVar("from").IntValue();
-		Value toVal = context->GetVar("to");
+	static Value intrinsic_slice(Context *context, const Value *args) {
+		Value seq = args[0];
+		long fromIdx = args[1].IntValue();
+		Value toVal = args[2];
 		long toIdx = 0;
 		if (not toVal.IsNull()) toIdx = toVal.IntValue();
 		if (seq.type == ValueType::List) {
@@ -585,7 +614,7 @@ namespace MiniScript {
 					slice.Add(list[i]);
 				}
 			}
-			return IntrinsicResult(slice);
+			return slice;
 		} else if (seq.type == ValueType::String) {
 			String str = seq.GetString();
 			long length = str.Length();
@@ -594,10 +623,10 @@ namespace MiniScript {
 			if (toVal.IsNull()) toIdx = length;
 			else if (toIdx < 0) toIdx += length;
 			if (toIdx > length) toIdx = length;
-			if (toIdx - fromIdx <= 0) return IntrinsicResult(Value::emptyString);
-			return IntrinsicResult(str.Substring(fromIdx, toIdx - fromIdx));
+			if (toIdx - fromIdx <= 0) return Value::emptyString;
+			return str.Substring(fromIdx, toIdx - fromIdx);
 		}
-		return IntrinsicResult::Null;
+		return Value::null;
 	}
 	
 
@@ -678,8 +707,8 @@ namespace MiniScript {
 		return IntrinsicResult(list);
 	}
 	
-	static IntrinsicResult intrinsic_sqrt(Context *context, IntrinsicResult partialResult) {
-		return IntrinsicResult(sqrt(context->GetVar("x").DoubleValue()));
+	static Value intrinsic_sqrt(Context *context, const Value *args) {
+		return sqrt(args[0].DoubleValue());
 	}
 	
 	static IntrinsicResult intrinsic_stackTrace(Context *context, IntrinsicResult partialResult) {
@@ -756,8 +785,8 @@ namespace MiniScript {
 		return IntrinsicResult(result);
 	}
 	
-	static IntrinsicResult intrinsic_sum(Context *context, IntrinsicResult partialResult) {
-		Value val = context->GetVar("self");
+	static Value intrinsic_sum(Context *context, const Value *args) {
+		Value val = args[0];
 		double sum = 0;
 		if (val.type == ValueType::List) {
 			ValueList list = val.GetList();
@@ -770,32 +799,32 @@ namespace MiniScript {
 				sum += kv.Value().DoubleValue();
 			}
 		}
-		return IntrinsicResult(sum);
+		return sum;
 	}
 
-	static IntrinsicResult intrinsic_tan(Context *context, IntrinsicResult partialResult) {
-		Value radians = context->GetVar("radians");
-		return IntrinsicResult(tan(radians.DoubleValue()));
+	static Value intrinsic_tan(Context *context, const Value *args) {
+		Value radians = args[0];
+		return tan(radians.DoubleValue());
 	}
 	
 	static IntrinsicResult intrinsic_time(Context *context, IntrinsicResult partialResult) {
 		return IntrinsicResult(context->vm->RunTime());
 	}
 
-	static IntrinsicResult intrinsic_upper(Context *context, IntrinsicResult partialResult) {
-		Value val = context->GetVar("self");
+	static Value intrinsic_upper(Context *context, const Value *args) {
+		Value val = args[0];
 		if (val.type == ValueType::String) {
 			String str = val.GetString();
-			return IntrinsicResult(str.ToUpper());
+			return str.ToUpper();
 		}
-		return IntrinsicResult(val);
+		return val;
 	}
 	
-	static IntrinsicResult intrinsic_val(Context *context, IntrinsicResult partialResult) {
-		Value val = context->GetVar("self");
-		if (val.type == ValueType::Number) return IntrinsicResult(val);
-		if (val.type == ValueType::String) return IntrinsicResult(val.GetString().DoubleValue());
-		return IntrinsicResult::Null;
+	static Value intrinsic_val(Context *context, const Value *args) {
+		Value val = args[0];
+		if (val.type == ValueType::Number) return val;
+		if (val.type == ValueType::String) return val.GetString().DoubleValue();
+		return Value::null;
 	}
 	
 	static IntrinsicResult intrinsic_values(Context *context, IntrinsicResult partialResult) {
@@ -876,6 +905,13 @@ namespace MiniScript {
 	
 	IntrinsicResult Intrinsic::Execute(long id, Context *context, IntrinsicResult partialResult) {
 		Intrinsic* item = GetByID(id);
+		if (item->code == nullptr and item->fastCode != nullptr) {
+			// Adapt the by-name call to the positional convention.
+			const List<FuncParam>& params = item->function->parameters;
+			Value args[maxFastArgs];
+			for (long i=0; i<params.Count(); i++) args[i] = context->GetVar(params[i].name);
+			return IntrinsicResult(item->fastCode(context, args));
+		}
 		return item->code(context, partialResult);
 	}
 
@@ -887,16 +923,33 @@ namespace MiniScript {
 	/// <param name="name">intrinsic name</param>
 	/// <returns>freshly minted (but empty) static Intrinsic</returns>
 	Intrinsic* Intrinsic::Create(String name) {
+		if (registrationClosed) RuntimeException("intrinsics can't be added once other threads have started").raise();
 		Intrinsic* result = new Intrinsic();
 		result->name = name;
 		result->numericID = all.Count();
 		result->function = new FunctionStorage();
+		result->function->intrinsic = result;
 		result->valFunction = Value(result->function);
 		all.Add(result);
 		if (!name.empty()) nameMap.SetValue(name, result);
 		return result;
 	}
 	
+	bool Intrinsic::CallFast(Context *context, long argCount, bool gotSelf, Value self, Value *outResult, bool forIteration) {
+		const List<FuncParam>& params = function->parameters;
+		long paramCount = params.Count();
+		FastCode fn = (forIteration and iterCode != nullptr ? iterCode : fastCode);
+		if (fn == nullptr or paramCount > maxFastArgs) return false;
+		Value args[maxFastArgs];
+		long selfParam = (gotSelf and paramCount > 0 and params[0].name == "self" ? 1 : 0);
+		if (argCount + selfParam > paramCount) TooManyArgumentsException().raise();
+		if (selfParam) args[0] = self;
+		for (long i = argCount - 1; i >= 0; i--) args[i + selfParam] = context->args.Pop();
+		for (long i = argCount + selfParam; i < paramCount; i++) args[i] = params[i].defaultValue;
+		*outResult = fn(context, args);
+		return true;
+	}
+	
 	void Intrinsic::AddParam(String name, double defaultValue) {
 		if (defaultValue == 0) AddParam(name, Value::zero);
 		else if (defaultValue == 1) AddParam(name, Value::one);
@@ -917,47 +970,48 @@ namespace MiniScript {
 	void Intrinsics::InitIfNeeded() {
 		if (initialized) return;		// our work is already done; bail out
 		initialized = true;
+		long firstCore = Intrinsic::all.Count();
 		Intrinsic *f;
 		
 		f = Intrinsic::Create("abs");
 		f->AddParam("x", 0);
-		f->code = &intrinsic_abs;
+		f->fastCode = &intrinsic_abs;
 		
 		f = Intrinsic::Create("acos");
 		f->AddParam("x", 0);
-		f->code = &intrinsic_acos;
+		f->fastCode = &intrinsic_acos;
 		
 		f = Intrinsic::Create("asin");
 		f->AddParam("x", 0);
-		f->code = &intrinsic_asin;
+		f->fastCode = &intrinsic_asin;
 		
 		f = Intrinsic::Create("atan");
 		f->AddParam("y", 0);
 		f->AddParam("x", 1);
-		f->code = &intrinsic_atan;
+		f->fastCode = &intrinsic_atan;
 		
 		f = Intrinsic::Create("bitAnd");
 		f->AddParam("i", 0);
 		f->AddParam("j", 0);
-		f->code = &intrinsic_bitAnd;
+		f->fastCode = &intrinsic_bitAnd;
 		
 		f = Intrinsic::Create("bitOr");
 		f->AddParam("i", 0);
 		f->AddParam("j", 0);
-		f->code = &intrinsic_bitOr;
+		f->fastCode = &intrinsic_bitOr;
 		
 		f = Intrinsic::Create("bitXor");
 		f->AddParam("i", 0);
 		f->AddParam("j", 0);
-		f->code = &intrinsic_bitXor;
+		f->fastCode = &intrinsic_bitXor;
 		
 		f = Intrinsic::Create("char");
 		f->AddParam("codePoint", 65);
-		f->code = &intrinsic_char;
+		f->fastCode = &intrinsic_char;
 		
 		f = Intrinsic::Create("ceil");
 		f->AddParam("x", 0);
-		f->code = &intrinsic_ceil;
+		f->fastCode = &intrinsic_ceil;
 		
 		f = Intrinsic::Create("code");
 		f->AddParam("self");
@@ -965,11 +1019,11 @@ namespace MiniScript {
 		
 		f = Intrinsic::Create("cos");
 		f->AddParam("radians", 0);
-		f->code = &intrinsic_cos;
+		f->fastCode = &intrinsic_cos;
 		
 		f = Intrinsic::Create("floor");
 		f->AddParam("x", 0);
-		f->code = &intrinsic_floor;
+		f->fastCode = &intrinsic_floor;
 		
 		f = Intrinsic::Create("funcRef");
 		f->code = &intrinsic_function;
@@ -981,7 +1035,7 @@ namespace MiniScript {
 		f = Intrinsic::Create("hasIndex");
 		f->AddParam("self");
 		f->AddParam("index");
-		f->code = &intrinsic_hasIndex;
+		f->fastCode = &intrinsic_hasIndex;
 		
 		f = Intrinsic::Create("indexes");
 		f->AddParam("self");
@@ -991,13 +1045,13 @@ namespace MiniScript {
 		f->AddParam("self");
 		f->AddParam("value");
 		f->AddParam("after", Value::null);
-		f->code = &intrinsic_indexOf;
+		f->fastCode = &intrinsic_indexOf;
 		
 		f = Intrinsic::Create("insert");
 		f->AddParam("self");
 		f->AddParam("index");
 		f->AddParam("value");
-		f->code = &intrinsic_insert;
+		f->fastCode = &intrinsic_insert;
 		
 		f = Intrinsic::Create("intrinsics");
 		f->code = &intrinsic_intrinsics;
@@ -1009,7 +1063,7 @@ namespace MiniScript {
 		
 		f = Intrinsic::Create("len");
 		f->AddParam("self");
-		f->code = &intrinsic_len;
+		f->fastCode = &intrinsic_len;
 		
 		f = Intrinsic::Create("list");
 		f->code = &intrinsic_list;
@@ -1017,11 +1071,11 @@ namespace MiniScript {
 		f = Intrinsic::Create("log");
 		f->AddParam("x");
 		f->AddParam("base", 10);
-		f->code = &intrinsic_log;
+		f->fastCode = &intrinsic_log;
 		
 		f = Intrinsic::Create("lower");
 		f->AddParam("self");
-		f->code = &intrinsic_lower;
+		f->fastCode = &intrinsic_lower;
 		
 		f = Intrinsic::Create("map");
 		f->code = &intrinsic_map;
@@ -1030,7 +1084,7 @@ namespace MiniScript {
 		f->code = &intrinsic_number;
 		
 		f = Intrinsic::Create("pi");
-		f->code = &intrinsic_pi;
+		f->fastCode = &intrinsic_pi;
 		
 		f = Intrinsic::Create("print");
 		f->AddParam("s", Value::emptyString);
@@ -1039,22 +1093,23 @@ namespace MiniScript {
 		
 		f = Intrinsic::Create("pop");
 		f->AddParam("self");
-		f->code = &intrinsic_pop;
+		f->fastCode = &intrinsic_pop;
 		
 		f = Intrinsic::Create("pull");
 		f->AddParam("self");
-		f->code = &intrinsic_pull;
+		f->fastCode = &intrinsic_pull;
 		
 		f = Intrinsic::Create("push");
 		f->AddParam("self");
 		f->AddParam("value");
-		f->code = &intrinsic_push;
+		f->fastCode = &intrinsic_push;
 		
 		f = Intrinsic::Create("range");
 		f->AddParam("from", 0);
 		f->AddParam("to", 0);
 		f->AddParam("step");
-		f->code = &intrinsic_range;
+		f->fastCode = &intrinsic_range;
+		f->iterCode = &intrinsic_rangeIter;
 		
 		f = Intrinsic::Create("refEquals");
 		f->AddParam("a");
@@ -1064,7 +1119,7 @@ namespace MiniScript {
 		f = Intrinsic::Create("remove");
 		f->AddParam("self");
 		f->AddParam("k");
-		f->code = &intrinsic_remove;
+		f->fastCode = &intrinsic_remove;
 		
 		f = Intrinsic::Create("replace");
 		f->AddParam("self");
@@ -1076,7 +1131,7 @@ namespace MiniScript {
 		f = Intrinsic::Create("round");
 		f->AddParam("x", 0);
 		f->AddParam("decimalPlaces", 0);
-		f->code = &intrinsic_round;
+		f->fastCode = &intrinsic_round;
 		
 		f = Intrinsic::Create("rnd");
 		f->AddParam("seed");
@@ -1084,17 +1139,17 @@ namespace MiniScript {
 
 		f = Intrinsic::Create("sign");
 		f->AddParam("x", 0);
-		f->code = &intrinsic_sign;
+		f->fastCode = &intrinsic_sign;
 
 		f = Intrinsic::Create("sin");
 		f->AddParam("radians", 0);
-		f->code = &intrinsic_sin;
+		f->fastCode = &intrinsic_sin;
 
 		f = Intrinsic::Create("slice");
 		f->AddParam("seq");
 		f->AddParam("from", 0);
 		f->AddParam("to");
-		f->code = &intrinsic_slice;
+		f->fastCode = &intrinsic_slice;
 
 		f = Intrinsic::Create("sort");
 		f->AddParam("self", 0);
@@ -1110,7 +1165,7 @@ namespace MiniScript {
 
 		f = Intrinsic::Create("sqrt");
 		f->AddParam("x", 0);
-		f->code = &intrinsic_sqrt;
+		f->fastCode = &intrinsic_sqrt;
 
 		f = Intrinsic::Create("stackTrace");
 		f->code = &intrinsic_stackTrace;
@@ -1128,22 +1183,22 @@ namespace MiniScript {
 
 		f = Intrinsic::Create("sum");
 		f->AddParam("self");
-		f->code = &intrinsic_sum;
+		f->fastCode = &intrinsic_sum;
 
 		f = Intrinsic::Create("tan");
 		f->AddParam("radians", 0);
-		f->code = &intrinsic_tan;
+		f->fastCode = &intrinsic_tan;
 
 		f = Intrinsic::Create("time");
 		f->code = &intrinsic_time;
 
 		f = Intrinsic::Create("upper");
 		f->AddParam("self");
-		f->code = &intrinsic_upper;
+		f->fastCode = &intrinsic_upper;
 		
 		f = Intrinsic::Create("val");
 		f->AddParam("self", 0);
-		f->code = &intrinsic_val;
+		f->fastCode = &intrinsic_val;
 
 		f = Intrinsic::Create("values");
 		f->AddParam("self");
@@ -1159,6 +1214,36 @@ namespace MiniScript {
 		f = Intrinsic::Create("yield");
 		f->code = &intrinsic_yield;
 		
+		// All the core intrinsics work on any thread.
+		for (long i=firstCore; i<Intrinsic::all.Count(); i++) Intrinsic::all[i]->threadSafe = true;
+	}
+	
+	void Intrinsics::PrepareForThreads() {
+		if (preparedForThreads) return;
+		InitIfNeeded();
+		preparedForThreads = true;
+		
+		// Other threads will read the list and name map of intrinsics without
+		// locking, so from here on they must not change.
+		Intrinsic::registrationClosed = true;
+		
+		// Make everything other threads may see permanent, so they can share it.
+		for (long i=0; i<Intrinsic::all.Count(); i++) {
+			Intrinsic *intrinsic = Intrinsic::all[i];
+			if (!intrinsic->threadSafe) continue;
+			intrinsic->name.MakeImmortal();
+			intrinsic->GetFunc().MakeImmortal();
+		}
+		Value::emptyString.MakeImmortal();
+		Value::magicIsA.MakeImmortal();
+		Value::keyString.MakeImmortal();
+		Value::valueString.MakeImmortal();
+		Value::implicitResult.MakeImmortal();
+		IntrinsicResult::EmptyString.Result().MakeImmortal();
+		_EOL.MakeImmortal();
+		VERSION.MakeImmortal();
+		hostName.MakeImmortal();
+		hostInfo.MakeImmortal();
 	}
 	
 	// Helper method to compile a call to Slice (when invoked directly via slice syntax).
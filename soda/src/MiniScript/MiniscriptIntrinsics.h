@@ -41,6 +41,13 @@ namespace MiniScript {
 	public:
 		static void InitIfNeeded();
 		
+		// Get ready for interpreters on other threads: make the thread-safe
+		// intrinsics, and the other values they share, permanent (see
+		// Value::MakeImmortal), and close registration (see Intrinsic::Create),
+		// so the tables other threads read never change again.  Call on the
+		// main thread before starting any others, once all intrinsics exist.
+		static void PrepareForThreads();
+		
 		// Helper method to compile a call to Slice.
 		static void CompileSlice(List<TACLine> code, Value list, Value fromIdx, Value toIdx, int resultTempNum);
 		
@@ -55,46 +62,38 @@ namespace MiniScript {
 		static Value StringType();
 	private:
 		static bool initialized;
+		static bool preparedForThreads;
 	};
 	
-	class IntrinsicResultStorage : public RefCountedStorage {
+	// Lazy numeric sequence used in place of a range() list when that is
+	// only iterated over by a 'for' loop: element i is from + i*step.
+	class RangeStorage : public RefCountedStorage {
 	public:
-		bool done;			// true if our work is complete; false if we need to Continue
-		Value result;		// final result if done; in-progress data if not done
-		
-	private:
-		IntrinsicResultStorage() : done(true) {}
-		virtual ~IntrinsicResultStorage() {}
-		friend class IntrinsicResult;
+		RangeStorage(double from, double step, long count) : from(from), step(step), count(count) {}
+		double from;
+		double step;
+		long count;
 	};
 	
+	// What an intrinsic returns: its result, and whether it's done.  This is
+	// a plain value type, so returning one allocates nothing.  An intrinsic
+	// that needs several calls to finish (like wait or import) returns its
+	// in-progress state as the result, with done = false; it's passed back
+	// as partialResult on the next call.
 	class IntrinsicResult {
 	public:
-		IntrinsicResult() : rs(nullptr) {}
-		IntrinsicResult(Value value, bool done=true) : rs(nullptr) {
-			ensureStorage();
-			rs->result = value;
-			rs->done = done;
-		}
-		IntrinsicResult(const IntrinsicResult& other) {	((IntrinsicResult&)other).ensureStorage(); rs = other.rs; retain(); }
-		IntrinsicResult& operator= (const IntrinsicResult& other) {	((IntrinsicResult&)other).ensureStorage(); other.rs->refCount++; release(); rs = other.rs; return *this; }
-
-		~IntrinsicResult() { release(); }
+		IntrinsicResult() : done(true) {}
+		IntrinsicResult(Value value, bool done=true) : result(value), done(done) {}
 		
-		bool Done() { return not rs or rs->done; }
-		Value Result() { return rs ? rs->result : Value::null; }
+		bool Done() const { return done; }
+		Value Result() const { return result; }
 
 		static IntrinsicResult Null;		// represents a completed, null result
 		static IntrinsicResult EmptyString;	// represents "" (empty string) result
 		
 	private:
-		IntrinsicResult(IntrinsicResultStorage* storage) : rs(storage) {}  // (assumes we grab an existing reference)
-		void forget() { rs = nullptr; }
-		
-		void retain() { if (rs) rs->refCount++; }
-		void release() { if (rs and --(rs->refCount) == 0) { delete rs; rs = nullptr; } }
-		void ensureStorage() { if (!rs) rs = new IntrinsicResultStorage(); }
-		IntrinsicResultStorage *rs;
+		Value result;		// final result if done; in-progress data if not done
+		bool done;			// true if our work is complete; false if we need to Continue
 	};
 
 	class Intrinsic {
@@ -105,10 +104,32 @@ namespace MiniScript {
 		// actual C++ code invoked by the intrinsic
 		IntrinsicResult (*code)(Context *context, IntrinsicResult partialResult);
 		
+		// Optional fast calling convention: if set, the VM calls this directly,
+		// with the arguments in parameter order (defaults filled in), instead
+		// of creating a call context and storing the arguments by name.  The
+		// context given is the caller's, so use it only for things like ->vm.
+		// Must complete immediately (no partial results).  Intrinsics using this
+		// need not set code at all; calls via the by-name path are adapted.
+		typedef Value (*FastCode)(Context *context, const Value *args);
+		FastCode fastCode;
+		
+		// Optional variant of fastCode used when the result will only be
+		// iterated over by a 'for' loop; may return a lazy sequence (see RangeStorage).
+		FastCode iterCode;
+		static const int maxFastArgs = 8;
+		
+		// Whether this intrinsic may be used on a thread other than the main
+		// one.  True for all the core intrinsics; hosts set it for their own
+		// when that's safe.
+		bool threadSafe;
+		
+		// Set on each thread that should see only thread-safe intrinsics (by name).
+		static thread_local bool threadSafeOnly;
+		
 		// a numeric ID (used internally -- don't worry about this)
 		long id() { return numericID; }
 		
-		void AddParam(String name, Value defaultValue) { function->parameters.Add(FuncParam(name, defaultValue)); }
+		void AddParam(String name, Value defaultValue) { function->parameters.Add(FuncParam(name.Intern(), defaultValue)); }
 		void AddParam(String name, double defaultValue);
 		void AddParam(String name) { AddParam(name, Value::null); }
 
@@ -124,14 +145,26 @@ namespace MiniScript {
 			Intrinsics::InitIfNeeded();
 			Intrinsic* result = nullptr;
 			nameMap.Get(name, &result);
+			if (result and threadSafeOnly and !result->threadSafe) return nullptr;
 			return result;
 		}
 		
 		/// Factory method to create a new Intrinsic, filling out its name as given,
 		/// and other internal properties as needed.  You'll still need to add any
-		/// parameters, and define the code it runs.
+		/// parameters, and define the code it runs.  Raises an exception once
+		/// registration is closed (see Intrinsics::PrepareForThreads).
 		static Intrinsic* Create(String name);
 		
+		// Set when other threads may be reading `all` and the name map, so
+		// that no more intrinsics may be created.
+		static bool registrationClosed;
+		
+		// Internally-used function to call this intrinsic via fastCode (or iterCode,
+		// if forIteration and we have one), popping argCount arguments off the
+		// caller's argument stack.  Returns false (consuming nothing) if this
+		// intrinsic doesn't support that.
+		bool CallFast(Context *context, long argCount, bool gotSelf, Value self, Value *outResult, bool forIteration=false);
+		
 		// Internally-used function to execute an intrinsic (by ID) given a context
 		// and a partial result.
 		static IntrinsicResult Execute(long id, Context *context, IntrinsicResult partialResult);
@@ -140,7 +173,7 @@ namespace MiniScript {
 		static List<Intrinsic*> all;
 
 	private:
-		Intrinsic() {}		// don't use this; use Create factory method instead.
+		Intrinsic() : code(nullptr), fastCode(nullptr), iterCode(nullptr), threadSafe(false) {}		// don't use this; use Create factory method instead.
 
 		FunctionStorage* function;
 		Value valFunction;		// (cached wrapper for function)
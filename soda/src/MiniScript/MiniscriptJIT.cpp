@@ -0,0 +1,644 @@
+//
+//  MiniscriptJIT.cpp
+//  MiniScript
+//
+//  See MiniscriptJIT.h.  Each variable and temp of a compiled function gets
+//  a slot in a frame of doubles; the native code reads and writes those
+//  slots directly, and calls small C helpers for anything that isn't a
+//  single instruction (%, ^, and/or/not), so that results match what
+//  TACLine::Evaluate would compute exactly.
+//
+
+#include "MiniscriptJIT.h"
+#include "MiniscriptTypes.h"
+#include "SimpleVector.h"
+#include "UnitTest.h"
+#include <cmath>
+#include <string.h>
+#include <stdint.h>
+
+#if defined(__x86_64__) && !defined(_WIN32)
+	#define JIT_X64 1
+	#include <sys/mman.h>
+#else
+	#define JIT_X64 0
+#endif
+
+namespace MiniScript {
+
+	bool JIT::enabled = false;
+	bool JIT::check = false;
+	long JIT::threshold = 2;
+	TextOutputMethod JIT::report = nullptr;
+	thread_local long JIT::compiledCount = 0;
+	thread_local long JIT::nativeCalls = 0;
+	thread_local long JIT::bailouts = 0;
+	thread_local long JIT::checkedCalls = 0;
+	thread_local long JIT::mismatches = 0;
+
+	typedef TACLine::Op Op;
+
+	static const long maxSlots = 256;			// variables + temps per function
+	static const long loopBudget = 1000000;		// backward jumps before we hand back
+
+	// A set of frame slots.
+	struct SlotSet {
+		uint64_t bits[maxSlots / 64];
+		void Clear() { memset(bits, 0, sizeof(bits)); }
+		bool Has(long slot) const { return (bits[slot >> 6] >> (slot & 63)) & 1; }
+		void Add(long slot) { bits[slot >> 6] |= (uint64_t)1 << (slot & 63); }
+		bool IntersectWith(const SlotSet& other) {
+			bool changed = false;
+			for (long i=0; i<maxSlots/64; i++) {
+				uint64_t b = bits[i] & other.bits[i];
+				if (b != bits[i]) changed = true;
+				bits[i] = b;
+			}
+			return changed;
+		}
+	};
+
+	// Native entry point.  Returns 0 if the function returned a number (now
+	// in the temp 0 slot), 1 if it returned null, or 2 if it stopped early,
+	// with *resumeLine set to the line the interpreter should carry on from.
+	typedef int (*NativeFunc)(double *frame, long *resumeLine);
+
+	class JitCode {
+	public:
+		JitCode() : entry(nullptr), mem(nullptr), memSize(0), slotCount(0), tempBase(0) {}
+
+		NativeFunc entry;			// null if the function couldn't be compiled
+		void *mem;
+		size_t memSize;
+		List<String> varNames;		// names of the variable slots (parameters first)
+		long slotCount;
+		long tempBase;				// slot of temp 0; temps follow the variables
+		SimpleVector<SlotSet> assigned;	// slots certainly assigned on entry to each line
+	};
+
+	// State passed from TryCall to Resume when native code stops early.
+	struct PendingResume {
+		JitCode *code;
+		long line;
+		double frame[maxSlots];
+	};
+	static thread_local PendingResume pending;
+
+	//--------------------------------------------------------------------------------
+	// Runtime helpers called from native code.  These must match TACLine::Evaluate.
+
+	static inline double AbsClamp01(double d) {
+		if (std::signbit(d)) d = -d;
+		if (d > 1) return 1;
+		return d;
+	}
+	static double HelperMod(double a, double b) { return fmod(a, b); }
+	static double HelperPow(double a, double b) { return pow(a, b); }
+	static double HelperAnd(double a, double b) { return AbsClamp01(a * b); }
+	static double HelperOr(double a, double b) { return AbsClamp01(a + b - a * b); }
+	static double HelperNot(double a) { return 1.0 - AbsClamp01(a); }
+	static int HelperTruly(double a) { return Value(a).IntValue() != 0; }
+
+	//--------------------------------------------------------------------------------
+	// Compiler: checks that a function fits the numeric subset, works out which
+	// slots are assigned where, and (on x86-64) generates the native code.
+
+	class Compiler {
+	public:
+		Compiler(FunctionStorage *func, JitCode *out) : func(func), code(func->code), out(out) {}
+		bool Run() { return Analyze() and Generate(); }
+		String reason;		// why we couldn't compile, if we couldn't
+
+	private:
+		FunctionStorage *func;
+		List<TACLine>& code;
+		JitCode *out;
+
+		bool Fail(String why) { reason = why; return false; }
+		long VarSlot(const String& name) const;
+		long SlotOf(const Value& v) const;
+		bool IsOperand(const Value& v) const;
+		bool CheckLine(long lineNum);
+		bool Analyze();
+		bool Generate();
+	};
+
+	static bool IsJump(Op op) {
+		return op == Op::GotoA or op == Op::GotoAifB or op == Op::GotoAifTrulyB or op == Op::GotoAifNotB;
+	}
+
+	static bool IsReservedName(const String& name) {
+		return name == "self" or name == "super" or name == "locals" or name == "globals" or name == "outer";
+	}
+
+	long Compiler::VarSlot(const String& name) const {
+		for (long i=0; i<out->varNames.Count(); i++) if (out->varNames[i] == name) return i;
+		return -1;
+	}
+
+	long Compiler::SlotOf(const Value& v) const {
+		if (v.type == ValueType::Temp) return out->tempBase + v.data.tempNum;
+		if (v.type == ValueType::Var) return VarSlot(v.GetString());
+		return -1;
+	}
+
+	bool Compiler::IsOperand(const Value& v) const {
+		return v.type == ValueType::Number or SlotOf(v) >= 0;
+	}
+
+	// Check that the given line is one we can compile.
+	bool Compiler::CheckLine(long lineNum) {
+		TACLine& line = code[lineNum];
+		Op op = TACLine::GenericOp(line.op);
+		switch (op) {
+			case Op::Noop:
+				return true;
+			case Op::GotoA: case Op::GotoAifB: case Op::GotoAifTrulyB: case Op::GotoAifNotB:
+				if (line.rhsA.type != ValueType::Number) return Fail("computed jump");
+				if (line.rhsA.IntValue() < 0 or line.rhsA.IntValue() > code.Count()) return Fail("bad jump target");
+				if (op != Op::GotoA and !IsOperand(line.rhsB)) return Fail("non-numeric condition");
+				return true;
+			case Op::ReturnA:
+				if (line.lhs.type != ValueType::Temp or line.lhs.data.tempNum != 0) return Fail("unusual return");
+				if (!line.rhsA.IsNull() and !IsOperand(line.rhsA)) return Fail("non-numeric return value");
+				return true;
+			default:
+				break;
+		}
+		// Everything else stores into a temp (other than temp 0) or a local.
+		if (line.lhs.type == ValueType::Temp) {
+			if (line.lhs.data.tempNum == 0) return Fail("temp 0 assigned outside of return");
+		} else if (line.lhs.type != ValueType::Var) {
+			return Fail("assignment to a map or list element");
+		}
+		switch (op) {
+			case Op::AssignA:
+				if (!IsOperand(line.rhsA)) return Fail("non-numeric assignment");
+				return true;
+			case Op::CallFunctionA:
+				// (a plain read of a local; anything else is a real call)
+				if (line.rhsA.type != ValueType::Var or VarSlot(line.rhsA.GetString()) < 0) return Fail("function call");
+				if (line.rhsB.type != ValueType::Number or line.rhsB.data.number != 0) return Fail("function call");
+				return true;
+			case Op::NotA:
+				if (!IsOperand(line.rhsA)) return Fail("non-numeric operand");
+				return true;
+			case Op::APlusB: case Op::AMinusB: case Op::ATimesB: case Op::ADividedByB:
+			case Op::AModB: case Op::APowB: case Op::AEqualB: case Op::ANotEqualB:
+			case Op::AGreaterThanB: case Op::AGreatOrEqualB: case Op::ALessThanB:
+			case Op::ALessOrEqualB: case Op::AAndB: case Op::AOrB:
+				if (!IsOperand(line.rhsA) or !IsOperand(line.rhsB)) return Fail("non-numeric operand");
+				return true;
+			default:
+				return Fail(String("unsupported op: ") + line.ToString());
+		}
+	}
+
+	bool Compiler::Analyze() {
+		long count = code.Count();
+		if (count == 0) return Fail("empty function");
+
+		// Variable slots: parameters first, then every local assigned anywhere.
+		for (long i=0; i<func->parameters.Count(); i++) {
+			String name = func->parameters[i].name;
+			if (IsReservedName(name)) return Fail(String("parameter named ") + name);
+			out->varNames.Add(name);
+		}
+		long maxTemp = 0;
+		for (long i=0; i<count; i++) {
+			const Value& lhs = code[i].lhs;
+			if (lhs.type == ValueType::Var) {
+				String name = lhs.GetString();
+				if (IsReservedName(name)) return Fail(String("assigns to ") + name);
+				if (VarSlot(name) < 0) out->varNames.Add(name);
+			} else if (lhs.type == ValueType::Temp and lhs.data.tempNum > maxTemp) {
+				maxTemp = lhs.data.tempNum;
+			}
+		}
+		out->tempBase = out->varNames.Count();
+		out->slotCount = out->tempBase + maxTemp + 1;
+		if (out->slotCount > maxSlots) return Fail("too many variables");
+		for (long i=0; i<count; i++) if (!CheckLine(i)) return false;
+
+		// Work out which slots are certainly assigned on entry to each line.
+		SimpleVector<bool> reached;
+		SimpleVector<long> work;
+		out->assigned.resize(count);
+		reached.resize(count);
+		for (long i=0; i<count; i++) reached[i] = false;
+		out->assigned[0].Clear();
+		for (long i=0; i<func->parameters.Count(); i++) out->assigned[0].Add(i);
+		reached[0] = true;
+		work.push_back(0);
+		while (!work.empty()) {
+			long i = work.pop_back();
+			TACLine& line = code[i];
+			Op op = TACLine::GenericOp(line.op);
+			if (op == Op::ReturnA) continue;
+			SlotSet after = out->assigned[i];
+			if (!IsJump(op) and op != Op::Noop) after.Add(SlotOf(line.lhs));
+			long succ[2] = { i + 1, -1 };
+			if (op == Op::GotoA) succ[0] = line.rhsA.IntValue();
+			else if (IsJump(op)) succ[1] = line.rhsA.IntValue();
+			for (int s=0; s<2; s++) {
+				long next = succ[s];
+				if (next < 0 or next >= count) continue;
+				if (!reached[next]) {
+					reached[next] = true;
+					out->assigned[next] = after;
+				} else if (!out->assigned[next].IntersectWith(after)) {
+					continue;
+				}
+				work.push_back(next);
+			}
+		}
+
+		// Every read must be of a slot that's certainly been assigned.  (Reading
+		// an unassigned local would fall back to an outer or global variable.)
+		for (long i=0; i<count; i++) {
+			if (!reached[i]) continue;
+			TACLine& line = code[i];
+			Op op = TACLine::GenericOp(line.op);
+			Value *reads[2] = { &line.rhsA, &line.rhsB };
+			if (IsJump(op)) reads[0] = nullptr;
+			if (op == Op::CallFunctionA) reads[1] = nullptr;
+			for (int r=0; r<2; r++) {
+				if (reads[r] == nullptr) continue;
+				long slot = SlotOf(*reads[r]);
+				if (slot >= 0 and !out->assigned[i].Has(slot)) {
+					return Fail(String("possibly unassigned: ") + reads[r]->ToString());
+				}
+			}
+		}
+		return true;
+	}
+
+#if JIT_X64
+
+	// A minimal x86-64 assembler: just the instructions we need, with
+	// labels (one per TAC line, plus extras) and 32-bit jump fixups.
+	class Assembler {
+	public:
+		SimpleVector<unsigned char> bytes;
+
+		void Byte(unsigned char b) { bytes.push_back(b); }
+		void Bytes(const char *s, long n) { for (long i=0; i<n; i++) Byte((unsigned char)s[i]); }
+		void Int32(int32_t v) { for (int i=0; i<4; i++) Byte((v >> (i*8)) & 0xFF); }
+		void Int64(uint64_t v) { for (int i=0; i<8; i++) Byte((v >> (i*8)) & 0xFF); }
+
+		long NewLabel() { labels.push_back(-1); return labels.size() - 1; }
+		void Bind(long label) { labels[label] = bytes.size(); }
+
+		// jmp label
+		void Jmp(long label) { Byte(0xE9); Fixup(label); }
+		// jcc label, where cc is the second byte of the 0F 8x form
+		void Jcc(unsigned char cc, long label) { Byte(0x0F); Byte(cc); Fixup(label); }
+
+		// movabs rax, imm64
+		void MovRaxImm(uint64_t v) { Byte(0x48); Byte(0xB8); Int64(v); }
+		// movsd xmmN, [rbx + slot*8]
+		void LoadSlot(int xmm, long slot) { Bytes("\xF2\x0F\x10", 3); Byte(0x83 | (xmm << 3)); Int32((int32_t)(slot * 8)); }
+		// movsd [rbx + slot*8], xmm0
+		void StoreSlot(long slot) { Bytes("\xF2\x0F\x11\x83", 4); Int32((int32_t)(slot * 8)); }
+		// movq xmmN, rax
+		void MovXmmRax(int xmm) { Bytes("\x66\x48\x0F\x6E", 4); Byte(0xC0 | (xmm << 3)); }
+		// mov rax, fn; call rax
+		void Call(const void *fn) { MovRaxImm((uint64_t)(uintptr_t)fn); Byte(0xFF); Byte(0xD0); }
+		// mov eax, imm32
+		void MovEax(int32_t v) { Byte(0xB8); Int32(v); }
+
+		bool Link() {
+			VecIterate(i, fixups) {
+				long target = labels[fixups[i].label];
+				if (target < 0) return false;
+				int32_t rel = (int32_t)(target - (fixups[i].pos + 4));
+				for (int b=0; b<4; b++) bytes[fixups[i].pos + b] = (rel >> (b*8)) & 0xFF;
+			}
+			return true;
+		}
+
+	private:
+		struct Fix { long pos; long label; };
+		SimpleVector<long> labels;
+		SimpleVector<Fix> fixups;
+		void Fixup(long label) { Fix f = { (long)bytes.size(), label }; fixups.push_back(f); Int32(0); }
+	};
+
+	bool Compiler::Generate() {
+		Assembler a;
+		long count = code.Count();
+		for (long i=0; i<count; i++) a.NewLabel();		// label i: start of line i
+		long endLabel = a.NewLabel();					// fell off the end: return null
+		long exitLabel = a.NewLabel();
+
+		// Backward jumps go through a stub that counts down our loop budget.
+		struct Stub { long label; long target; };
+		SimpleVector<Stub> stubs;
+
+		// Prologue: rbx = frame, r13 = resumeLine pointer, r12 = loop budget.
+		a.Byte(0x53);								// push rbx
+		a.Bytes("\x41\x54\x41\x55", 4);				// push r12; push r13
+		a.Bytes("\x48\x89\xFB", 3);					// mov rbx, rdi
+		a.Bytes("\x49\x89\xF5", 3);					// mov r13, rsi
+		a.Bytes("\x49\xBC", 2); a.Int64(loopBudget);	// mov r12, loopBudget
+
+		for (long i=0; i<count; i++) {
+			a.Bind(i);
+			TACLine& line = code[i];
+			Op op = TACLine::GenericOp(line.op);
+
+			// Load an operand (number or slot) into xmm register n.
+			#define LOAD(n, v) do { long s_ = SlotOf(v); \
+				if (s_ >= 0) a.LoadSlot(n, s_); \
+				else { double d_ = (v).data.number; uint64_t u_; memcpy(&u_, &d_, 8); a.MovRaxImm(u_); a.MovXmmRax(n); } \
+			} while (0)
+
+			long jumpLabel = -1;
+			if (IsJump(op)) {
+				long target = line.rhsA.IntValue();
+				if (target > i) jumpLabel = target;
+				else {
+					Stub s = { a.NewLabel(), target };
+					stubs.push_back(s);
+					jumpLabel = s.label;
+				}
+			}
+
+			switch (op) {
+				case Op::Noop:
+					break;
+				case Op::GotoA:
+					a.Jmp(jumpLabel);
+					break;
+				case Op::GotoAifB:			// jump if nonzero (NaN counts as nonzero)
+					LOAD(0, line.rhsB);
+					a.Bytes("\x66\x0F\x57\xC9", 4);		// xorpd xmm1, xmm1
+					a.Bytes("\x66\x0F\x2E\xC1", 4);		// ucomisd xmm0, xmm1
+					a.Jcc(0x85, jumpLabel);				// jne
+					a.Jcc(0x8A, jumpLabel);				// jp
+					break;
+				case Op::GotoAifNotB:		// jump if exactly zero
+					LOAD(0, line.rhsB);
+					a.Bytes("\x66\x0F\x57\xC9", 4);		// xorpd xmm1, xmm1
+					a.Bytes("\x66\x0F\x2E\xC1", 4);		// ucomisd xmm0, xmm1
+					a.Bytes("\x7A\x06", 2);				// jp (over the je)
+					a.Jcc(0x84, jumpLabel);				// je
+					break;
+				case Op::GotoAifTrulyB:
+					LOAD(0, line.rhsB);
+					a.Call((const void*)&HelperTruly);
+					a.Bytes("\x85\xC0", 2);				// test eax, eax
+					a.Jcc(0x85, jumpLabel);				// jne
+					break;
+				case Op::ReturnA:
+					if (line.rhsA.IsNull()) {
+						a.MovEax(1);
+					} else {
+						LOAD(0, line.rhsA);
+						a.StoreSlot(out->tempBase);
+						a.MovEax(0);
+					}
+					a.Jmp(exitLabel);
+					break;
+				case Op::AssignA:
+				case Op::CallFunctionA:
+					LOAD(0, line.rhsA);
+					a.StoreSlot(SlotOf(line.lhs));
+					break;
+				case Op::NotA:
+					LOAD(0, line.rhsA);
+					a.Call((const void*)&HelperNot);
+					a.StoreSlot(SlotOf(line.lhs));
+					break;
+				default:
+					// binary operators: A in xmm0, B in xmm1, result in xmm0
+					LOAD(0, line.rhsA);
+					LOAD(1, line.rhsB);
+					switch (op) {
+						case Op::APlusB:		a.Bytes("\xF2\x0F\x58\xC1", 4); break;		// addsd
+						case Op::AMinusB:		a.Bytes("\xF2\x0F\x5C\xC1", 4); break;		// subsd
+						case Op::ATimesB:		a.Bytes("\xF2\x0F\x59\xC1", 4); break;		// mulsd
+						case Op::ADividedByB:	a.Bytes("\xF2\x0F\x5E\xC1", 4); break;		// divsd
+						case Op::AModB:			a.Call((const void*)&HelperMod); break;
+						case Op::APowB:			a.Call((const void*)&HelperPow); break;
+						case Op::AAndB:			a.Call((const void*)&HelperAnd); break;
+						case Op::AOrB:			a.Call((const void*)&HelperOr); break;
+						default:
+							// Comparisons: set al to 0 or 1, then convert to a double.
+							// (ucomisd flags an unordered (NaN) compare as ZF=PF=CF=1.)
+							switch (op) {
+								case Op::AGreaterThanB:		a.Bytes("\x66\x0F\x2E\xC1\x0F\x97\xC0", 7); break;	// ucomisd xmm0,xmm1; seta al
+								case Op::AGreatOrEqualB:	a.Bytes("\x66\x0F\x2E\xC1\x0F\x93\xC0", 7); break;	// ucomisd xmm0,xmm1; setae al
+								case Op::ALessThanB:		a.Bytes("\x66\x0F\x2E\xC8\x0F\x97\xC0", 7); break;	// ucomisd xmm1,xmm0; seta al
+								case Op::ALessOrEqualB:		a.Bytes("\x66\x0F\x2E\xC8\x0F\x93\xC0", 7); break;	// ucomisd xmm1,xmm0; setae al
+								case Op::AEqualB:			// sete al; setnp cl; and al, cl
+									a.Bytes("\x66\x0F\x2E\xC1\x0F\x94\xC0\x0F\x9B\xC1\x20\xC8", 12); break;
+								case Op::ANotEqualB:		// setne al; setp cl; or al, cl
+									a.Bytes("\x66\x0F\x2E\xC1\x0F\x95\xC0\x0F\x9A\xC1\x08\xC8", 12); break;
+								default:
+									return Fail("internal error: unexpected op");
+							}
+							a.Bytes("\x0F\xB6\xC0", 3);				// movzx eax, al
+							a.Bytes("\xF2\x0F\x2A\xC0", 4);			// cvtsi2sd xmm0, eax
+							break;
+					}
+					a.StoreSlot(SlotOf(line.lhs));
+					break;
+			}
+			#undef LOAD
+		}
+
+		a.Bind(endLabel);
+		a.MovEax(1);
+		a.Bind(exitLabel);
+		a.Bytes("\x41\x5D\x41\x5C\x5B\xC3", 6);		// pop r13; pop r12; pop rbx; ret
+
+		VecIterate(i, stubs) {
+			// dec r12; jnz target; otherwise, *resumeLine = target and return 2
+			a.Bind(stubs[i].label);
+			a.Bytes("\x49\xFF\xCC", 3);
+			a.Jcc(0x85, stubs[i].target);
+			a.MovRaxImm(stubs[i].target);
+			a.Bytes("\x49\x89\x45\x00", 4);			// mov [r13], rax
+			a.MovEax(2);
+			a.Jmp(exitLabel);
+		}
+		if (!a.Link()) return Fail("internal error: unbound label");
+
+		// Copy the code into executable memory.
+		size_t size = a.bytes.size();
+		void *mem = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANON, -1, 0);
+		if (mem == MAP_FAILED) return Fail("couldn't allocate executable memory");
+		memcpy(mem, &a.bytes[0], size);
+		if (mprotect(mem, size, PROT_READ | PROT_EXEC) != 0) {
+			munmap(mem, size);
+			return Fail("couldn't make code executable");
+		}
+		out->mem = mem;
+		out->memSize = size;
+		out->entry = (NativeFunc)mem;
+		return true;
+	}
+
+	void JIT::Release(JitCode *code) {
+		if (code->mem) munmap(code->mem, code->memSize);
+		delete code;
+	}
+
+	bool JIT::Supported() { return true; }
+
+#else
+
+	bool Compiler::Generate() { return Fail("no native code generator for this platform"); }
+
+	void JIT::Release(JitCode *code) { delete code; }
+
+	bool JIT::Supported() { return false; }
+
+#endif
+
+	//--------------------------------------------------------------------------------
+
+	static String Describe(FunctionStorage *func) {
+		if (func->code.Count() == 0) return "function";
+		return String("function at ") + func->code[0].location.ToString();
+	}
+
+	bool JIT::Compile(FunctionStorage *func) {
+		if (func->jitCode != nullptr) return func->jitCode->entry != nullptr;
+		JitCode *jc = new JitCode();
+		func->jitCode = jc;
+		Compiler compiler(func, jc);
+		if (!compiler.Run()) {
+			if (report) report(String("JIT: not compiling ") + Describe(func) + ": " + compiler.reason, true);
+			return false;
+		}
+		compiledCount++;
+		if (report) report(String("JIT: compiled ") + Describe(func) + " ("
+			+ String::Format(func->code.Count()) + " lines, "
+			+ String::Format((long)jc->memSize) + " bytes)", true);
+		return true;
+	}
+
+	// Run the call in the interpreter (in a private machine, since the code
+	// can't touch anything outside its own frame), and compare the results.
+	static Value CheckCall(FunctionStorage *func, Context *context, long argCount, Value nativeResult) {
+		Context *root = new Context();
+		root->code = func->code;
+		long argBase = context->args.Count() - argCount;
+		for (long i=0; i<func->parameters.Count(); i++) {
+			root->SetVar(func->parameters[i].name, i < argCount ? context->args[argBase + i] : func->parameters[i].defaultValue);
+		}
+		Machine vm(root, nullptr);		// (adopts root)
+		while (!root->Done()) {
+			bool isReturn = (TACLine::GenericOp(root->code[root->lineNum].op) == Op::ReturnA);
+			vm.Step();
+			if (isReturn) break;
+		}
+		Value expected = root->GetTemp(0, Value::null);
+		JIT::checkedCalls++;
+		bool same;
+		if (expected.type != nativeResult.type) same = false;
+		else if (expected.type != ValueType::Number) same = true;
+		else same = (expected.data.number == nativeResult.data.number)
+			or (std::isnan(expected.data.number) and std::isnan(nativeResult.data.number));
+		if (!same) {
+			JIT::mismatches++;
+			if (JIT::report) JIT::report(String("JIT mismatch in ") + Describe(func) + ": native "
+				+ nativeResult.ToString() + ", interpreter " + expected.ToString(), true);
+		}
+		return expected;
+	}
+
+	JIT::Outcome JIT::TryCall(FunctionStorage *func, Context *context, long argCount,
+							  bool gotSelf, Value *outResult) {
+		JitCode *jc = func->jitCode;
+		if (jc == nullptr) {
+			if (++func->callCount < threshold or !Compile(func)) return Outcome::NotRun;
+			jc = func->jitCode;
+		} else if (jc->entry == nullptr) {
+			return Outcome::NotRun;
+		}
+
+		// Load the arguments (or defaults) into the frame; all must be numbers.
+		// (Leave any error about too many arguments to the interpreter.)
+		long paramCount = func->parameters.Count();
+		if (gotSelf and paramCount > 0 and func->parameters[0].name == "self") return Outcome::NotRun;
+		if (argCount > paramCount) return Outcome::NotRun;
+		long argBase = context->args.Count() - argCount;
+		for (long i=0; i<paramCount; i++) {
+			const Value& v = (i < argCount ? context->args[argBase + i] : func->parameters[i].defaultValue);
+			if (v.type != ValueType::Number) return Outcome::NotRun;
+			pending.frame[i] = v.data.number;
+		}
+
+		long resumeLine = 0;
+		int status = jc->entry(pending.frame, &resumeLine);
+		if (status == 2) {
+			pending.code = jc;
+			pending.line = resumeLine;
+			bailouts++;
+			return Outcome::Bailed;
+		}
+		*outResult = (status == 0 ? Value(pending.frame[jc->tempBase]) : Value::null);
+		if (check) *outResult = CheckCall(func, context, argCount, *outResult);
+		for (long i=0; i<argCount; i++) context->args.Pop();
+		nativeCalls++;
+		return Outcome::Done;
+	}
+
+	void JIT::Resume(Context *callContext) {
+		JitCode *jc = pending.code;
+		const SlotSet& known = jc->assigned[pending.line];
+		for (long slot=0; slot<jc->slotCount; slot++) {
+			if (!known.Has(slot)) continue;
+			Value v(pending.frame[slot]);
+			if (slot < jc->tempBase) callContext->SetVar(jc->varNames[slot], v);
+			else callContext->SetTemp((int)(slot - jc->tempBase), v);
+		}
+		callContext->lineNum = pending.line;
+	}
+
+	//--------------------------------------------------------------------------------
+
+	class TestJIT : public UnitTest
+	{
+	public:
+		TestJIT() : UnitTest("JIT") {}
+		virtual void Run();
+	};
+
+	void TestJIT::Run()
+	{
+		// f(n, k=2): return n * k
+		FunctionStorage *f = new FunctionStorage();
+		f->parameters.Add(FuncParam("n", Value::null));
+		f->parameters.Add(FuncParam("k", Value(2)));
+		f->code.Add(TACLine(Value::Temp(1), Op::CallFunctionA, Value::Var("n"), Value::zero));
+		f->code.Add(TACLine(Value::Temp(2), Op::CallFunctionA, Value::Var("k"), Value::zero));
+		f->code.Add(TACLine(Value::Temp(3), Op::ATimesB, Value::Temp(1), Value::Temp(2)));
+		f->code.Add(TACLine(Value::Temp(0), Op::ReturnA, Value::Temp(3)));
+
+		// A function that uses a global can't be compiled.
+		FunctionStorage *g = new FunctionStorage();
+		g->code.Add(TACLine(Value::Temp(0), Op::ReturnA, Value::Var("x")));
+
+		bool compiled = JIT::Compile(f);
+		ErrorIf(compiled != JIT::Supported());
+		ErrorIf(JIT::Compile(g));
+		if (compiled) {
+			Context context;
+			context.args.Add(Value(20));
+			Value result;
+			ErrorIf(JIT::TryCall(f, &context, 1, false, &result) != JIT::Outcome::Done);
+			ErrorIf(result.type != ValueType::Number or result.data.number != 40);
+			ErrorIf(context.args.Count() != 0);
+			context.args.Add(Value("x"));
+			ErrorIf(JIT::TryCall(f, &context, 1, false, &result) != JIT::Outcome::NotRun);
+		}
+		delete f;
+		delete g;
+	}
+
+	RegisterUnitTest(TestJIT);
+}
@@ -0,0 +1,81 @@
+//
+//  MiniscriptJIT.h
+//  MiniScript
+//
+//  An optional baseline JIT compiler.  Once a function has been called
+//  often enough, we try to compile its TAC to native code.  Only the
+//  numeric subset is supported: arithmetic, comparison and logic on
+//  numbers held in parameters, locals and temps, plus jumps and return.
+//  Anything else (calls, strings, maps, globals...) leaves the function
+//  to the interpreter, as does any call whose arguments aren't numbers.
+//
+//  Compiled code periodically hands the rest of a long-running call back
+//  to the interpreter (which picks up from the same line, with the same
+//  local values), so scripts stay responsive.
+//
+//  Native code is currently generated only for x86-64 (System V ABI);
+//  on other platforms, Supported() is false and everything is interpreted.
+//
+
+#ifndef MINISCRIPTJIT_H
+#define MINISCRIPTJIT_H
+
+#include "MiniscriptTAC.h"
+
+namespace MiniScript {
+
+	class JitCode;
+
+	class JIT {
+	public:
+		// Set to true to enable the JIT (off by default).
+		static bool enabled;
+
+		// If true, every natively completed call is run again in the
+		// interpreter, and any difference in the result is reported.
+		static bool check;
+
+		// Number of calls to a function before we try to compile it.
+		static long threshold;
+
+		// If set, called with a note about each function compiled or
+		// rejected, and about any mismatch found in check mode.
+		static TextOutputMethod report;
+
+		// Counters (for this thread), for --jit-check and testing.
+		static thread_local long compiledCount;		// functions compiled
+		static thread_local long nativeCalls;		// calls completed in native code
+		static thread_local long bailouts;			// calls handed back to the interpreter
+		static thread_local long checkedCalls;		// calls compared in check mode
+		static thread_local long mismatches;			// ...and how many of those differed
+
+		// Return whether this build can generate native code.
+		static bool Supported();
+
+		enum class Outcome {
+			NotRun,		// call the function in the interpreter, as usual
+			Done,		// the call is complete; result is in *outResult
+			Bailed		// set up the call as usual, then pass it to Resume
+		};
+
+		// Count a call to the given (non-intrinsic) function, compiling it if
+		// it's hot, and run it natively if possible.  The arguments are the last
+		// argCount values on context->args; they're popped only if we're Done.
+		static Outcome TryCall(FunctionStorage *func, Context *context, long argCount,
+							   bool gotSelf, Value *outResult);
+
+		// After TryCall returns Bailed, and a call context has been made in
+		// the usual way: load it with the native frame's variables and temps,
+		// and point it at the line where native execution stopped.
+		static void Resume(Context *callContext);
+
+		// Compile the given function now (regardless of threshold), if we
+		// haven't already tried.  Returns whether it has native code.
+		static bool Compile(FunctionStorage *func);
+
+		// Free compiled code (called when its function is destroyed).
+		static void Release(JitCode *code);
+	};
+}
+
+#endif /* MINISCRIPTJIT_H */
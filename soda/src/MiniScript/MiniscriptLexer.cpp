@@ -200,6 +200,7 @@ namespace MiniScript {
 					ls->positionB = p + 2;
 				}
 			}
+			if (result.type == Token::Type::Identifier) result.text = result.text.Intern();
 			return result;
 		} else if (c == '"') {
 			// Lex a string... to the closing ", but skipping (and singling) a doubled double quote ("")
@@ -227,6 +228,7 @@ namespace MiniScript {
 			if (!gotEndQuote) LexerException("missing closing quote (\")").raise();
 			result.text = ls->input.SubstringB(startPosB, ls->positionB - startPosB - 1);
 			if (haveDoubledQuotes) result.text = result.text.Replace("\"\"", "\"");
+			result.text = result.text.Intern();
 			return result;
 			
 		} else {
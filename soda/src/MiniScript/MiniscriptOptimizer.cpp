@@ -0,0 +1,459 @@
+//
+//  MiniscriptOptimizer.cpp
+//  MiniScript
+//
+//  See MiniscriptOptimizer.h.  Note that temps (other than temp 0, which
+//  holds a function's return value) are private to the code block, so we
+//  can reason about all their uses; variables are not, and reading one may
+//  raise an error or invoke a function, so we never move or remove those.
+//
+
+#include "MiniscriptOptimizer.h"
+#include "MiniscriptErrors.h"
+#include "SimpleVector.h"
+#include "UnitTest.h"
+
+namespace MiniScript {
+
+	bool Optimizer::enabled = true;
+	TextOutputMethod Optimizer::report = nullptr;
+
+	typedef TACLine::Op Op;
+
+	static bool IsJump(Op op) {
+		return op == Op::GotoA or op == Op::GotoAifB or op == Op::GotoAifTrulyB or op == Op::GotoAifNotB;
+	}
+
+	static bool IsConstant(const Value& v) {
+		return v.type == ValueType::Null or v.type == ValueType::Number or v.type == ValueType::String;
+	}
+
+	// Ops that, given constant operands, compute a result with no side effects.
+	static bool IsFoldable(Op op) {
+		switch (op) {
+			case Op::APlusB: case Op::AMinusB: case Op::ATimesB: case Op::ADividedByB:
+			case Op::AModB: case Op::APowB: case Op::AEqualB: case Op::ANotEqualB:
+			case Op::AGreaterThanB: case Op::AGreatOrEqualB: case Op::ALessThanB:
+			case Op::ALessOrEqualB: case Op::AAndB: case Op::AOrB: case Op::NotA:
+				return true;
+			default:
+				return false;
+		}
+	}
+
+	// Per-temp bookkeeping.
+	struct TempInfo {
+		long defs;			// how many lines store into this temp
+		long uses;			// how many times it's read (anywhere)
+		bool nestedUse;		// true if read inside a SeqElem or list/map literal
+	};
+
+	class TempTable {
+	public:
+		TempTable(List<TACLine>& code) {
+			long maxTemp = 0;
+			for (long i=0; i<code.Count(); i++) {
+				TACLine& line = code[i];
+				if (line.lhs.type == ValueType::Temp and line.lhs.data.tempNum > maxTemp) maxTemp = line.lhs.data.tempNum;
+			}
+			info.resize(maxTemp + 1);
+			for (long t=0; t<=maxTemp; t++) info[t] = {0, 0, false};
+			for (long i=0; i<code.Count(); i++) {
+				TACLine& line = code[i];
+				if (line.lhs.type == ValueType::Temp) info[line.lhs.data.tempNum].defs++;
+				else NoteUses(line.lhs, true);
+				NoteUses(line.rhsA, false);
+				NoteUses(line.rhsB, false);
+			}
+		}
+
+		// Whether this temp is ours to rewrite: one definition, and not temp 0.
+		bool IsPrivate(long t) { return t > 0 and t < (long)info.size() and info[t].defs == 1; }
+
+		SimpleVector<TempInfo> info;
+
+	private:
+		void NoteUses(Value v, bool nested) {
+			switch (v.type) {
+				case ValueType::Temp:
+					if (v.data.tempNum >= (long)info.size()) return;	// (never assigned)
+					info[v.data.tempNum].uses++;
+					if (nested) info[v.data.tempNum].nestedUse = true;
+					break;
+				case ValueType::SeqElem:
+				{
+					SeqElemStorage *se = (SeqElemStorage*)(v.data.ref);
+					NoteUses(se->sequence, true);
+					NoteUses(se->index, true);
+				} break;
+				case ValueType::List:
+				{
+					ValueList list = v.GetList();
+					for (long i=0; i<list.Count(); i++) NoteUses(list[i], true);
+				} break;
+				case ValueType::Map:
+				{
+					ValueDict map = v.GetDict();
+					for (ValueDictIterator kv = map.GetIterator(); !kv.Done(); kv.Next()) {
+						NoteUses(kv.Key(), true);
+						NoteUses(kv.Value(), true);
+					}
+				} break;
+				default:
+					break;
+			}
+		}
+	};
+
+	// Replace an operation on constants with an assignment of its result.
+	static bool FoldConstants(List<TACLine>& code) {
+		bool changed = false;
+		for (long i=0; i<code.Count(); i++) {
+			TACLine& line = code[i];
+			if (not IsFoldable(line.op)) continue;
+			if (not IsConstant(line.rhsA) or not IsConstant(line.rhsB)) continue;
+			Value result;
+			if (line.rhsA.type == ValueType::Number and (line.rhsB.type == ValueType::Number or line.op == Op::NotA)) {
+				try {
+					result = line.Evaluate(nullptr);
+				} catch (MiniscriptException&) {
+					continue;		// (leave it for runtime to report)
+				}
+			} else if (line.op == Op::APlusB and line.rhsA.type == ValueType::String and line.rhsB.type == ValueType::String) {
+				String sA = line.rhsA.GetString();
+				String sB = line.rhsB.GetString();
+				if (sA.LengthB() + sB.LengthB() > Value::maxStringSize) continue;
+				result = Value(sA + sB);
+			} else continue;
+			line.op = Op::AssignA;
+			line.rhsA = result;
+			line.rhsB = Value::null;
+			changed = true;
+		}
+		return changed;
+	}
+
+	// Substitute constants for private temps that are simply assigned a constant.
+	static bool PropagateConstants(List<TACLine>& code) {
+		TempTable temps(code);
+		long tempCount = temps.info.size();
+		SimpleVector<Value> constVal(tempCount);
+		SimpleVector<bool> isConst(tempCount);
+		for (long t=0; t<tempCount; t++) {
+			isConst.push_back(false);
+			constVal.push_back(Value::null);
+		}
+		bool any = false;
+		for (long i=0; i<code.Count(); i++) {
+			TACLine& line = code[i];
+			if (line.op != Op::AssignA or line.lhs.type != ValueType::Temp or not IsConstant(line.rhsA)) continue;
+			long t = line.lhs.data.tempNum;
+			if (not temps.IsPrivate(t) or temps.info[t].nestedUse) continue;
+			isConst[t] = true;
+			constVal[t] = line.rhsA;
+			any = true;
+		}
+		if (not any) return false;
+		bool changed = false;
+		for (long i=0; i<code.Count(); i++) {
+			TACLine& line = code[i];
+			if (line.rhsA.type == ValueType::Temp and line.rhsA.data.tempNum < tempCount and isConst[line.rhsA.data.tempNum]
+					and not IsJump(line.op)) {
+				line.rhsA = constVal[line.rhsA.data.tempNum];
+				changed = true;
+			}
+			if (line.rhsB.type == ValueType::Temp and line.rhsB.data.tempNum < tempCount and isConst[line.rhsB.data.tempNum]) {
+				line.rhsB = constVal[line.rhsB.data.tempNum];
+				changed = true;
+			}
+		}
+		return changed;
+	}
+
+	// Point jumps that land on an unconditional jump straight at its destination.
+	static bool CollapseJumps(List<TACLine>& code) {
+		bool changed = false;
+		long count = code.Count();
+		for (long i=0; i<count; i++) {
+			TACLine& line = code[i];
+			if (not IsJump(line.op) or line.rhsA.type != ValueType::Number) continue;
+			long target = line.rhsA.IntValue();
+			long hops = 0;
+			while (target >= 0 and target < count and code[target].op == Op::GotoA
+				   and code[target].rhsA.type == ValueType::Number and hops++ < count) {
+				long next = code[target].rhsA.IntValue();
+				if (next == target) break;		// (infinite loop; leave it alone)
+				target = next;
+			}
+			if (target != line.rhsA.IntValue()) {
+				line.rhsA = Value(target);
+				changed = true;
+			}
+		}
+		return changed;
+	}
+
+	// Note which lines (0 through code.Count()) some jump may land on.
+	static void FindJumpTargets(List<TACLine>& code, SimpleVector<bool>& isTarget) {
+		long count = code.Count();
+		for (long i=0; i<=count; i++) isTarget.push_back(false);
+		for (long i=0; i<count; i++) {
+			TACLine& line = code[i];
+			if (IsJump(line.op) and line.rhsA.type == ValueType::Number) {
+				long target = line.rhsA.IntValue();
+				if (target >= 0 and target <= count) isTarget[target] = true;
+			}
+		}
+	}
+
+	// Remove lines that have no effect, and fold "temp := x; v := temp" into
+	// "v := x".  Jump targets are renumbered to match.
+	static bool RemoveDeadCode(List<TACLine>& code) {
+		long count = code.Count();
+		TempTable temps(code);
+		SimpleVector<bool> isTarget;
+		FindJumpTargets(code, isTarget);
+
+		// Lines that no path from the top can reach are dead, too.
+		// (Code is only ever entered at line 0.)
+		SimpleVector<bool> keep(count);
+		for (long i=0; i<count; i++) keep.push_back(false);
+		SimpleVector<long> toVisit;
+		toVisit.push_back(0);
+		while (not toVisit.empty()) {
+			long i = toVisit.pop_back();
+			if (i < 0 or i >= count or keep[i]) continue;
+			keep[i] = true;
+			TACLine& line = code[i];
+			if (IsJump(line.op)) {
+				if (line.rhsA.type != ValueType::Number) return false;	// (can't tell where this goes)
+				toVisit.push_back(line.rhsA.IntValue());
+			}
+			if (line.op != Op::GotoA and line.op != Op::ReturnA) toVisit.push_back(i+1);
+		}
+		bool changed = false;
+		for (long i=0; i<count; i++) if (not keep[i]) changed = true;
+
+		for (long i=0; i<count; i++) {
+			if (not keep[i]) continue;
+			TACLine& line = code[i];
+			// A conditional jump on a constant either always or never jumps.
+			if ((line.op == Op::GotoAifB or line.op == Op::GotoAifNotB or line.op == Op::GotoAifTrulyB)
+					and IsConstant(line.rhsB) and line.rhsB.type != ValueType::String) {
+				bool jumps;
+				if (line.op == Op::GotoAifB) jumps = (not line.rhsB.IsNull() and line.rhsB.BoolValue());
+				else if (line.op == Op::GotoAifNotB) jumps = (line.rhsB.IsNull() or not line.rhsB.BoolValue());
+				else jumps = (not line.rhsB.IsNull() and line.rhsB.IntValue() != 0);
+				if (jumps) {
+					line.op = Op::GotoA;
+					line.rhsB = Value::null;
+				} else {
+					keep[i] = false;
+				}
+				changed = true;
+				continue;
+			}
+			// A jump to the very next line does nothing.
+			if (line.op == Op::GotoA and line.rhsA.type == ValueType::Number and line.rhsA.IntValue() == i+1) {
+				keep[i] = false;
+				changed = true;
+				continue;
+			}
+			if (line.lhs.type != ValueType::Temp) continue;
+			long t = line.lhs.data.tempNum;
+			if (not temps.IsPrivate(t)) continue;
+			// Assigning a constant or temp to a temp nobody reads does nothing.
+			if (temps.info[t].uses == 0 and line.op == Op::AssignA
+					and (IsConstant(line.rhsA) or line.rhsA.type == ValueType::Temp)) {
+				keep[i] = false;
+				changed = true;
+				continue;
+			}
+			// If the only use of this temp is to copy it into a variable or
+			// another temp on the very next line, store it there directly.
+			if (temps.info[t].uses == 1 and i+1 < count and keep[i+1] and not isTarget[i+1]
+					and not IsJump(line.op) and line.op != Op::PushParam
+					and line.op != Op::AssignImplicit and line.op != Op::CallIntrinsicA) {
+				TACLine& next = code[i+1];
+				if (next.op == Op::AssignA and next.rhsA.type == ValueType::Temp and next.rhsA.data.tempNum == t
+						and (next.lhs.type == ValueType::Var or next.lhs.type == ValueType::Temp)) {
+					line.lhs = next.lhs;
+					keep[i+1] = false;
+					i++;
+					changed = true;
+				}
+			}
+		}
+		if (not changed) return false;
+
+		// Compact the code, mapping each old line number to its new one.
+		// (A jump to a removed line goes to the next line that remains.)
+		SimpleVector<long> newIndex(count + 1);
+		long kept = 0;
+		for (long i=0; i<count; i++) {
+			newIndex.push_back(kept);
+			if (keep[i]) kept++;
+		}
+		newIndex.push_back(kept);
+		List<TACLine> result(kept);
+		for (long i=0; i<count; i++) {
+			if (not keep[i]) continue;
+			TACLine line = code[i];
+			if (IsJump(line.op) and line.rhsA.type == ValueType::Number) {
+				long target = line.rhsA.IntValue();
+				if (target >= 0 and target <= count) line.rhsA = Value(newIndex[target]);
+			}
+			result.Add(line);
+		}
+		// Replace the contents in place, since the code storage may be shared.
+		code.Clear();
+		for (long i=0; i<result.Count(); i++) code.Add(result[i]);
+		return true;
+	}
+
+	static bool IsNumericOperand(const Value& v) {
+		return v.type == ValueType::Temp or v.type == ValueType::Number;
+	}
+
+	// Speculatively switch arithmetic and compare-and-branch to the numeric
+	// ops (see TACLine::Op), which deopt on their own if the guess is wrong.
+	// Doesn't change the line count; returns how many lines were changed.
+	static long Specialize(List<TACLine>& code) {
+		long count = code.Count();
+		TempTable temps(code);
+		SimpleVector<bool> isTarget;
+		FindJumpTargets(code, isTarget);
+		long specialized = 0;
+		for (long i=0; i<count; i++) {
+			TACLine& line = code[i];
+			bool numeric = IsNumericOperand(line.rhsA) and IsNumericOperand(line.rhsB);
+			// Arithmetic on two numbers.
+			Op numOp = Op::Noop;
+			if (numeric) switch (line.op) {
+				case Op::APlusB:		numOp = Op::APlusBNum;		break;
+				case Op::AMinusB:		numOp = Op::AMinusBNum;		break;
+				case Op::ATimesB:		numOp = Op::ATimesBNum;		break;
+				case Op::ADividedByB:	numOp = Op::ADividedByBNum;	break;
+				default:				break;
+			}
+			if (numOp != Op::Noop) {
+				line.op = numOp;
+				specialized++;
+				continue;
+			}
+			// The rest fuse this line with the next, so: this line must store
+			// into a temp read only by the next line, which nothing jumps to.
+			bool canFuse = (line.lhs.type == ValueType::Temp and i+1 < count and not isTarget[i+1]
+				and temps.IsPrivate(line.lhs.data.tempNum) and temps.info[line.lhs.data.tempNum].uses == 1);
+			long t = canFuse ? line.lhs.data.tempNum : -1;
+			TACLine& next = code[i+1 < count ? i+1 : i];
+			// Comparison, then "goto X if not <result>".
+			if (numeric and canFuse) switch (line.op) {
+				case Op::AEqualB:			numOp = Op::AEqualBJumpNum;			break;
+				case Op::ANotEqualB:		numOp = Op::ANotEqualBJumpNum;		break;
+				case Op::AGreaterThanB:		numOp = Op::AGreaterThanBJumpNum;	break;
+				case Op::AGreatOrEqualB:	numOp = Op::AGreatOrEqualBJumpNum;	break;
+				case Op::ALessThanB:		numOp = Op::ALessThanBJumpNum;		break;
+				case Op::ALessOrEqualB:		numOp = Op::ALessOrEqualBJumpNum;	break;
+				default:					break;
+			}
+			if (numOp != Op::Noop and next.op == Op::GotoAifNotB and next.rhsA.type == ValueType::Number
+					and next.rhsB.type == ValueType::Temp and next.rhsB.data.tempNum == t) {
+				line.op = numOp;
+				specialized++;
+				i++;
+				continue;
+			}
+			// "_t := call x with 0 args", then "x := _t + n" (or - n).
+			if (canFuse and line.op == Op::CallFunctionA and line.rhsA.type == ValueType::Var and line.rhsB.IntValue() == 0
+					and (next.op == Op::APlusB or next.op == Op::AMinusB) and next.rhsB.type == ValueType::Number
+					and next.rhsA.type == ValueType::Temp and next.rhsA.data.tempNum == t
+					and next.lhs.type == ValueType::Var and next.lhs.GetString() == line.rhsA.GetString()) {
+				line.op = Op::IncrementVarNum;
+				specialized++;
+				i++;
+				continue;
+			}
+			// Otherwise, guess that a plain "_t := call x with 0 args" is just
+			// reading a local variable.  (But not one of the special names
+			// that GetVar handles before looking at locals.)
+			if (line.op == Op::CallFunctionA and line.rhsA.type == ValueType::Var and line.rhsB.IntValue() == 0) {
+				String ident = line.rhsA.GetString();
+				if (ident != "locals" and ident != "globals" and ident != "outer") {
+					line.op = Op::LoadLocalA;
+					specialized++;
+				}
+			}
+		}
+		return specialized;
+	}
+
+	long Optimizer::Optimize(List<TACLine>& code) {
+		long before = code.Count();
+		if (not enabled or before == 0) return 0;
+		for (int pass=0; pass<10; pass++) {
+			bool changed = FoldConstants(code);
+			changed = PropagateConstants(code) or changed;
+			changed = CollapseJumps(code) or changed;
+			changed = RemoveDeadCode(code) or changed;
+			if (not changed) break;
+		}
+		long specialized = Specialize(code);
+		long after = code.Count();
+		if (report) {
+			String where = code.Count() > 0 ? String::Format(code[0].location.lineNum) : String("?");
+			(*report)(String("TAC at line ") + where + ": " + String::Format(before)
+					  + " -> " + String::Format(after) + " instructions ("
+					  + String::Format(specialized) + " specialized)", true);
+		}
+		return before - after;
+	}
+
+	//--------------------------------------------------------------------------------
+	// Unit tests
+	//--------------------------------------------------------------------------------
+
+	class TestOptimizer : public UnitTest
+	{
+	public:
+		TestOptimizer() : UnitTest("Optimizer") {}
+		virtual void Run();
+	};
+
+	void TestOptimizer::Run()
+	{
+		// _1 := 2 * 3; x := 1 + _1  -->  x := 7
+		List<TACLine> code;
+		code.Add(TACLine(Value::Temp(1), Op::ATimesB, Value(2), Value(3)));
+		code.Add(TACLine(Value::Var("x"), Op::APlusB, Value(1), Value::Temp(1)));
+		Optimizer::Optimize(code);
+		ErrorIf(code.Count() != 1);
+		ErrorIf(code[0].op != Op::AssignA);
+		ErrorIf(code[0].rhsA.DoubleValue() != 7);
+
+		// Jump chains collapse, dead and unreachable lines go away, and
+		// the remaining jumps are renumbered to match.
+		code = List<TACLine>();
+		code.Add(TACLine(Op::GotoAifNotB, Value(3), Value::Var("x")));
+		code.Add(TACLine(Value::Temp(1), Op::AssignA, Value(5)));
+		code.Add(TACLine(Op::GotoA, Value(4)));
+		code.Add(TACLine(Op::GotoA, Value(5)));
+		code.Add(TACLine(Value::Var("y"), Op::AssignA, Value::one));
+		code.Add(TACLine(Value::Var("z"), Op::AssignA, Value(2)));
+		Optimizer::Optimize(code);
+		ErrorIf(code.Count() != 3);
+		ErrorIf(code[0].op != Op::GotoAifNotB or code[0].rhsA.IntValue() != 2);
+		ErrorIf(code[2].lhs.ToString() != "z");
+
+		// i = i + 1 becomes a (speculative) numeric increment.
+		code = List<TACLine>();
+		code.Add(TACLine(Value::Temp(1), Op::CallFunctionA, Value::Var("i"), Value::zero));
+		code.Add(TACLine(Value::Var("i"), Op::APlusB, Value::Temp(1), Value::one));
+		Optimizer::Optimize(code);
+		ErrorIf(code.Count() != 2);
+		ErrorIf(code[0].op != Op::IncrementVarNum);
+		ErrorIf(TACLine::GenericOp(code[0].op) != Op::CallFunctionA);
+	}
+
+	RegisterUnitTest(TestOptimizer);
+}
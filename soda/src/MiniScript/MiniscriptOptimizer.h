@@ -0,0 +1,34 @@
+//
+//  MiniscriptOptimizer.h
+//  MiniScript
+//
+//  A simple peephole optimizer for the TAC (three-address code) produced by
+//  the parser.  It folds constant expressions, propagates constant copies,
+//  removes dead temps, and collapses chains of jumps, renumbering jump
+//  targets as lines are removed.  The result behaves identically to the
+//  original code, just with fewer instructions.
+//
+
+#ifndef MINISCRIPTOPTIMIZER_H
+#define MINISCRIPTOPTIMIZER_H
+
+#include "MiniscriptTAC.h"
+
+namespace MiniScript {
+
+	class Optimizer {
+	public:
+		// Optimize the given code in place.  The code must be complete (all
+		// jumps patched) and not yet running.  Returns the number of lines removed.
+		static long Optimize(List<TACLine>& code);
+
+		// Set to false to skip optimization entirely (e.g. for debugging).
+		static bool enabled;
+
+		// If set, called with a one-line summary (before/after instruction
+		// count) for each block of code optimized.
+		static TextOutputMethod report;
+	};
+}
+
+#endif /* MINISCRIPTOPTIMIZER_H */
@@ -9,6 +9,7 @@
 #include "MiniscriptParser.h"
 #include "MiniscriptErrors.h"
 #include "MiniscriptIntrinsics.h"
+#include "MiniscriptOptimizer.h"
 #include "UnitTest.h"
 
 namespace MiniScript {
@@ -186,6 +187,7 @@ namespace MiniScript {
 			}
 			CheckForOpenBackpatches(tokens.lineNum() + 1);
 		}
+		if (not replMode and outputStack.Count() == 1) Optimizer::Optimize(output->code);
 	}
 	
 	/// <summary>
@@ -208,6 +210,7 @@ namespace MiniScript {
 				tokens.Dequeue();
 				if (outputStack.Count() > 1) {
 					CheckForOpenBackpatches(tokens.lineNum() + 1);
+					Optimizer::Optimize(output->code);
 					outputStack.Pop();
 					output = &outputStack.Last();
 				} else {
@@ -327,6 +330,17 @@ namespace MiniScript {
 					CompilerException(errorContext, tokens.lineNum(),
 						"sequence expression expected for 'for' loop").raise();
 				}
+				
+				// If the sequence is just a function call (e.g. range(...)), let the
+				// function know that its result is only iterated over, so it may
+				// produce a lazy sequence rather than a list.
+				if (output->code.Count() > 0) {
+					TACLine& last = output->code[output->code.Count()-1];
+					if (last.op == TACLine::Op::CallFunctionA and last.lhs.type == ValueType::Temp
+						and stuff.type == ValueType::Temp and last.lhs.data.tempNum == stuff.data.tempNum) {
+						last.op = TACLine::Op::CallFunctionIterA;
+					}
+				}
 
 				// Create an index variable to iterate over the sequence, initialized to -1.
 				Value idxVar = Value::Var("__" + loopVarTok.text + "_idx");
@@ -0,0 +1,243 @@
+//
+//  MiniscriptProfiler.cpp
+//  MiniScript
+//
+//  See MiniscriptProfiler.h.  Each sample is stored as a string key (one
+//  "function:line" entry per frame, outermost first, separated by ';')
+//  with a count, so repeated stacks cost only a hash lookup.  A function is
+//  identified by the location of its first line, and given a name (from the
+//  globals) only when we write out the results.
+//
+
+#include "MiniscriptProfiler.h"
+#include "MiniscriptTAC.h"
+#include "Dictionary.h"
+#include "SplitJoin.h"
+#include "UnitTest.h"
+#include <stdio.h>
+#include <algorithm>
+
+namespace MiniScript {
+
+	typedef Dictionary<String, long, hashString> CountMap;
+
+	bool Profiler::enabled = false;
+	double Profiler::interval = 0.001;
+
+	// Samples taken on this thread.  (Allocated on first use and never freed,
+	// as with the cycle collector's roots, to stay clear of thread-exit order.)
+	static thread_local CountMap& stackCounts = *new CountMap();
+	static thread_local long sampleCount = 0;
+	static thread_local double nextSample = 0;
+
+	static thread_local const String& mainKey = *new String("main");	// (per thread, as Strings aren't shared)
+
+	// Key for the function whose code this is (or main, for the global context).
+	static String FunctionKey(Context *context) {
+		if (context->parent == nullptr) return mainKey;
+		if (context->code.Count() == 0) return String("?");
+		return context->code[0].location.ToString();
+	}
+
+	void Profiler::Resume(double now) {
+		nextSample = now + interval;
+	}
+
+	void Profiler::Tick(Machine *vm, double now) {
+		if (now < nextSample) return;
+		long weight = (long)((now - nextSample) / interval) + 1;
+		nextSample += weight * interval;
+
+		// Each frame is running the line before lineNum (for outer frames,
+		// that's the call to the next frame in).
+		SimpleVector<Context*> frames;
+		for (Context *c = vm->GetTopContext(); c != nullptr; c = c->parent) frames.push_back(c);
+		String key;
+		for (long i = frames.size() - 1; i >= 0; i--) {
+			Context *c = frames[i];
+			long idx = c->lineNum - 1;
+			if (idx >= c->code.Count()) idx = c->code.Count() - 1;
+			if (idx < 0) idx = 0;
+			int lineNum = c->code.Count() > 0 ? c->code[idx].location.lineNum : 0;
+			if (!key.empty()) key += ";";
+			key += FunctionKey(c) + ":" + String::Format(lineNum);
+		}
+		stackCounts.SetValue(key, stackCounts.Lookup(key, 0) + weight);
+		sampleCount += weight;
+	}
+
+	long Profiler::SampleCount() {
+		return sampleCount;
+	}
+
+	void Profiler::Reset() {
+		stackCounts.RemoveAll();
+		sampleCount = 0;
+	}
+
+	//--------------------------------------------------------------------------------
+	// Reporting
+
+	typedef Dictionary<String, String, hashString> NameMap;
+
+	static void AddFunctionName(NameMap& names, Value val, String name) {
+		if (val.type != ValueType::Function) return;
+		FunctionStorage *func = (FunctionStorage*)val.data.ref;
+		if (func == nullptr or func->code.Count() == 0) return;
+		String key = func->code[0].location.ToString();
+		if (!names.ContainsKey(key)) names.SetValue(key, name);
+	}
+
+	// Name the functions we can find in the globals, and in maps (classes
+	// and imported modules) stored in globals.
+	static NameMap FunctionNames(Machine *vm) {
+		NameMap names;
+		names.SetValue(mainKey, mainKey);
+		if (vm == nullptr) return names;
+		ValueDict globals = vm->GetGlobalContext()->variables;
+		for (ValueDictIterator kv = globals.GetIterator(); !kv.Done(); kv.Next()) {
+			String name = kv.Key().ToString();
+			Value val = kv.Value();
+			if (val.type == ValueType::Function) AddFunctionName(names, val, name);
+			else if (val.type == ValueType::Map) {
+				ValueDict members = val.GetDict();
+				for (ValueDictIterator m = members.GetIterator(); !m.Done(); m.Next()) {
+					AddFunctionName(names, m.Value(), name + "." + m.Key().ToString());
+				}
+			}
+		}
+		return names;
+	}
+
+	static String FunctionLabel(const NameMap& names, const String& key) {
+		String name;
+		if (names.Get(key, &name)) return name;
+		return "function" + key;
+	}
+
+	// Split a "function:line" frame into its parts.
+	static void SplitFrame(const String& frame, String *outFunc, String *outLine) {
+		long pos = frame.LastIndexOfB(":");
+		*outFunc = frame.SubstringB(0, pos);
+		*outLine = frame.SubstringB(pos + 1);
+	}
+
+	bool Profiler::WriteCollapsedStacks(String path, Machine *vm) {
+		FILE *f = fopen(path.c_str(), "w");
+		if (f == nullptr) return false;
+		NameMap names = FunctionNames(vm);
+		String func, line;
+		for (DictIterator<String, long> kv = stackCounts.GetIterator(); !kv.Done(); kv.Next()) {
+			StringList frames = Split(kv.Key(), ';');
+			String out;
+			for (long i=0; i<frames.Count(); i++) {
+				SplitFrame(frames[i], &func, &line);
+				if (i > 0) out += ";";
+				out += FunctionLabel(names, func) + ":" + line;
+			}
+			fprintf(f, "%s %ld\n", out.c_str(), kv.Value());
+		}
+		fclose(f);
+		return true;
+	}
+
+	struct ReportEntry {
+		String label;
+		long count;
+	};
+
+	static bool ReportEntryGreater(const ReportEntry& a, const ReportEntry& b) {
+		return a.count > b.count;
+	}
+
+	// Get the entries of the given map, biggest count first.
+	static SimpleVector<ReportEntry> SortedEntries(const CountMap& counts) {
+		SimpleVector<ReportEntry> result;
+		for (DictIterator<String, long> kv = counts.GetIterator(); !kv.Done(); kv.Next()) {
+			ReportEntry e = { kv.Key(), kv.Value() };
+			result.push_back(e);
+		}
+		if (result.size() > 1) std::sort(&result[0], &result[0] + result.size(), ReportEntryGreater);
+		return result;
+	}
+
+	static void Add(CountMap& counts, const String& key, long n) {
+		counts.SetValue(key, counts.Lookup(key, 0) + n);
+	}
+
+	static String Percent(long count, long total) {
+		return String::Format(100.0 * count / total, "%5.1f") + "%";
+	}
+
+	String Profiler::Report(Machine *vm, int topN) {
+		if (sampleCount == 0) return "Profile: no samples taken\n";
+		NameMap names = FunctionNames(vm);
+		CountMap lineSelf, funcSelf, funcTotal;
+		String func, line;
+		for (DictIterator<String, long> kv = stackCounts.GetIterator(); !kv.Done(); kv.Next()) {
+			StringList frames = Split(kv.Key(), ';');
+			long n = kv.Value();
+			SimpleVector<String> seen;		// (count recursive functions once per sample)
+			for (long i=0; i<frames.Count(); i++) {
+				SplitFrame(frames[i], &func, &line);
+				String label = FunctionLabel(names, func);
+				if (!seen.Contains(label)) {
+					Add(funcTotal, label, n);
+					seen.push_back(label);
+				}
+				if (i == frames.Count() - 1) {
+					Add(funcSelf, label, n);
+					Add(lineSelf, "line " + line + " (" + label + ")", n);
+				}
+			}
+		}
+
+		String result = "Profile: " + String::Format(sampleCount) + " samples of "
+			+ String::Format(interval * 1000, "%g") + " ms\n";
+		result += "Hottest lines (self time):\n";
+		SimpleVector<ReportEntry> lines = SortedEntries(lineSelf);
+		for (long i=0; i<lines.size() and i<topN; i++) {
+			result += "  " + Percent(lines[i].count, sampleCount) + String::Format(lines[i].count, "%8ld")
+				+ "  " + lines[i].label + "\n";
+		}
+		result += "Hottest functions (total time, self time):\n";
+		SimpleVector<ReportEntry> funcs = SortedEntries(funcTotal);
+		for (long i=0; i<funcs.size() and i<topN; i++) {
+			result += "  " + Percent(funcs[i].count, sampleCount) + "  "
+				+ Percent(funcSelf.Lookup(funcs[i].label, 0), sampleCount) + "  " + funcs[i].label + "\n";
+		}
+		return result;
+	}
+
+	//--------------------------------------------------------------------------------
+
+	class TestProfiler : public UnitTest
+	{
+	public:
+		TestProfiler() : UnitTest("Profiler") {}
+		virtual void Run();
+	};
+
+	void TestProfiler::Run()
+	{
+		String func, line;
+		SplitFrame("[line 12]:34", &func, &line);
+		ErrorIf(func != "[line 12]" or line != "34");
+		SplitFrame("main:5", &func, &line);
+		ErrorIf(func != "main" or line != "5");
+
+		NameMap names;
+		names.SetValue("[line 12]", "update");
+		ErrorIf(FunctionLabel(names, "[line 12]") != "update");
+		ErrorIf(FunctionLabel(names, "[line 40]") != "function[line 40]");
+
+		CountMap counts;
+		counts.SetValue("a", 3);
+		counts.SetValue("b", 7);
+		counts.SetValue("c", 5);
+		SimpleVector<ReportEntry> sorted = SortedEntries(counts);
+		ErrorIf(sorted.size() != 3 or sorted[0].label != "b" or sorted[2].label != "a");
+	}
+
+	RegisterUnitTest(TestProfiler);
+}
@@ -0,0 +1,56 @@
+//
+//  MiniscriptProfiler.h
+//  MiniScript
+//
+//  A sampling profiler.  While a script runs, the interpreter calls Tick
+//  every few steps (when it checks the time anyway); about once per interval,
+//  we note where the script is: the line being run in each frame of the call
+//  stack.  Each sample is weighted by the intervals since the last one, so a
+//  slow intrinsic counts for as long as it took.  Time spent outside of
+//  RunUntilDone (e.g. drawing frames) isn't counted.
+//
+//  Samples are kept per thread; the report and stack file cover the samples
+//  taken on the calling thread.
+//
+
+#ifndef MINISCRIPTPROFILER_H
+#define MINISCRIPTPROFILER_H
+
+#include "SimpleString.h"
+
+namespace MiniScript {
+
+	class Machine;
+
+	class Profiler {
+	public:
+		// Set to true to take samples (off by default).
+		static bool enabled;
+
+		// Time between samples, in seconds.
+		static double interval;
+
+		// Called by the interpreter at the start of each run (so that time
+		// between runs is skipped), and every so often while running.
+		static void Resume(double now);
+		static void Tick(Machine *vm, double now);
+
+		// Total samples (in intervals) taken so far.
+		static long SampleCount();
+
+		// Write the samples as collapsed stacks, one line per distinct stack,
+		// like "main:40;Ball.update:34 12" (as read by flamegraph.pl, speedscope,
+		// etc.).  Functions are named by looking in vm's globals.  Returns
+		// false if the file could not be written.
+		static bool WriteCollapsedStacks(String path, Machine *vm);
+
+		// Get a summary of the topN hottest lines (by self time) and
+		// functions (by total time).
+		static String Report(Machine *vm, int topN=20);
+
+		// Forget all samples taken so far.
+		static void Reset();
+	};
+}
+
+#endif /* MINISCRIPTPROFILER_H */
@@ -7,6 +7,7 @@
 //
 
 #include "MiniscriptTAC.h"
+#include "MiniscriptJIT.h"
 #include <math.h>		// for pow() and fmod()
 #include <cmath>		// for std::signbit()
 #if _WIN32 || _WIN64
@@ -24,7 +25,34 @@ namespace MiniScript {
 		return d;
 	}
 	
+	TACLine::Op TACLine::GenericOp(Op op) {
+		switch (op) {
+			case Op::APlusBNum:				return Op::APlusB;
+			case Op::AMinusBNum:			return Op::AMinusB;
+			case Op::ATimesBNum:			return Op::ATimesB;
+			case Op::ADividedByBNum:		return Op::ADividedByB;
+			case Op::AEqualBJumpNum:		return Op::AEqualB;
+			case Op::ANotEqualBJumpNum:		return Op::ANotEqualB;
+			case Op::AGreaterThanBJumpNum:	return Op::AGreaterThanB;
+			case Op::AGreatOrEqualBJumpNum:	return Op::AGreatOrEqualB;
+			case Op::ALessThanBJumpNum:		return Op::ALessThanB;
+			case Op::ALessOrEqualBJumpNum:	return Op::ALessOrEqualB;
+			case Op::IncrementVarNum:		return Op::CallFunctionA;
+			case Op::LoadLocalA:			return Op::CallFunctionA;
+			default:						return op;
+		}
+	}
+	
 	String TACLine::ToString() {
+		if (op >= Op::APlusBNum) {
+			// specialized op: show it as the generic one, plus a note
+			TACLine generic(*this);
+			generic.op = GenericOp(op);
+			if (op == Op::IncrementVarNum) return generic.ToString() + " (then increment)";
+			if (op == Op::LoadLocalA) return generic.ToString() + " (local)";
+			if (op >= Op::AEqualBJumpNum) return generic.ToString() + " (numeric, then branch)";
+			return generic.ToString() + " (numeric)";
+		}
 		String text;
 		switch (op) {
 			case Op::AssignA:
@@ -108,6 +136,9 @@ namespace MiniScript {
 			case Op::CallFunctionA:
 				text = lhs.ToString() + " := call " + rhsA.ToString() + " with " + rhsB.ToString() + " args";
 				break;
+			case Op::CallFunctionIterA:
+				text = lhs.ToString() + " := call " + rhsA.ToString() + " with " + rhsB.ToString() + " args (for iteration)";
+				break;
 			case Op::CallIntrinsicA:
 				text = "intrinsic " + Intrinsic::GetByID(rhsA.IntValue())->name;
 				break;
@@ -182,14 +213,24 @@ namespace MiniScript {
 				RuntimeException("invalid use of 'new'; to create a function, use the 'function' keyword").raise();
 			}
 			ValueDict newMap;
+			newMap.UseShapes();		// (objects made with 'new' tend to share a layout)
 			newMap.SetValue(Value::magicIsA, opA);
 			return newMap;
 		}
 		
+		if (opA.type == ValueType::Handle and (op == Op::LengthOfA or op == Op::ElemBofIterA)) {
+			// lazy sequence from CallFunctionIterA (e.g. range)
+			RangeStorage *range = dynamic_cast<RangeStorage*>((RefCountedStorage*)opA.data.ref);
+			if (range != nullptr) {
+				if (op == Op::LengthOfA) return Value(range->count);
+				return Value(range->from + opB.IntValue() * range->step);
+			}
+		}
+		
 		if (op == Op::ElemBofA && opB.type == ValueType::String) {
 			// You can now look for a String in almost anything...
 			// and we have a convenient (and relatively fast) method for it:
-			return Value::Resolve(opA, opB.ToString(), context, nullptr);
+			return ResolveCached(opA, opB, context, nullptr);
 		}
 		
 		// check for special cases of comparison to null (works with any type)
@@ -204,6 +245,14 @@ namespace MiniScript {
 		// when either side is a string and the operator is addition.
 		if ((opA.type == ValueType::String or opB.type == ValueType::String) and op == Op::APlusB) {
 			if (opB.IsNull()) return opA;
+			if (opA.type == ValueType::String and lhs.type == ValueType::Var
+					and (rhsA.type == ValueType::Temp or (rhsA.type == ValueType::Var and rhsA.data.ref == lhs.data.ref))) {
+				// s = s + x: if nothing but s refers to this string, just extend it.
+				// (The parser usually loads s into a temp first, which is one more reference.)
+				String sB = opB.ToString();
+				long refs = (rhsA.type == ValueType::Temp ? 3 : 2);
+				if (opA.AppendInPlace(sB, context->variables, lhs.GetString(), refs)) return opA;
+			}
 			String sA = opA.ToString();
 			String sB = opB.ToString();
 			if (sA.LengthB() + sB.LengthB() > Value::maxStringSize) LimitExceededException("string too large").raise();
@@ -511,6 +560,133 @@ namespace MiniScript {
 		return Value::null;
 	}
 	
+	TACLine& TACLine::operator=(const TACLine& other) {
+		if (other.cache) other.cache->retain();
+		if (cache) cache->release();
+		lhs = other.lhs;
+		op = other.op;
+		rhsA = other.rhsA;
+		rhsB = other.rhsB;
+		comment = other.comment;
+		location = other.location;
+		cache = other.cache;
+		return *this;
+	}
+	
+	Value TACLine::ResolveCached(Value sequence, Value identifier, Context *context, ValueDict *outFoundInMap) {
+		if (sequence.type == ValueType::Temp or sequence.type == ValueType::Var) sequence = sequence.Val(context);
+		if (sequence.type != ValueType::Map) return Value::Resolve(sequence, identifier.ToString(), context, outFoundInMap);
+		if (!cache) cache = new InlineCache();
+		return cache->Resolve(sequence, identifier, context, outFoundInMap);
+	}
+	
+	thread_local long InlineCache::totalHits = 0;
+	thread_local long InlineCache::totalMisses = 0;
+
+	Value InlineCache::Resolve(Value receiver, Value identifier, Context *context, ValueDict *outFoundInMap) {
+		if (key.IsNull()) key = identifier;
+		if (disabled or receiver.type != ValueType::Map or identifier != key) {
+			return Value::Resolve(receiver, identifier.ToString(), context, outFoundInMap);
+		}
+		ValueDict d = receiver.GetDict();
+		DictShape<Value> *shape = d.Shape();
+		for (int i=0; i<count; i++) {
+			Entry& e = entries[i];
+			if (shape ? e.shape != shape : e.receiver != receiver.data.ref) continue;
+			if (e.depth == 0) {
+				// Found right in the receiver; the shape alone tells us where.
+				hits++; totalHits++;
+				if (outFoundInMap) *outFoundInMap = d;
+				return d.SlotValue(e.slot);
+			}
+			if (e.epoch != dictWatchEpoch) continue;
+			if (shape) {
+				const Value& isa = d.SlotValue(e.isaSlot);
+				if (isa.type != ValueType::Map or isa.data.ref != e.proto) continue;
+			}
+			hits++; totalHits++;
+			if (outFoundInMap) *outFoundInMap = e.holder.GetDict();
+			return e.value;
+		}
+		
+		misses++; totalMisses++;
+		if (misses > 256 and misses > hits) {
+			// This site just isn't cacheable (too many receiver types, or the
+			// maps involved keep changing).  Stop trying.
+			disabled = true;
+			Clear();
+		}
+		Value result;
+		ValueDict foundIn;
+		if (!Fill(receiver, identifier, &result, &foundIn)) {
+			return Value::Resolve(receiver, identifier.ToString(), context, outFoundInMap);
+		}
+		if (outFoundInMap) *outFoundInMap = foundIn;
+		return result;
+	}
+
+	bool InlineCache::Fill(Value receiver, Value identifier, Value *outValue, ValueDict *outFoundInMap) {
+		// Walk the __isa chain, as Value::Resolve does.  If we run off the end
+		// (into the generic map type), or hit anything unusual, return false
+		// and let Value::Resolve handle it.
+		Value chain[8];
+		int depth = 0;
+		Value obj = receiver;
+		while (true) {
+			ValueDict d = obj.GetDict();
+			if (d.HasEvalOverride()) return false;
+			if (d.Get(identifier, outValue)) {
+				*outFoundInMap = d;
+				break;
+			}
+			if (not d.Get(Value::magicIsA, &obj) or obj.type != ValueType::Map) return false;
+			if (++depth >= 8 or depth > Value::maxIsaDepth) return false;
+			chain[depth] = obj;
+		}
+		if (disabled) return true;
+		
+		ValueDict receiverDict = receiver.GetDict();
+		DictShape<Value> *shape = receiverDict.Shape();
+		if (depth == 0 and !shape) return true;		// (a plain hash lookup; nothing to gain)
+		
+		Entry *e;
+		if (count < maxEntries) e = &entries[count++];
+		else {
+			e = &entries[nextVictim];
+			nextVictim = (nextVictim + 1) % maxEntries;
+			if (e->shape) e->shape->release();
+		}
+		e->shape = shape;
+		if (shape) shape->retain();
+		e->receiver = shape ? nullptr : receiver.data.ref;
+		e->depth = depth;
+		e->slot = depth == 0 ? receiverDict.ShapeSlotOf(identifier) : -1;
+		e->isaSlot = shape ? receiverDict.ShapeSlotOf(Value::magicIsA) : -1;
+		e->proto = depth > 0 ? chain[1].data.ref : nullptr;
+		if (depth > 0) {
+			// Watch every map on the chain (other than a shape-mode receiver,
+			// whose shape already tells us it lacks the identifier).
+			if (!shape) receiverDict.Watch();
+			for (int i=1; i<=depth; i++) chain[i].GetDict().Watch();
+			e->holder = chain[depth];
+			e->value = *outValue;
+		} else {
+			e->holder = Value::null;
+			e->value = Value::null;
+		}
+		e->epoch = dictWatchEpoch;
+		return true;
+	}
+	
+	void InlineCache::Clear() {
+		for (int i=0; i<count; i++) {
+			if (entries[i].shape) entries[i].shape->release();
+			entries[i].shape = nullptr;
+			entries[i].holder = Value::null;
+			entries[i].value = Value::null;
+		}
+		count = nextVictim = 0;
+	}
 	
 	void Context::StoreValue(Value lhs, Value value) {
 //		std::cout << "Storing into " << lhs.ToString().c_str() << ": " << value.ToString().c_str() << std::endl;
@@ -692,15 +868,87 @@ namespace MiniScript {
 		stack.Add(nextContext);
 	}
 
+	/// <summary>
+	/// Execute one of the specialized ops (see TACLine::Op).
+	/// Returns false, after changing line.op back to its generic op, if the
+	/// operands turn out not to suit it; the caller should then carry on
+	/// as if the line had been generic all along.
+	/// </summary>
+	bool Machine::DoSpecializedLine(TACLine& line, Context *context) {
+		typedef TACLine::Op Op;
+		if (line.op == Op::IncrementVarNum) {
+			String ident = line.rhsA.GetString();
+			Value val;
+			if (context->variables.Get(ident, &val) and val.type == ValueType::Number) {
+				TACLine& next = context->code[context->lineNum];
+				double n = next.rhsB.data.number;
+				context->SetVar(ident, Value(next.op == Op::APlusB ? val.data.number + n : val.data.number - n));
+				context->lineNum++;
+				return true;
+			}
+			line.op = Op::CallFunctionA;
+			return false;
+		}
+		if (line.op == Op::LoadLocalA) {
+			Value val;
+			if (context->variables.Get(line.rhsA.GetString(), &val) and val.type != ValueType::Function) {
+				context->StoreValue(line.lhs, val);
+				return true;
+			}
+			line.op = Op::CallFunctionA;
+			return false;
+		}
+		
+		Value opA = line.rhsA.type == ValueType::Temp ? context->GetTemp(line.rhsA.data.tempNum) : line.rhsA;
+		Value opB = line.rhsB.type == ValueType::Temp ? context->GetTemp(line.rhsB.data.tempNum) : line.rhsB;
+		if (opA.type != ValueType::Number or opB.type != ValueType::Number) {
+			line.op = TACLine::GenericOp(line.op);
+			return false;
+		}
+		double fA = opA.data.number, fB = opB.data.number;
+		bool cond;
+		switch (line.op) {
+			case Op::APlusBNum:		context->StoreValue(line.lhs, Value(fA + fB));	return true;
+			case Op::AMinusBNum:	context->StoreValue(line.lhs, Value(fA - fB));	return true;
+			case Op::ATimesBNum:	context->StoreValue(line.lhs, Value(fA * fB));	return true;
+			case Op::ADividedByBNum:	context->StoreValue(line.lhs, Value(fA / fB));	return true;
+			case Op::AEqualBJumpNum:		cond = (fA == fB);	break;
+			case Op::ANotEqualBJumpNum:		cond = (fA != fB);	break;
+			case Op::AGreaterThanBJumpNum:	cond = (fA > fB);	break;
+			case Op::AGreatOrEqualBJumpNum:	cond = (fA >= fB);	break;
+			case Op::ALessThanBJumpNum:		cond = (fA < fB);	break;
+			case Op::ALessOrEqualBJumpNum:	cond = (fA <= fB);	break;
+			default:
+				line.op = TACLine::GenericOp(line.op);
+				return false;
+		}
+		// Do the "goto X if not <result>" on the next line, too.
+		if (cond) context->lineNum++;
+		else context->lineNum = context->code[context->lineNum].rhsA.IntValue();
+		return true;
+	}
+
 	void Machine::DoOneLine(TACLine& line, Context *context) {
+		if (line.op >= TACLine::Op::APlusBNum and DoSpecializedLine(line, context)) return;
 		if (line.op == TACLine::Op::PushParam) {
 			Value val = line.rhsA.IsNull() ? line.rhsA : line.rhsA.Val(context);
 			context->PushParamArgument(val);
-		} else if (line.op == TACLine::Op::CallFunctionA) {
+		} else if (line.op == TACLine::Op::CallFunctionA or line.op == TACLine::Op::CallFunctionIterA) {
 			// Resolve rhsA.  If it's a function, invoke it; otherwise,
 			// just store it directly.
 			ValueDict valueFoundIn;
-			Value funcVal = line.rhsA.Val(context, &valueFoundIn);		// resolves the whole dot chain, if any
+			Value funcVal;
+			Value seqVal;
+			bool gotSeqVal = false;
+			if (line.rhsA.type == ValueType::SeqElem and ((SeqElemStorage*)(line.rhsA.data.ref))->index.type == ValueType::String) {
+				// obj.method call: look it up via this line's inline cache
+				SeqElemStorage *se = (SeqElemStorage*)(line.rhsA.data.ref);
+				seqVal = se->sequence.Val(context);
+				gotSeqVal = true;
+				funcVal = line.ResolveCached(seqVal, se->index, context, &valueFoundIn);
+			} else {
+				funcVal = line.rhsA.Val(context, &valueFoundIn);		// resolves the whole dot chain, if any
+			}
 			if (funcVal.type == ValueType::Function) {
 				Value self;
 				// bind "super" to the parent of the map the function was found in
@@ -710,14 +958,32 @@ namespace MiniScript {
 					// except when invoking via "super"
 					Value seq = ((SeqElemStorage*)(line.rhsA.data.ref))->sequence;
 					if (seq.type == ValueType::Var && seq.ToString() == "super") self = context->GetVar("self");
-					else self = seq.Val(context);
+					else self = gotSeqVal ? seqVal : seq.Val(context);
 				}
 				long argCount = line.rhsB.IntValue();
 				FunctionStorage *fs = (FunctionStorage*)(funcVal.data.ref);
+				Value result;
+				bool forIteration = (line.op == TACLine::Op::CallFunctionIterA);
+				if (fs->intrinsic and fs->intrinsic->CallFast(context, argCount, not self.IsNull(), self, &result, forIteration)) {
+					// (native intrinsic: no call context needed)
+					context->StoreValue(line.lhs, result);
+					return;
+				}
+				JIT::Outcome jit = JIT::Outcome::NotRun;
+				if (JIT::enabled and not fs->intrinsic) {
+					jit = JIT::TryCall(fs, context, argCount, not self.IsNull(), &result);
+					if (jit == JIT::Outcome::Done) {
+						context->StoreValue(line.lhs, result);
+						return;
+					}
+				}
 				Context* nextContext = context->NextCallContext(fs, argCount, not self.IsNull(), line.lhs);
-				nextContext->outerVars = fs->outerVars;
+				// (Intrinsics have no outer variables; and as their functions are shared
+				// across threads, we mustn't give them a storage to share here.)
+				if (not fs->intrinsic) nextContext->outerVars = fs->outerVars;
 				if (!valueFoundIn.empty()) nextContext->SetVar("super", super);
 				if (not self.IsNull()) nextContext->SetVar("self", self);
+				if (jit == JIT::Outcome::Bailed) JIT::Resume(nextContext);
 				stack.Add(nextContext);
 			} else {
 				// The user is attempting to call something that's not a function.
@@ -19,6 +19,52 @@ namespace MiniScript {
 	class IntrinsicResult;
 	class Interpreter;
 	
+	// InlineCache: remembers where a dot-lookup (obj.field or obj.method) at
+	// one particular TAC line found its result, so that the next lookup there
+	// can usually skip the hash lookups and __isa walk.  Each entry is keyed on
+	// the receiver's shape (or, for a map not in shape mode, its identity).
+	// Entries that depend on maps up the __isa chain are validated against
+	// dictWatchEpoch, which changes whenever any of those maps is assigned to.
+	class InlineCache : public RefCountedStorage {
+	public:
+		InlineCache() : hits(0), misses(0), count(0), nextVictim(0), disabled(false) {}
+		virtual ~InlineCache() { Clear(); }
+		
+		// Look up identifier in receiver, exactly as Value::Resolve would,
+		// but using (and updating) this cache when possible.
+		Value Resolve(Value receiver, Value identifier, Context *context, ValueDict *outFoundInMap);
+		
+		void Clear();
+		
+		long hits;			// lookups answered from the cache
+		long misses;		// lookups that had to walk the map chain
+		
+		static thread_local long totalHits;		// hits, summed over all caches (on this thread)
+		static thread_local long totalMisses;	// misses, summed over all caches (on this thread)
+		
+	private:
+		struct Entry {
+			DictShape<Value> *shape;	// receiver's shape (retained), or null if not in shape mode
+			const void *receiver;		// receiver's storage, when not in shape mode (watched)
+			long isaSlot;				// slot of __isa in the receiver (shape mode, depth > 0)
+			const void *proto;			// storage of the receiver's __isa map (watched; depth > 0)
+			int depth;					// how far up the __isa chain the identifier was found
+			long slot;					// slot of the value in the receiver (depth 0)
+			Value holder;				// map in which the identifier was found (depth > 0)
+			Value value;				// value found (depth > 0)
+			unsigned long epoch;		// dictWatchEpoch when this entry was made
+		};
+		static const int maxEntries = 4;	// beyond this, we consider a site megamorphic
+		
+		bool Fill(Value receiver, Value identifier, Value *outValue, ValueDict *outFoundInMap);
+		
+		Value key;			// identifier this cache is for
+		Entry entries[maxEntries];
+		int count;
+		int nextVictim;		// entry to replace next, once we're full
+		bool disabled;		// set when this site misses too often to be worth caching
+	};
+	
 	class TACLine {
 	public:
 		enum class Op {
@@ -54,7 +100,29 @@ namespace MiniScript {
 			ReturnA,
 			ElemBofA,
 			ElemBofIterA,
-			LengthOfA
+			LengthOfA,
+			CallFunctionIterA,	// like CallFunctionA, but result is used only as a 'for' sequence
+			// Specializations, generated by the Optimizer.  Each behaves like its
+			// generic op (see GenericOp), but only for the operands noted (mostly
+			// two numbers); given anything else, it reverts (deopts) to the
+			// generic op for good.
+			APlusBNum,
+			AMinusBNum,
+			ATimesBNum,
+			ADividedByBNum,
+			// Compare-and-branch: the comparison, plus the GotoAifNotB on
+			// its result which must be the very next line (and is skipped).
+			AEqualBJumpNum,
+			ANotEqualBJumpNum,
+			AGreaterThanBJumpNum,
+			AGreatOrEqualBJumpNum,
+			ALessThanBJumpNum,
+			ALessOrEqualBJumpNum,
+			// "_t := call x with 0 args" followed by "x := _t + n" (or - n):
+			// when x is a local number, just adds n to it and skips the next line.
+			IncrementVarNum,
+			// "_t := call x with 0 args" where x is a local that's not a function.
+			LoadLocalA
 		};
 		
 		Value lhs;
@@ -64,12 +132,25 @@ namespace MiniScript {
 		String comment;
 		SourceLoc location;
 		
-		TACLine() : op(Op::Noop) {}
-		TACLine(Value lhs, Op op, Value rhsA, Value rhsB=Value::null) : lhs(lhs), op(op), rhsA(rhsA), rhsB(rhsB) {}
-		TACLine(Op op, Value rhsA, Value rhsB=Value()) : op(op), rhsA(rhsA), rhsB(rhsB) {}
+		TACLine() : op(Op::Noop), cache(nullptr) {}
+		TACLine(Value lhs, Op op, Value rhsA, Value rhsB=Value::null) : lhs(lhs), op(op), rhsA(rhsA), rhsB(rhsB), cache(nullptr) {}
+		TACLine(Op op, Value rhsA, Value rhsB=Value()) : op(op), rhsA(rhsA), rhsB(rhsB), cache(nullptr) {}
+		TACLine(const TACLine& other) : lhs(other.lhs), op(other.op), rhsA(other.rhsA), rhsB(other.rhsB),
+			comment(other.comment), location(other.location), cache(other.cache) { if (cache) cache->retain(); }
+		TACLine& operator=(const TACLine& other);
+		~TACLine() { if (cache) cache->release(); }
 
 		String ToString();
 		Value Evaluate(Context *context);
+		
+		// Map a specialized op to the generic op it stands in for.
+		static Op GenericOp(Op op);
+		
+		// Look up identifier in sequence, using this line's inline cache.
+		Value ResolveCached(Value sequence, Value identifier, Context *context, ValueDict *outFoundInMap);
+		
+	private:
+		InlineCache *cache;		// (created on first use by ResolveCached)
 	};
 		
 	class Context {
@@ -182,6 +263,7 @@ namespace MiniScript {
 		static double CurrentWallClockTime();
 		
 		void DoOneLine(TACLine& line, Context *context);
+		bool DoSpecializedLine(TACLine& line, Context *context);
 		void PopContext();
 		
 		List<Context*> stack;
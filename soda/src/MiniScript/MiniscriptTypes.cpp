@@ -10,6 +10,7 @@
 #include "MiniscriptErrors.h"
 #include "MiniscriptIntrinsics.h"
 #include "MiniscriptTAC.h"
+#include "MiniscriptJIT.h"
 #include "UnitTest.h"
 #include "SplitJoin.h"
 
@@ -28,21 +29,30 @@ namespace MiniScript {
 	Value Value::zero(0.0);
 	Value Value::one(1.0);
 	Value Value::emptyString("");
-	Value Value::magicIsA("__isa");
+	Value Value::magicIsA(String("__isa").Intern());
 	Value Value::null;
-	Value Value::keyString("key");
-	Value Value::valueString("value");
-	Value Value::implicitResult = Value::Var("_");
+	Value Value::keyString(String("key").Intern());
+	Value Value::valueString(String("value").Intern());
+	Value Value::implicitResult = Value::Var(String("_").Intern());
 
 	static int rotateBits(int n) {
 		return (n >> 1) | (n << (sizeof(int) * 8 - 1));
 	}
 
+	FunctionStorage::FunctionStorage() : intrinsic(nullptr), callCount(0), jitCode(nullptr) {
+		gcKind = GCKind::Function;
+	}
+	
+	FunctionStorage::~FunctionStorage() {
+		if (jitCode) JIT::Release(jitCode);
+	}
+	
 	FunctionStorage *FunctionStorage::BindAndCopy(ValueDict contextVariables) {
 		FunctionStorage *result = new FunctionStorage();
 		result->parameters = parameters;
 		result->code = code;
 		result->outerVars = contextVariables;
+		result->intrinsic = intrinsic;
 		return result;
 	}
 
@@ -509,6 +519,70 @@ namespace MiniScript {
 
 	}
 	
+	bool Value::AppendInPlace(const String& suffix, ValueDict& vars, const Value& varName, long expectedRefs) {
+		if (type != ValueType::String or data.ref == nullptr) return false;
+		StringStorage *ss = (StringStorage*)data.ref;
+		if (ss->RefCount() != expectedRefs or ss->interned or ss == suffix.ss) return false;
+		if (ss->dataSize - 1 + suffix.LengthB() > maxStringSize) return false;	// (let caller raise)
+		if (vars.HasAssignOverride() or vars.HasEvalOverride()) return false;
+		{
+			Value cur;
+			if (not vars.Get(varName, &cur) or cur.data.ref != data.ref) return false;
+		}
+		ss->AppendInPlace(suffix.c_str(), suffix.LengthB());
+		return true;
+	}
+
+	void Value::MakeImmortal() const {
+		if (type < ValueType::String or data.ref == nullptr) return;
+		if (data.ref->IsImmortal()) return;	// (already done)
+		switch (type) {
+			case ValueType::String:
+			case ValueType::Var:
+				String((StringStorage*)data.ref).MakeImmortal();
+				return;		// (which did the storage, too)
+			case ValueType::List:
+			{
+				data.ref->MakeImmortal();		// (first, in case of cycles)
+				ValueList list = GetList();
+				for (long i=0; i<list.Count(); i++) list[i].MakeImmortal();
+				return;
+			}
+			case ValueType::Map:
+			{
+				data.ref->MakeImmortal();
+				ValueDict map((ValueDictStorage*)data.ref);
+				for (ValueDictIterator kv = map.GetIterator(); !kv.Done(); kv.Next()) {
+					kv.Key().MakeImmortal();
+					kv.Value().MakeImmortal();
+				}
+				return;
+			}
+			case ValueType::Function:
+			{
+				data.ref->MakeImmortal();
+				FunctionStorage *fs = (FunctionStorage*)data.ref;
+				fs->parameters.MakeImmortal();
+				for (long i=0; i<fs->parameters.Count(); i++) {
+					fs->parameters[i].name.MakeImmortal();
+					fs->parameters[i].defaultValue.MakeImmortal();
+				}
+				fs->code.MakeImmortal();
+				for (long i=0; i<fs->code.Count(); i++) {
+					TACLine& line = fs->code[i];
+					line.lhs.MakeImmortal();
+					line.rhsA.MakeImmortal();
+					line.rhsB.MakeImmortal();
+				}
+				if (!fs->outerVars.empty()) Value(fs->outerVars).MakeImmortal();
+				return;
+			}
+			default:
+				data.ref->MakeImmortal();
+				return;
+		}
+	}
+
 	/// <summary>
 	/// Determine whether this value is the given type (or some subclass)
 	/// in the context of the given virtual machine.
@@ -649,6 +723,10 @@ namespace MiniScript {
 		return v.Hash();
 	}
 	
+	bool IsShapeKey(const Value& v) {
+		return v.type == ValueType::String;
+	}
+	
 	unsigned int IntHash(int i) {
 		unsigned int x = (unsigned int)i;
 		x = ((x >> 16) ^ x) * 0x45d9f3b;
@@ -868,11 +946,13 @@ private:
 	void TestBasics();
 	void TestHashAndEquality();
 	void TestSeqElem();
+	void TestShapes();
 };
 
 void TestValue::Run()
 {
 	TestBasics();
+	TestShapes();
 //	TestHashAndEquality();
 //	TestSeqElem();
 }
@@ -908,6 +988,37 @@ void TestValue::TestBasics()
 	Assert(s == "[1, \"two\", 3.14157]");
 }
 
+void TestValue::TestShapes() {
+	// Two maps built with the same keys in the same order share a shape.
+	ValueDict a, b;
+	a.UseShapes();
+	b.UseShapes();
+	a.SetValue("x", 1);
+	a.SetValue("y", 2);
+	b.SetValue("x", 10);
+	b.SetValue("y", 20);
+	Assert(a.Shape() and b.Shape());
+	Assert(a.Shape() == b.Shape());
+	Assert(a.Count() == 2 and a.Lookup("y", Value::null) == Value(2));
+	Assert(b["x"] == Value(10));
+	a.SetValue("x", 5);
+	Assert(a.Shape() == b.Shape() and a.Lookup("x", Value::null) == Value(5));
+	Assert(not a.ContainsKey("z"));
+	long n = 0;
+	for (ValueDictIterator kv = a.GetIterator(); !kv.Done(); kv.Next()) n++;
+	Assert(n == 2);
+
+	// A non-string key drops us back to dictionary mode, keeping the data.
+	b.SetValue(42, "answer");
+	Assert(not b.Shape());
+	Assert(b.Count() == 3 and b.Lookup("y", Value::null) == Value(20) and b.Lookup(42, Value::null) == "answer");
+
+	// So does removing a key.
+	a.Remove("x");
+	Assert(not a.Shape());
+	Assert(a.Count() == 1 and a.Lookup("y", Value::null) == Value(2));
+}
+
 void TestValue::TestHashAndEquality() {
 	Value a(42);
 	Value b(42);
@@ -26,6 +26,7 @@ namespace MiniScript {
 	class Machine;
 	
 	unsigned int HashValue(const Value& v);
+	bool IsShapeKey(const Value& v);		// (true for string keys; see DictShape)
 	
 	typedef List<Value> ValueList;
 	typedef ListStorage<Value> ValueListStorage;
@@ -39,8 +40,15 @@ namespace MiniScript {
 	/// actually HAVE names; instead there are named variables whose value may happen to be
 	/// a function.)
 	/// </summary>
+	class Intrinsic;
+
+	class JitCode;
+
 	class FunctionStorage : public RefCountedStorage {
 	public:
+		FunctionStorage();
+		virtual ~FunctionStorage();
+		
 		// Function parameters
 		List<FuncParam> parameters;
 		
@@ -50,6 +58,13 @@ namespace MiniScript {
 		// Local variables where the function was defined {#8}
 		ValueDict outerVars;
 		
+		// If this is the wrapper function for an intrinsic, that intrinsic
+		Intrinsic *intrinsic;
+		
+		// Calls so far, and native code once the JIT has tried to compile it
+		long callCount;
+		JitCode *jitCode;
+		
 		FunctionStorage *BindAndCopy(ValueDict contextVariables);
 	};
 
@@ -212,6 +227,20 @@ namespace MiniScript {
 		/// </summary>
 		bool IsA(Value type, Machine *vm);
 		
+		// Append the given string to this (string) value by extending its
+		// storage in place, provided that storage is also the current value of
+		// the given variable (which the caller is about to overwrite), and has
+		// no references beyond the expected number (this value, the variable,
+		// and any temp the caller loaded it through).  This makes building up
+		// a string with s = s + x take amortized linear time.  Returns false
+		// (and does nothing) if that's not safe, or would exceed maxStringSize.
+		bool AppendInPlace(const String& suffix, ValueDict& vars, const Value& varName, long expectedRefs);
+		
+		// Make this value, and everything it refers to, permanent, so that it
+		// can be shared by interpreters on different threads (see
+		// RefCountedStorage::MakeImmortal).  Nothing may change it after this.
+		void MakeImmortal() const;
+		
 		// handy statics (DO NOT MUTATE THESE!)
 		static Value zero;			// 0
 		static Value one;			// 1
@@ -277,7 +306,10 @@ namespace MiniScript {
 			{
 				if (data.ref == rhs.data.ref) return true;
 				if (!data.ref || !rhs.data.ref) return false;
-				return Equal((StringStorage*)data.ref, (StringStorage*)rhs.data.ref);
+				StringStorage *lhsSS = (StringStorage*)data.ref, *rhsSS = (StringStorage*)rhs.data.ref;
+				if (lhsSS->interned and rhsSS->interned) return false;	// (interned strings are unique)
+				if (lhsSS->hashKnown and rhsSS->hashKnown and lhsSS->hash != rhsSS->hash) return false;
+				return Equal(lhsSS, rhsSS);
 			}
 			case ValueType::List:
 			{
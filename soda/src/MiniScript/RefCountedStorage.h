@@ -10,6 +10,7 @@
 #define REFCOUNTEDSTORAGE_H
 
 #include <stdio.h>
+#include "SlabAllocator.h"
 
 namespace MiniScript {
 
@@ -17,13 +18,52 @@ namespace MiniScript {
 extern long _stringInstanceCount();
 #endif
 
+	class Value;
+	class RefCountedStorage;
+	class CycleCollector;
+	
+	// Note a container whose reference count has dropped (but not to zero),
+	// so the cycle collector will check whether it is part of a garbage cycle;
+	// or forget one that's about to be deleted.
+	void AddPossibleCycleRoot(RefCountedStorage *storage);
+	void ForgetPossibleCycleRoot(RefCountedStorage *storage);
+	
+	// Kinds of storage the cycle collector looks inside: those holding Values.
+	enum class GCKind : unsigned char { None, List, Map, Function };
+	template <class T> struct HoldsValues { static const bool value = false; };
+	template <> struct HoldsValues<Value> { static const bool value = true; };
+	
 	class RefCountedStorage {
 	public:
-		void retain() { refCount++; }
-		void release() { if (--refCount == 0) delete this; }
+		void retain() { if (!immortal) refCount++; }
+		void release() {
+			if (immortal) return;
+			if (--refCount == 0) {
+				if (gcIndex) ForgetPossibleCycleRoot(this);
+				delete this;
+			} else if (gcKind != GCKind::None and gcIndex == 0) {
+				AddPossibleCycleRoot(this);
+			}
+		}
+		long RefCount() const { return refCount; }
+		
+		// Make this storage permanent, so it can be shared by interpreters on
+		// different threads (as long as none of them changes it).  From then
+		// on, retain and release leave it alone, and so does the cycle
+		// collector; nothing writes to it at all.  Call this only before any
+		// other thread can see the storage.  (Its count is also set very high,
+		// so that checks for an unshared storage never pass.)
+		void MakeImmortal() { immortal = true; refCount = immortalRefCount; gcKind = GCKind::None; }
+		bool IsImmortal() const { return immortal; }
+		static const long immortalRefCount = 1L << 30;
+		
+		// Storages are small and short-lived, so come from the slab allocator.
+		// (The destructor is virtual, so delete gets the size of the actual subclass.)
+		static void *operator new(size_t size) { return SlabAllocator::Allocate(size); }
+		static void operator delete(void *p, size_t size) { SlabAllocator::Free(p, size); }
 		
 	protected:
-		RefCountedStorage() : refCount(1) {
+		RefCountedStorage() : refCount(1), gcKind(GCKind::None), gcColor(0), immortal(false), gcIndex(0) {
 #if(DEBUG)
 			instanceCount++;
 			printf("+++ %ld instances (%ld strings)\n", instanceCount, _stringInstanceCount());
@@ -37,6 +77,14 @@ extern long _stringInstanceCount();
 		}
 		
 		long refCount;
+		GCKind gcKind;			// set by containers of Values
+		unsigned char gcColor;	// cycle collector state (see MiniscriptGC.cpp)
+		bool immortal;			// set by MakeImmortal; never counted or collected
+		unsigned int gcIndex;	// 1 + position in the cycle collector's possible roots, or 0
+		
+		friend class CycleCollector;
+		friend void AddPossibleCycleRoot(RefCountedStorage *storage);
+		friend void ForgetPossibleCycleRoot(RefCountedStorage *storage);
 		
 #if(DEBUG)
 	public:
@@ -26,6 +26,25 @@ namespace MiniScript {
 	}
 #endif
 
+
+	// The size of the StringStorage being deleted, passed from its destructor
+	// to operator delete (which can't look at the destroyed object).
+	static thread_local size_t freeingBlockSize;
+
+	StringStorage::~StringStorage() {
+		if (data and data != inlineData) delete[] data;		// (buffer given to takeoverBuffer)
+#if(DEBUG)
+		instanceCount--;
+		if (_prev) _prev->_next = _next;
+		if (_next) _next->_prev = _prev;
+		if (head == this) head = _next;
+#endif
+		freeingBlockSize = blockSize ? blockSize : SlabAllocator::maxBlockSize + 1;
+	}
+
+	void StringStorage::operator delete(void *p) {
+		SlabAllocator::Free(p, freeingBlockSize);
+	}
 	
 	using std::fabs;
 	
@@ -195,6 +214,91 @@ namespace MiniScript {
 		}
 	}
 
+	StringStorage *StringStorage::SingleByte(unsigned char c) {
+		// One shared storage per byte value, created on demand (per thread,
+		// and released when the thread ends).
+		struct Singles {
+			StringStorage *storage[256];
+			~Singles() { for (int i=0; i<256; i++) if (storage[i]) storage[i]->release(); }
+		};
+		static thread_local Singles singles;
+		StringStorage *&single = singles.storage[c];
+		if (!single) {
+			single = New(2);
+			single->data[0] = (char)c;
+		}
+		single->retain();
+		return single;
+	}
+
+	// Intern table: an open-addressed hash set of interned string storage.
+	// There is one table per thread, so that threads never share storage.
+	// Interned storage is retained by the table, and so lasts as long as
+	// the thread does.
+	class InternTable {
+	public:
+		InternTable() : slots(nullptr), capacity(0), count(0) {}
+		~InternTable() {
+			for (unsigned long i=0; i<capacity; i++) if (slots[i]) slots[i]->release();
+			delete[] slots;
+		}
+		StringStorage **slots;
+		unsigned long capacity;		// always a power of 2
+		unsigned long count;
+	};
+	
+	static InternTable& GetInternTable() {
+		static thread_local InternTable table;
+		return table;
+	}
+
+	String String::Intern() const {
+		if (!ss or ss->dataSize <= 1 or ss->interned) return *this;
+		InternTable& table = GetInternTable();
+		if ((table.count + 1) * 2 > table.capacity) {
+			// Grow (or create) the table, and rehash everything into it.
+			unsigned long newCapacity = table.capacity ? table.capacity * 2 : 1024;
+			StringStorage **newSlots = new StringStorage*[newCapacity];
+			for (unsigned long i=0; i<newCapacity; i++) newSlots[i] = nullptr;
+			for (unsigned long i=0; i<table.capacity; i++) {
+				StringStorage *entry = table.slots[i];
+				if (!entry) continue;
+				unsigned long j = entry->hash & (newCapacity - 1);
+				while (newSlots[j]) j = (j + 1) & (newCapacity - 1);
+				newSlots[j] = entry;
+			}
+			delete[] table.slots;
+			table.slots = newSlots;
+			table.capacity = newCapacity;
+		}
+		unsigned int hash = Hash();
+		unsigned long mask = table.capacity - 1;
+		for (unsigned long i = hash & mask; ; i = (i + 1) & mask) {
+			StringStorage *entry = table.slots[i];
+			if (!entry) {
+				// Not found; our own storage becomes the interned one.
+				table.slots[i] = ss;
+				ss->retain();
+				ss->interned = true;
+				table.count++;
+				return *this;
+			}
+			if (entry->hash == hash and entry->dataSize == ss->dataSize
+					and memcmp(entry->data, ss->data, ss->dataSize) == 0) {
+				entry->retain();
+				return String(entry, false);
+			}
+		}
+	}
+
+	void String::MakeImmortal() const {
+		if (!ss) return;
+		Hash();			// (work out the cached data now, so no thread writes it later)
+		Length();
+		ss->MakeImmortal();
+		ss->interned = false;
+	}
+
 
 	//--------------------------------------------------------------------------------
 	// Unit Tests
@@ -296,6 +400,22 @@ namespace MiniScript {
 		s = s.Replace("oo", "oooo");	// scary, but should be safe!
 		Assert(s == "foooobarbazaroooo");
 		
+		String a("interned"), b(String("inter") + "ned");
+		Assert(a.Hash() == b.Hash());
+		Assert(not a.IsInterned() and not b.IsInterned());
+		a = a.Intern();
+		b = b.Intern();
+		Assert(a.IsInterned() and b.IsInterned() and a.c_str() == b.c_str());
+		Assert(String("nonesuch").Intern() != a);
+		
+		// single-byte strings share storage; short and long strings both work
+		Assert(String('q').c_str() == String("q").c_str());
+		Assert(String("xqz").SubstringB(1, 1).c_str() == String('q').c_str());
+		s = "fifteen chars!!";
+		Assert(s.LengthB() == 15 and s + "" == "fifteen chars!!");
+		s = s + s + s;
+		Assert(s.LengthB() == 45 and s.SubstringB(30) == "fifteen chars!!");
+		
 		s = "another simple String";
 		char *str = new char[23];
 		strcpy(str,"an array of characters");
@@ -12,7 +12,9 @@
 #include <assert.h>
 #include <cctype>
 #include <cstring>
+#include <new>
 #include "RefCountedStorage.h"
+#include "SlabAllocator.h"
 
 namespace MiniScript {
 
@@ -24,7 +26,26 @@ namespace MiniScript {
 
 	class StringStorage : public RefCountedStorage {
 	private:
-		StringStorage() : data(nullptr), dataSize(0), charCount(-1) {
+		// Small strings (up to INLINE_BYTES-1 characters plus the terminating
+		// null) fit entirely within the storage object.  Longer strings are
+		// still allocated in a single block, by over-allocating the storage
+		// so that inlineData runs on past its declared size.  Either way,
+		// use New() rather than operator new to make one.
+		enum { INLINE_BYTES = 16 };
+		
+		static StringStorage *New(size_t bufSize) {
+			size_t extra = bufSize > INLINE_BYTES ? bufSize - INLINE_BYTES : 0;
+			size_t size = sizeof(StringStorage) + extra;
+			StringStorage *result = ::new(SlabAllocator::Allocate(size)) StringStorage(bufSize);
+			result->blockSize = size <= SlabAllocator::maxBlockSize ? (unsigned short)size : 0;
+			return result;
+		}
+		static void operator delete(void *p);	// (frees blockSize bytes; see ~StringStorage)
+		
+		// Get the shared storage for a one-byte string (already retained for the caller).
+		static StringStorage *SingleByte(unsigned char c);
+		
+		StringStorage() : data(nullptr), dataSize(0), capacity(0), charCount(-1), hash(0), hashKnown(false), interned(false), blockSize(sizeof(StringStorage)) {
 #if(DEBUG)
 			instanceCount++;
 			_prev = nullptr; _next = head;
@@ -32,9 +53,10 @@ namespace MiniScript {
 			head = this;
 #endif
 		}
-		StringStorage(size_t bufSize) : dataSize(bufSize), charCount(-1) {
-			data = new char[bufSize];
-			memset(data, 0, bufSize);
+		StringStorage(size_t bufSize) : data(inlineData), dataSize(bufSize), capacity(bufSize > INLINE_BYTES ? bufSize : INLINE_BYTES),
+				charCount(-1), hash(0), hashKnown(false), interned(false), blockSize(sizeof(StringStorage)) {
+			// Note: callers are responsible for filling in all but the last byte.
+			data[bufSize-1] = 0;
 #if(DEBUG)
 			instanceCount++;
 			_prev = nullptr; _next = head;
@@ -42,22 +64,39 @@ namespace MiniScript {
 			head = this;
 #endif
 		}
-		virtual ~StringStorage() {
-			if (data) delete[] data;
-#if(DEBUG)
-			instanceCount--;
-			if (_prev) _prev->_next = _next;
-			if (_next) _next->_prev = _prev;
-			if (head == this) head = _next;
-#endif
-		}
+		virtual ~StringStorage();
 		
 		char *data;
 		size_t dataSize;
+		size_t capacity;	// bytes available at data (>= dataSize)
+		
+		// Append bytes to this storage in place, growing the buffer
+		// geometrically as needed.  This mutates the storage, so it may
+		// only be used when nothing else can see it (see Value::AppendInPlace).
+		void AppendInPlace(const char *bytes, size_t byteCount) {
+			size_t newSize = dataSize + byteCount;
+			if (newSize > capacity) {
+				size_t newCapacity = newSize * 2;
+				char *newData = new char[newCapacity];
+				memcpy(newData, data, dataSize - 1);
+				if (data != inlineData) delete[] data;
+				data = newData;
+				capacity = newCapacity;
+			}
+			memcpy(data + dataSize - 1, bytes, byteCount);
+			data[newSize - 1] = 0;
+			dataSize = newSize;
+			charCount = -1;
+			hashKnown = false;
+		}
 		
 		// some cached data for efficiency:
 		long charCount; // -1 when not yet known
 		bool isASCII;   // if charCount > 0 and isASCII==true, then this String is 1 byte per character
+		unsigned int hash;	// valid only when hashKnown is true
+		bool hashKnown;
+		bool interned;	// true if this storage is in the intern table (see String::Intern)
+		unsigned short blockSize;	// bytes allocated for this storage, or 0 if too big for a size class
 		
 		friend class String;
 		friend class Value;
@@ -70,7 +109,9 @@ namespace MiniScript {
 		static long instanceCount;
 		static StringStorage* head;
 		static void DumpStrings();
+	private:
 #endif
+		char inlineData[INLINE_BYTES];	// (must be last; see New)
 	};
 
 	#pragma mark -
@@ -89,7 +130,7 @@ namespace MiniScript {
 		~String() { release(); }
 		
 		// operators
-		String& operator= (const String& other) { if (other != *this) { if (other.ss) other.ss->refCount++; release(); ss = other.ss; isTemp = false; } return *this; }
+		String& operator= (const String& other) { if (other.ss != ss) { if (other.ss) other.ss->retain(); release(); ss = other.ss; isTemp = false; } return *this; }
 		inline String& operator=(const char c);
 		inline String& operator= (const char* c);
 		inline String operator+ (const String& other) const;
@@ -146,8 +187,10 @@ namespace MiniScript {
 		bool operator>= (const char *c) const { return Compare(c) >= 0; }
 		bool operator<= (const char *c) const { return Compare(c) <= 0; }
 		
-		// mutators (note: these bind this String to a new storage;
-		// we NEVER mutate the String storage itself)
+		// mutators (note: these bind this String to a new storage; shared
+		// storage is never mutated.  The one exception is StringStorage::
+		// AppendInPlace, used only on storage that is not interned and has
+		// no other references besides the variable being appended to)
 		inline String& Append(const String& other);
 		inline String& operator+= (const String& other) { return this->Append(other); }
 		inline String& assign(const String& s) { return (*this = s); }
@@ -179,6 +222,17 @@ namespace MiniScript {
 
 		inline unsigned int Hash() const;
 		
+		// Interning: return an equivalent String whose storage is shared by
+		// all interned strings with the same content (on this thread).  Two
+		// interned strings are equal if and only if they share storage.
+		String Intern() const;
+		bool IsInterned() const { return ss and ss->interned; }
+		
+		// Make our storage permanent, to share with other threads (see
+		// RefCountedStorage::MakeImmortal).  It no longer counts as interned,
+		// as each thread has an intern table of its own.
+		void MakeImmortal() const;
+		
 		friend class Value;
 		
 	private:
@@ -204,11 +258,11 @@ namespace MiniScript {
 	String::String(int count, char c) : isTemp(false) {
 		if (count < 1) {
 			ss = nullptr;
+		} else if (count == 1) {
+			ss = StringStorage::SingleByte(c);
 		} else {
-
-			ss = new StringStorage(count+1);
+			ss = StringStorage::New(count+1);
 			for (int i = 0; i < count; i++) ss->data[i] = c;
-			ss->data[count+1] = 0;
 		}
 	}
 
@@ -216,8 +270,10 @@ namespace MiniScript {
 		size_t n = c ? strlen(c) : 0;
 		if (!n) {
 			ss = nullptr;
+		} else if (n == 1) {
+			ss = StringStorage::SingleByte(c[0]);
 		} else {
-			ss = new StringStorage(n+1);
+			ss = StringStorage::New(n+1);
 			memcpy(ss->data, c, n+1);
 		}
 	}
@@ -225,17 +281,16 @@ namespace MiniScript {
 	String::String(const char* buf, size_t bytes) : isTemp(false) {
 		if (!bytes) {
 			ss = nullptr;
+		} else if (bytes == 1) {
+			ss = StringStorage::SingleByte(buf[0]);
 		} else {
-			ss = new StringStorage(bytes+1);
+			ss = StringStorage::New(bytes+1);
 			memcpy(ss->data, buf, bytes);
-			ss->data[bytes] = 0;
 		}
 	}
 
 	inline String::String(const char c) : isTemp(false) {
-		ss = new StringStorage(2);
-		ss->data[0] = c;
-		ss->data[1] = 0;
+		ss = StringStorage::SingleByte(c);
 	}
 
 	String& String::operator=(const char* c) {
@@ -243,8 +298,10 @@ namespace MiniScript {
 		size_t n = strlen(c);
 		if (!n) {
 			ss = nullptr;
+		} else if (n == 1) {
+			ss = StringStorage::SingleByte(c[0]);
 		} else {
-			ss = new StringStorage(n+1);
+			ss = StringStorage::New(n+1);
 			memcpy(ss->data, c, n+1);
 		}
 		isTemp = false;
@@ -253,11 +310,7 @@ namespace MiniScript {
 
 	String& String::operator=(const char c) {
 		release();
-		
-		ss = new StringStorage(2);
-		ss->data[0] = c;
-		ss->data[1] = 0;
-		
+		ss = StringStorage::SingleByte(c);
 		isTemp = false;
 		return *this;
 	}
@@ -377,9 +430,11 @@ namespace MiniScript {
 		if (LengthB == -1 or LengthB > (long)ss->dataSize-1 - posB) {
 			LengthB = ss->dataSize-1 - posB;
 		}
-		if (posB == 0 and LengthB == (long)ss->dataSize) return *this;
+		if (posB == 0 and LengthB == (long)ss->dataSize-1) return *this;
+		if (LengthB <= 0) return String();
+		if (LengthB == 1) return String(StringStorage::SingleByte(ss->data[posB]), false);
 		
-		StringStorage *newbie = new StringStorage(LengthB+1);
+		StringStorage *newbie = StringStorage::New(LengthB+1);
 		memcpy(newbie->data, ss->data+posB, LengthB);
 
 		#if DEBUG
@@ -396,7 +451,7 @@ namespace MiniScript {
 		} else {
 			size_t n1 = ss ? ss->dataSize - 1 : 0;
 			size_t n2 = other.ss ? other.ss->dataSize - 1 : 0;
-			StringStorage* newbie = new StringStorage(n1 + n2 + 1);
+			StringStorage* newbie = StringStorage::New(n1 + n2 + 1);
 			memcpy(newbie->data, ss->data, n1);
 			memcpy(newbie->data+n1, other.ss->data, n2+1);
 			release();
@@ -444,7 +499,11 @@ namespace MiniScript {
 			return out;
 		}
 		
-		StringStorage *newbie = new StringStorage(newSize +1);
+		if (newSize == 1) {
+			out.ss = StringStorage::SingleByte(*start);
+			return out;
+		}
+		StringStorage *newbie = StringStorage::New(newSize +1);
 		memcpy(newbie->data, start, newSize);
 		out.ss = newbie;
 		
@@ -474,6 +533,7 @@ namespace MiniScript {
 		newbie->data = buffer;
 		if (strBytes >= 0) newbie->dataSize = strBytes + 1; // +1 for the nullptr character
 		else if (buffer) newbie->dataSize = strlen(buffer) + 1; // (same)
+		newbie->capacity = newbie->dataSize;
 		ss = newbie;
 		isTemp = false;
 		return *this;
@@ -485,7 +545,7 @@ namespace MiniScript {
 		
 		size_t n1 = ss ? ss->dataSize - 1 : 0;
 		size_t n2 = other.ss ? other.ss->dataSize - 1 : 0;
-		StringStorage* newbie = new StringStorage(n1 + n2 + 1);
+		StringStorage* newbie = StringStorage::New(n1 + n2 + 1);
 		memcpy(newbie->data, ss->data, n1);
 		memcpy(newbie->data+n1, other.ss->data, n2+1);
 		return String(newbie, false);		// LEAK
@@ -497,7 +557,7 @@ namespace MiniScript {
 		
 		size_t n1 = ss ? ss->dataSize - 1 : 0;
 		size_t n2 = strlen(c);
-		StringStorage* newbie = new StringStorage(n1 + n2 + 1);
+		StringStorage* newbie = StringStorage::New(n1 + n2 + 1);
 		memcpy(newbie->data, ss->data, n1);
 		memcpy(newbie->data+n1, c, n2+1);
 		return String(newbie, false);	// LEAK
@@ -508,7 +568,7 @@ namespace MiniScript {
 		if (!s.ss) return String(c);
 		size_t n1 = strlen(c);
 		size_t n2 = s.ss ? s.ss->dataSize - 1 : 0;
-		StringStorage* newbie = new StringStorage(n1 + n2 + 1);
+		StringStorage* newbie = StringStorage::New(n1 + n2 + 1);
 		memcpy(newbie->data, c, n1);
 		memcpy(newbie->data+n1, s.ss->data, n2+1);
 		return String(newbie, false);	// LEAK
@@ -517,7 +577,7 @@ namespace MiniScript {
 	inline String String::ToLower() const {
 		String out;
 		if (ss != nullptr) {
-			out.ss = new StringStorage(ss->dataSize);
+			out.ss = StringStorage::New(ss->dataSize);
 			memcpy(out.ss->data, ss->data, ss->dataSize);
 			for (unsigned int i = 0; i < out.ss->dataSize; i++) {
 				out.ss->data[i] = tolower(out.ss->data[i]);
@@ -529,7 +589,7 @@ namespace MiniScript {
 	inline String String::ToUpper() const {
 		String out;
 		if (ss) {
-			out.ss = new StringStorage(ss->dataSize);
+			out.ss = StringStorage::New(ss->dataSize);
 			memcpy(out.ss->data, ss->data, ss->dataSize);
 			for (unsigned int i = 0; i < out.ss->dataSize; i++) {
 				out.ss->data[i] = toupper(out.ss->data[i]);
@@ -548,6 +608,9 @@ namespace MiniScript {
 
 	unsigned int String::Hash() const {
 		// http://isthe.com/chongo/tech/comp/fnv/#FNV-1a
+		// (We compute this once and cache it in the storage.  That's safe because
+		// the only mutation, StringStorage::AppendInPlace, clears hashKnown.)
+		if (ss and ss->hashKnown) return ss->hash;
 		
 		const unsigned int fnv_prime = 16777619u;
 		unsigned int hash = 2166136261u;
@@ -557,6 +620,10 @@ namespace MiniScript {
 			hash *= fnv_prime;
 		}
 		
+		if (ss) {
+			ss->hash = hash;
+			ss->hashKnown = true;
+		}
 		return hash;
 	}
 	
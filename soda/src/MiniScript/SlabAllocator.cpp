@@ -0,0 +1,215 @@
+//
+//  SlabAllocator.cpp
+//  MiniScript
+//
+//  See SlabAllocator.h.  Each size class has a free list (threaded through
+//  the free blocks themselves) and the unused tail of its current slab;
+//  we take from the free list first, then from the tail, and only then
+//  get a new slab.  When a thread ends, its free blocks (and the unused
+//  tails of its slabs) go into a shared orphan pool, which any thread
+//  takes from before getting a new slab.
+//
+
+#include "SlabAllocator.h"
+#include "UnitTest.h"
+#include <new>
+#include <mutex>
+#include <atomic>
+#include <thread>
+
+namespace MiniScript {
+
+#if MINISCRIPT_SLAB_ALLOC
+
+	struct FreeBlock {
+		FreeBlock *next;
+	};
+
+	// Per-thread state.  This is plain data (all zero to start), so that
+	// getting at it doesn't need any thread-local initialization check.
+	struct SlabPool {
+		FreeBlock *freeList[SlabAllocator::classCount];
+		char *tail[SlabAllocator::classCount];		// unused part of the current slab...
+		char *tailEnd[SlabAllocator::classCount];	// ...and its end
+		long allocs[SlabAllocator::classCount];
+		long frees[SlabAllocator::classCount];
+		long large;
+		bool ended;				// set by ThreadEnded
+	};
+	static thread_local SlabPool pool;
+
+	// Free blocks left behind by threads that have ended.
+	struct OrphanPool {
+		std::mutex lock;
+		FreeBlock *freeList[SlabAllocator::classCount];
+	};
+	static OrphanPool orphans;
+	static std::atomic<long> slabBytes(0);
+
+	static void *AllocateFromSlab(int c) {
+		size_t blockSize = SlabAllocator::BlockSize(c);
+		if (pool.tail[c] + blockSize > pool.tailEnd[c]) {
+			// Adopt all the orphaned blocks of this class, if there are any.
+			FreeBlock *adopted;
+			{
+				std::lock_guard<std::mutex> guard(orphans.lock);
+				adopted = orphans.freeList[c];
+				orphans.freeList[c] = nullptr;
+			}
+			if (adopted != nullptr) {
+				pool.freeList[c] = adopted->next;
+				return adopted;
+			}
+			// (Slabs are never freed: blocks from them may be in use on any thread.)
+			pool.tail[c] = (char*)::operator new(SlabAllocator::slabSize);
+			pool.tailEnd[c] = pool.tail[c] + SlabAllocator::slabSize;
+			slabBytes += SlabAllocator::slabSize;
+		}
+		void *result = pool.tail[c];
+		pool.tail[c] += blockSize;
+		return result;
+	}
+
+	void *SlabAllocator::Allocate(size_t size) {
+		if (size > maxBlockSize) {
+			pool.large++;
+			return ::operator new(size);
+		}
+		int c = ClassOf(size);
+		pool.allocs[c]++;
+		FreeBlock *b = pool.freeList[c];
+		if (b == nullptr) return AllocateFromSlab(c);
+		pool.freeList[c] = b->next;
+		return b;
+	}
+
+	void SlabAllocator::Free(void *p, size_t size) {
+		if (p == nullptr) return;
+		if (size > maxBlockSize) {
+			::operator delete(p);
+			return;
+		}
+		int c = ClassOf(size);
+		pool.frees[c]++;
+		FreeBlock *b = (FreeBlock*)p;
+		if (pool.ended) {
+			// (Freed by a thread-local destructor, as the thread exits.)
+			std::lock_guard<std::mutex> guard(orphans.lock);
+			b->next = orphans.freeList[c];
+			orphans.freeList[c] = b;
+			return;
+		}
+		b->next = pool.freeList[c];
+		pool.freeList[c] = b;
+	}
+
+	void SlabAllocator::ThreadEnded() {
+		for (int c=0; c<classCount; c++) {
+			// Chain the free list and the unused tail together...
+			FreeBlock *head = pool.freeList[c];
+			FreeBlock **end = &head;
+			while (*end != nullptr) end = &(*end)->next;
+			size_t blockSize = BlockSize(c);
+			for (char *p = pool.tail[c]; p + blockSize <= pool.tailEnd[c]; p += blockSize) {
+				*end = (FreeBlock*)p;
+				end = &(*end)->next;
+			}
+			*end = nullptr;
+			pool.freeList[c] = nullptr;
+			pool.tail[c] = pool.tailEnd[c] = nullptr;
+			if (head == nullptr) continue;
+			// ...and put that in front of the orphans.
+			std::lock_guard<std::mutex> guard(orphans.lock);
+			*end = orphans.freeList[c];
+			orphans.freeList[c] = head;
+		}
+		pool.ended = true;
+	}
+
+	long SlabAllocator::Allocations() {
+		long result = 0;
+		for (int c=0; c<classCount; c++) result += pool.allocs[c];
+		return result;
+	}
+
+	long SlabAllocator::Frees() {
+		long result = 0;
+		for (int c=0; c<classCount; c++) result += pool.frees[c];
+		return result;
+	}
+
+	long SlabAllocator::LargeAllocations() { return pool.large; }
+	long SlabAllocator::SlabBytes() { return slabBytes; }
+
+	long SlabAllocator::LiveBlocks(int sizeClass) {
+		if (sizeClass < 0 or sizeClass >= classCount) return 0;
+		return pool.allocs[sizeClass] - pool.frees[sizeClass];
+	}
+
+#else
+
+	void *SlabAllocator::Allocate(size_t size) { return ::operator new(size); }
+	void SlabAllocator::Free(void *p, size_t size) { ::operator delete(p); }
+	void SlabAllocator::ThreadEnded() {}
+	long SlabAllocator::Allocations() { return 0; }
+	long SlabAllocator::Frees() { return 0; }
+	long SlabAllocator::LargeAllocations() { return 0; }
+	long SlabAllocator::SlabBytes() { return 0; }
+	long SlabAllocator::LiveBlocks(int sizeClass) { return 0; }
+
+#endif
+
+	//--------------------------------------------------------------------------------
+
+	class TestSlabAllocator : public UnitTest
+	{
+	public:
+		TestSlabAllocator() : UnitTest("SlabAllocator") {}
+		virtual void Run();
+	};
+
+	void TestSlabAllocator::Run()
+	{
+		void *a = SlabAllocator::Allocate(24);
+		void *b = SlabAllocator::Allocate(32);
+		void *big = SlabAllocator::Allocate(SlabAllocator::maxBlockSize + 1);
+		ErrorIf(a == nullptr or b == nullptr or big == nullptr or a == b);
+		ErrorIf(SlabAllocator::ClassOf(16) != 0 or SlabAllocator::ClassOf(17) != 1);
+		ErrorIf(SlabAllocator::BlockSize(SlabAllocator::ClassOf(300)) != 512);
+		ErrorIf(SlabAllocator::BlockSize(SlabAllocator::classCount - 1) != SlabAllocator::maxBlockSize);
+		#if MINISCRIPT_SLAB_ALLOC
+		ErrorIf(SlabAllocator::LiveBlocks(1) < 2);
+		long before = SlabAllocator::LiveBlocks(1);
+		SlabAllocator::Free(a, 24);
+		ErrorIf(SlabAllocator::LiveBlocks(1) != before - 1);
+		void *c = SlabAllocator::Allocate(17);		// (same size class, so reuses a)
+		ErrorIf(c != a);
+		SlabAllocator::Free(c, 17);
+		
+		// A thread's free blocks outlive it, for reuse by the next thread.
+		void *fromFirst = nullptr, *fromSecond = nullptr;
+		long bytes = 0;
+		std::thread first([&]() {
+			fromFirst = SlabAllocator::Allocate(3000);
+			SlabAllocator::Free(fromFirst, 3000);
+			bytes = SlabAllocator::SlabBytes();
+			SlabAllocator::ThreadEnded();
+		});
+		first.join();
+		std::thread second([&]() {
+			fromSecond = SlabAllocator::Allocate(3000);
+			SlabAllocator::Free(fromSecond, 3000);
+			SlabAllocator::ThreadEnded();
+		});
+		second.join();
+		ErrorIf(fromSecond != fromFirst);
+		ErrorIf(SlabAllocator::SlabBytes() != bytes);
+		#else
+		SlabAllocator::Free(a, 24);
+		#endif
+		SlabAllocator::Free(b, 32);
+		SlabAllocator::Free(big, SlabAllocator::maxBlockSize + 1);
+	}
+
+	RegisterUnitTest(TestSlabAllocator);
+}
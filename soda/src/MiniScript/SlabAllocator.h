@@ -0,0 +1,74 @@
+//
+//  SlabAllocator.h
+//  MiniScript
+//
+//  A small-object allocator for the ref-counted storages (strings, lists,
+//  maps, functions, etc.) and hash map entries, which are created and
+//  destroyed at a great rate by any running script.  Blocks are grouped
+//  into size classes, each with its own free list, carved out of large
+//  slabs that are never given back.  The free lists are per-thread, so
+//  no locking is needed; a block freed on a different thread than the one
+//  that allocated it simply joins the freeing thread's list.  A thread
+//  that ends should call ThreadEnded, so that its free blocks can be
+//  reused by other threads rather than lost.
+//
+//  Build with MINISCRIPT_SLAB_ALLOC=0 to use the global allocator instead
+//  (e.g. for comparison, or when running under a memory checker).
+//
+
+#ifndef SLABALLOCATOR_H
+#define SLABALLOCATOR_H
+
+#include <stddef.h>
+
+#ifndef MINISCRIPT_SLAB_ALLOC
+#define MINISCRIPT_SLAB_ALLOC 1
+#endif
+
+namespace MiniScript {
+
+	class SlabAllocator {
+	public:
+		// Size classes go up by smallStep to smallMax, then by largeStep to
+		// maxBlockSize (which is big enough for a map's hash table storage).
+		enum {
+			smallStep = 16,
+			smallMax = 256,
+			largeStep = 256,
+			maxBlockSize = 4096,					// larger requests go to the global allocator
+			classCount = smallMax / smallStep + (maxBlockSize - smallMax) / largeStep,
+			slabSize = 64 * 1024					// bytes obtained at a time for each size class
+		};
+
+		// Allocate or free a block of the given size.  Free must be given
+		// the same size that was passed to Allocate.
+		static void *Allocate(size_t size);
+		static void Free(void *p, size_t size);
+
+		// Hand the current thread's free blocks over to whichever thread next
+		// needs blocks of the same size.  Call this when a thread is done
+		// running scripts; anything it frees after that (e.g. in thread-local
+		// destructors) goes straight to the other threads too.
+		static void ThreadEnded();
+
+		// Statistics for the current thread (all zero if built without slabs).
+		static long Allocations();		// blocks handed out from size classes
+		static long Frees();			// blocks returned to size classes
+		static long LargeAllocations();	// requests too big for any size class
+		static long SlabBytes();		// total bytes of slab obtained (by all threads)
+		static long LiveBlocks(int sizeClass);	// blocks of the given class currently in use
+		
+		// Size class for a request of the given size (up to maxBlockSize), and the block size of a class.
+		static int ClassOf(size_t size) {
+			if (size <= smallMax) return size ? (int)((size - 1) / smallStep) : 0;
+			return smallMax / smallStep + (int)((size - smallMax - 1) / largeStep);
+		}
+		static size_t BlockSize(int sizeClass) {
+			if (sizeClass < smallMax / smallStep) return (size_t)(sizeClass + 1) * smallStep;
+			return smallMax + (size_t)(sizeClass - smallMax / smallStep + 1) * largeStep;
+		}
+	};
+
+}
+
+#endif /* SLABALLOCATOR_H */
@@ -1,4 +1,5 @@
 #include "PixelDisplay.h"
+#include "SceneRenderer.h"
 #include "SdlUtils.h"
 #include "SdlGlue.h"
 #include "Color.h"
@@ -10,7 +11,7 @@ using namespace SdlGlue;
 namespace SdlGlue {
 
 PixelDisplay* mainPixelDisplay = nullptr;
-static SDL_Renderer* mainRenderer = nullptr;
+static unsigned long lastTileVersion = 0;
 
 static int ceilDiv(int x, int y) {
     if (x == 0) return 0;
@@ -113,8 +114,7 @@ PixelDisplay::~PixelDisplay() {
     DeallocArrays();
 }
 
-void SetupPixelDisplay(SDL_Renderer *renderer) {
-    mainRenderer = renderer;
+void SetupPixelDisplay() {
     mainPixelDisplay = new PixelDisplay();
 }
 
@@ -123,45 +123,32 @@ void ShutdownPixelDisplay() {
     mainPixelDisplay = nullptr;
 }
 
-void RenderPixelDisplay() {
-    mainPixelDisplay->Render();
-}
-
 void PixelDisplay::AllocArrays() {
     tileCols = ceilDiv(totalWidth, tileWidth);
     tileRows = ceilDiv(totalHeight, tileHeight);
     int qtyTiles = tileCols * tileRows;
     
-    tileTex = new SDL_Texture*[qtyTiles];
     textureInUse = new bool[qtyTiles];
     tileColor = new Color[qtyTiles];
-    tileNeedsUpdate = new bool[qtyTiles];
-    pixelCache = new CachedPixels[qtyTiles];
+    tilePixels = new TilePixels*[qtyTiles];
+    tileVersion = new unsigned long[qtyTiles];
     for (int i=0; i<qtyTiles; i++) {
-        SDL_Texture *tex = SDL_CreateTexture(mainRenderer, 
-            SDL_PIXELFORMAT_RGBA32, 
-            SDL_TEXTUREACCESS_STREAMING,
-            tileWidth, tileHeight);
-        SDL_SetTextureBlendMode(tex, SDL_BLENDMODE_BLEND);
-        tileTex[i] = tex;
         textureInUse[i] = false;
         tileColor[i] = Color(0,0,0,0);
-        tileNeedsUpdate[i] = false;
-        pixelCache[i].pixels = nullptr;
+        tilePixels[i] = nullptr;
+        tileVersion[i] = 0;
     }
 }
 
 void PixelDisplay::DeallocArrays() {
     int qtyTiles = tileCols * tileRows;
     for (int i=0; i<qtyTiles; i++) {
-        SDL_DestroyTexture(tileTex[i]);
-        if (pixelCache[i].pixels) delete[] pixelCache[i].pixels;
+        if (tilePixels[i]) tilePixels[i]->release();
     }
-    delete[] tileTex;
     delete[] textureInUse;
     delete[] tileColor;
-    delete[] tileNeedsUpdate;
-    delete[] pixelCache;
+    delete[] tilePixels;
+    delete[] tileVersion;
 }
 
 void PixelDisplay::Clear(Color color) {
@@ -172,54 +159,19 @@ void PixelDisplay::Clear(Color color) {
     }
 }
 
-void PixelDisplay::Render() {
-    int i = 0;
-    int windowHeight = tileRows * tileHeight;
-    
-    for (int row=0; row < tileRows; row++) {
-        int yPos = windowHeight - (row + 1) * tileHeight;
-        
-        for (int col=0; col < tileCols; col++) {
-            SDL_Rect destRect = { col*tileWidth, yPos, tileWidth, tileHeight };
-            if (textureInUse[i]) {
-                if (tileNeedsUpdate[i]) {
-                    void* pixels;
-                    int pitch;
-                    int err = SDL_LockTexture(tileTex[i], NULL, &pixels, &pitch);
-                    if (err) {
-                        printf("Error in SDL_LockTexture: %s\n", SDL_GetError());
-                        continue;
-                    }
-                    
-                    Color* srcP = pixelCache[i].pixels + (tileHeight - 1) * tileWidth;
-                    Uint8* destP = (Uint8*)pixels;
-                    int bytesToCopy = tileWidth * 4;
-                    
-                    if (bytesToCopy == pitch) {
-                        for (int y = 0; y < tileHeight; y++) {
-                            memcpy(destP + y * pitch, srcP - y * tileWidth, bytesToCopy);
-                        }
-                    } else {
-                        for (int y = 0; y < tileHeight; y++) {
-                            memcpy(destP, srcP, bytesToCopy);
-                            srcP -= tileWidth;
-                            destP += pitch;
-                        }
-                    }
-                    
-                    SDL_UnlockTexture(tileTex[i]);
-                    tileNeedsUpdate[i] = false;
-                }
-                SDL_RenderCopy(mainRenderer, tileTex[i], NULL, &destRect);
-            } else {
-                Color c = tileColor[i];
-                if (c.a > 0) {
-                    SDL_SetRenderDrawColor(mainRenderer, c.r, c.g, c.b, c.a);
-                    SDL_RenderFillRect(mainRenderer, &destRect);
-                }
-            }
-            i++;
-        }
+void PixelDisplay::Capture(Scene *scene) {
+    scene->tileCols = tileCols;
+    scene->tileRows = tileRows;
+    scene->tileWidth = tileWidth;
+    scene->tileHeight = tileHeight;
+    int qtyTiles = tileCols * tileRows;
+    for (int i=0; i<qtyTiles; i++) {
+        TileDraw tile;
+        tile.color = tileColor[i];
+        tile.version = tileVersion[i];
+        tile.pixels = textureInUse[i] ? tilePixels[i] : nullptr;
+        if (tile.pixels) tile.pixels->retain();
+        scene->tiles.push_back(tile);
     }
 }
 
@@ -255,13 +207,30 @@ bool PixelDisplay::EnsureTextureInUse(int tileIndex, Color unlessColor) {
 void PixelDisplay::EnsureTextureInUse(int tileIndex) {
     if (textureInUse[tileIndex]) return;
     int pixPerTile = tileWidth * tileHeight;
-    if (!pixelCache[tileIndex].pixels) pixelCache[tileIndex].pixels = new Color[pixPerTile];
-    Color* pixels = pixelCache[tileIndex].pixels;
+    Color* pixels = PixelsForWriting(tileIndex);
     Color c = tileColor[tileIndex];
     for (int i=0; i<pixPerTile; i++) *pixels++ = c;
     textureInUse[tileIndex] = true;
 }
 
+// Get the pixels of the given tile, ready to change.  If a scene still refers
+// to the current ones, we make a new copy rather than change them under it.
+// Either way, the tile gets a new version number.
+Color *PixelDisplay::PixelsForWriting(int tileIndex) {
+    int pixPerTile = tileWidth * tileHeight;
+    TilePixels *tile = tilePixels[tileIndex];
+    if (!tile) {
+        tile = tilePixels[tileIndex] = new TilePixels(pixPerTile);
+    } else if (tile->RefCount() > 1) {
+        TilePixels *copy = new TilePixels(pixPerTile);
+        memcpy(copy->pixels, tile->pixels, pixPerTile * sizeof(Color));
+        tile->release();
+        tile = tilePixels[tileIndex] = copy;
+    }
+    tileVersion[tileIndex] = ++lastTileVersion;
+    return tile->pixels;
+}
+
 void PixelDisplay::SetPixel(int x, int y, Color color) {
     if (x < 0 || y < 0 || x >= totalWidth || y >= totalHeight) return;
     int col = x / tileWidth, row = y / tileHeight;
@@ -271,10 +240,8 @@ void PixelDisplay::SetPixel(int x, int y, Color color) {
     
     int localX = x % tileWidth;
     int localY = y % tileHeight;
-    Color* p = pixelCache[tileIndex].pixels + localY*tileWidth + localX;
-    if (*p == color) return;
-    *p = color;
-    tileNeedsUpdate[tileIndex] = true;
+    if (tilePixels[tileIndex]->pixels[localY*tileWidth + localX] == color) return;
+    PixelsForWriting(tileIndex)[localY*tileWidth + localX] = color;
 }
 
 void PixelDisplay::SetPixelRun(int x0, int x1, int y, Color color) {
@@ -287,9 +254,8 @@ void PixelDisplay::SetPixelRun(int x0, int x1, int y, Color color) {
         int tileIndex = row * tileCols + col;
         int localX = x % tileWidth;
         if (EnsureTextureInUse(tileIndex, color)) {
-            Color* p = pixelCache[tileIndex].pixels + localY*tileWidth + localX;
+            Color* p = PixelsForWriting(tileIndex) + localY*tileWidth + localX;
             for (; x < endX; x++) *p++ = color;
-            tileNeedsUpdate[tileIndex] = true;
         }
         col++;
         x = col * tileWidth;
@@ -3,8 +3,8 @@
 //  soda
 //
 //	This is the actual Display class that represents a pixel display.  It
-//	wraps a PixelSurface (which is a more low-level thing that manages an
-//	array of SDL textures).
+//	keeps the pixels in tiles, each either a solid color or (when in use)
+//	a TilePixels buffer; the render thread turns those into textures.
 //
 //	ToDo: consider whether this wrapper is actually contributing anything
 //	worthwhile.  Maybe PixelDisplay and PixelSurface should be combined into
@@ -17,26 +17,21 @@
 #include "SimpleVector.h"
 #include "Vector2.h"
 
-struct SDL_Renderer;
-
 namespace SdlGlue {
 
-void SetupPixelDisplay(SDL_Renderer* renderer);
+void SetupPixelDisplay();
 void ShutdownPixelDisplay();
-void RenderPixelDisplay();
-
-struct CachedPixels {
-    Color* pixels;
-};
 
 class PointInPolyPrecalc;
+class TilePixels;
+struct Scene;
 
 class PixelDisplay {
 public:
     PixelDisplay();
     ~PixelDisplay();
     void Clear(Color color=Color(0,0,0,0));
-    void Render();
+    void Capture(Scene *scene);		// add our current tiles to the given scene
     
     int Height() { return totalHeight; }
     int Width() { return totalWidth; }
@@ -62,16 +57,16 @@ private:
     int tileRows;
     int tileCols;
     
-    SDL_Texture* *tileTex;
     bool *textureInUse;
     Color *tileColor;
-    bool *tileNeedsUpdate;
-    CachedPixels *pixelCache;
+    TilePixels* *tilePixels;		// (may be shared with scenes; see PixelsForWriting)
+    unsigned long *tileVersion;		// bumped whenever a tile's pixels change
     
     void AllocArrays();
     void DeallocArrays();
     bool EnsureTextureInUse(int tileIndex, Color unlessColor);
     void EnsureTextureInUse(int tileIndex);
+    Color *PixelsForWriting(int tileIndex);
     void SetPixelRun(int x0, int x1, int y, Color color);
 	void DrawThinLine(int x1, int y1, int x2, int y2, Color color);
     bool TileRangeWithin(SDL_Rect *rect, int* tileCol0, int* tileCol1, int* tileRow0, int* tileRow1);
@@ -0,0 +1,355 @@
+//
+//  SceneRenderer.cpp
+//  soda
+//
+//	See SceneRenderer.h.  Everything here that touches the SDL_Renderer (or
+//	textures made with it) runs on the render thread, or, when not threaded,
+//	on the main thread within SubmitScene.
+//
+
+#include "SceneRenderer.h"
+#include "SdlUtils.h"
+#include "FrameStats.h"
+#include "compiledData/ScreenFont_png.h"
+
+using namespace MiniScript;
+
+namespace SdlGlue {
+
+// Scenes, and which is which.  Swapping these indices is guarded by sceneLock.
+static Scene scenes[3];
+static int writingIdx = 0, readyIdx = 1, renderingIdx = 2;
+static bool sceneReady = false;			// true when scenes[readyIdx] is new
+static bool stopping = false;			// true when the render thread should exit
+static SDL_mutex *sceneLock = nullptr;
+static SDL_cond *sceneReadyCond = nullptr;		// signaled when a scene is submitted
+static SDL_cond *scenePickedUpCond = nullptr;	// signaled when the render thread takes one
+static SDL_Thread *renderThread = nullptr;
+static SimpleVector<SDL_Texture*> texturesToRelease;	// (also guarded by sceneLock)
+
+// Render-thread data.
+static SDL_Window *window = nullptr;
+static SDL_Renderer *renderer = nullptr;
+static SDL_Surface *offscreen = nullptr;		// target surface, for the offscreen renderer
+static int offscreenWidth = 0, offscreenHeight = 0;
+static bool useVsync = true;
+static SDL_Texture *screenFontTexture = nullptr;
+static SimpleVector<SDL_Texture*> tileTextures;
+static SimpleVector<unsigned long> tileVersions;	// version of the pixels in each tile texture
+static int tileTexWidth = 0, tileTexHeight = 0;
+
+// forward declarations of private methods:
+static void Start(bool threaded);
+static int RenderThread(void *unused);
+static void SetupRenderer();
+static void ShutdownRenderer();
+static void DrawScene(const Scene& scene);
+static void DrawSprites(const Scene& scene);
+static void DrawTiles(const Scene& scene);
+static void DrawText(const SimpleVector<TextDraw>& text, int windowHeight);
+static void DrawOverlay(const Scene& scene);
+static void DestroyReleasedTextures();
+static void SaveFrame(const char *path);
+
+//--------------------------------------------------------------------------------
+// Public method implementations
+//--------------------------------------------------------------------------------
+
+RenderImage::~RenderImage() {
+	SDL_FreeSurface(surface);	surface = NULL;
+	ReleaseTexture(texture);	texture = NULL;
+}
+
+void Scene::Clear() {
+	VecIterate(i, sprites) sprites[i].image->release();
+	sprites.deleteAll();
+	VecIterate(i, tiles) if (tiles[i].pixels) tiles[i].pixels->release();
+	tiles.deleteAll();
+	text.deleteAll();
+	overlayRects.deleteAll();
+	overlayText.deleteAll();
+	savePath = String();
+}
+
+void StartRenderer(SDL_Window *inWindow, bool threaded, bool vsync) {
+	window = inWindow;
+	useVsync = vsync;
+	offscreenWidth = offscreenHeight = 0;
+	Start(threaded);
+}
+
+void StartOffscreenRenderer(int width, int height, bool threaded) {
+	window = nullptr;
+	useVsync = false;
+	offscreenWidth = width;
+	offscreenHeight = height;
+	Start(threaded);
+}
+
+static void Start(bool threaded) {
+	stopping = false;
+	sceneReady = false;
+	if (!threaded) {
+		SetupRenderer();
+		return;
+	}
+	sceneLock = SDL_CreateMutex();
+	sceneReadyCond = SDL_CreateCond();
+	scenePickedUpCond = SDL_CreateCond();
+	renderThread = SDL_CreateThread(RenderThread, "RenderThread", nullptr);
+	SdlAssertNotNull(renderThread);
+}
+
+void StopRenderer() {
+	if (renderThread) {
+		SDL_LockMutex(sceneLock);
+		stopping = true;
+		SDL_CondSignal(sceneReadyCond);
+		SDL_UnlockMutex(sceneLock);
+		SDL_WaitThread(renderThread, NULL);
+		renderThread = nullptr;
+		SDL_DestroyCond(sceneReadyCond);		sceneReadyCond = nullptr;
+		SDL_DestroyCond(scenePickedUpCond);		scenePickedUpCond = nullptr;
+		SDL_DestroyMutex(sceneLock);			sceneLock = nullptr;
+	} else {
+		ShutdownRenderer();
+	}
+	for (int i=0; i<3; i++) scenes[i].Clear();
+}
+
+Scene *BeginScene() {
+	// (The render thread never looks at the scene being written, so this is safe.)
+	Scene *scene = &scenes[writingIdx];
+	scene->Clear();
+	return scene;
+}
+
+void SubmitScene() {
+	if (!renderThread) {
+		if (renderer) DrawScene(scenes[writingIdx]);
+		return;
+	}
+	SDL_LockMutex(sceneLock);
+	while (sceneReady and !stopping) SDL_CondWait(scenePickedUpCond, sceneLock);
+	int temp = readyIdx; readyIdx = writingIdx; writingIdx = temp;
+	sceneReady = true;
+	SDL_CondSignal(sceneReadyCond);
+	SDL_UnlockMutex(sceneLock);
+}
+
+void ReleaseTexture(SDL_Texture *texture) {
+	if (texture == nullptr) return;
+	if (renderThread) {
+		SDL_LockMutex(sceneLock);
+		texturesToRelease.push_back(texture);
+		SDL_UnlockMutex(sceneLock);
+	} else if (renderer) {
+		SDL_DestroyTexture(texture);
+	}
+	// (If there's no renderer, it's been destroyed, along with all its textures.)
+}
+
+//--------------------------------------------------------------------------------
+// Private method implementations
+//--------------------------------------------------------------------------------
+
+static int RenderThread(void *unused) {
+	SetupRenderer();
+	while (true) {
+		SDL_LockMutex(sceneLock);
+		while (!sceneReady and !stopping) SDL_CondWait(sceneReadyCond, sceneLock);
+		if (stopping) {
+			SDL_UnlockMutex(sceneLock);
+			break;
+		}
+		int temp = renderingIdx; renderingIdx = readyIdx; readyIdx = temp;
+		sceneReady = false;
+		SDL_CondSignal(scenePickedUpCond);
+		SDL_UnlockMutex(sceneLock);
+
+		DestroyReleasedTextures();
+		if (renderer) DrawScene(scenes[renderingIdx]);
+	}
+	DestroyReleasedTextures();
+	ShutdownRenderer();
+	return 0;
+}
+
+static void SetupRenderer() {
+	if (window) {
+		// Create renderer (hardware-accelerated and, unless uncapped, vsync'd) for the window
+		Uint32 flags = SDL_RENDERER_ACCELERATED;
+		if (useVsync) flags |= SDL_RENDERER_PRESENTVSYNC;
+		renderer = SDL_CreateRenderer(window, -1, flags);
+	} else {
+		// Create a software renderer that draws into our offscreen surface
+		offscreen = SDL_CreateRGBSurfaceWithFormat(0, offscreenWidth, offscreenHeight, 32, SDL_PIXELFORMAT_RGBA32);
+		SdlAssertNotNull(offscreen);
+		if (!offscreen) return;
+		renderer = SDL_CreateSoftwareRenderer(offscreen);
+	}
+	SdlAssertNotNull(renderer);
+	if (!renderer) return;
+
+	SDL_RWops *stream = SDL_RWFromConstMem(ScreenFont_png, ScreenFont_png_len);
+	SdlAssertNotNull(stream);
+	SDL_Surface *surf = IMG_Load_RW(stream, 1);
+	SdlAssertNotNull(surf);
+	screenFontTexture = SDL_CreateTextureFromSurface(renderer, surf);
+	SdlAssertNotNull(screenFontTexture);
+	SDL_SetTextureBlendMode(screenFontTexture, SDL_BLENDMODE_BLEND);
+	SDL_FreeSurface(surf);
+}
+
+static void ShutdownRenderer() {
+	VecIterate(i, tileTextures) SDL_DestroyTexture(tileTextures[i]);
+	tileTextures.deleteAll();
+	tileVersions.deleteAll();
+	SDL_DestroyTexture(screenFontTexture); screenFontTexture = nullptr;
+	// (This destroys any image textures still around, too.)
+	SDL_DestroyRenderer(renderer); renderer = nullptr;
+	SDL_FreeSurface(offscreen); offscreen = nullptr;
+}
+
+static void DestroyReleasedTextures() {
+	SDL_LockMutex(sceneLock);
+	VecIterate(i, texturesToRelease) SDL_DestroyTexture(texturesToRelease[i]);
+	texturesToRelease.deleteAll();
+	SDL_UnlockMutex(sceneLock);
+}
+
+static void DrawScene(const Scene& scene) {
+	Color c = scene.backColor;
+	SDL_SetRenderDrawColor(renderer, c.r, c.g, c.b, c.a);
+	SDL_RenderClear(renderer);
+	{ StageTimer timer(stageSprites); DrawSprites(scene); }
+	{ StageTimer timer(stageTiles); DrawTiles(scene); }
+	{ StageTimer timer(stageText); DrawText(scene.text, scene.windowHeight); }
+	DrawOverlay(scene);
+	if (!scene.savePath.empty()) SaveFrame(scene.savePath.c_str());
+	StageTimer timer(stagePresent);
+	SDL_RenderPresent(renderer);
+}
+
+static void SaveFrame(const char *path) {
+	// The offscreen renderer has drawn right into our surface; otherwise,
+	// read the pixels back from the renderer.
+	SDL_Surface *surf = offscreen;
+	if (surf == nullptr) {
+		int w, h;
+		SDL_GetRendererOutputSize(renderer, &w, &h);
+		surf = SDL_CreateRGBSurfaceWithFormat(0, w, h, 32, SDL_PIXELFORMAT_RGBA32);
+		if (surf == nullptr) return;
+		SDL_RenderReadPixels(renderer, NULL, SDL_PIXELFORMAT_RGBA32, surf->pixels, surf->pitch);
+	}
+	if (IMG_SavePNG(surf, path) != 0) {
+		printf("Couldn't save frame to %s: %s\n", path, IMG_GetError());
+	}
+	if (surf != offscreen) SDL_FreeSurface(surf);
+}
+
+static void DrawSprites(const Scene& scene) {
+	VecIterate(i, scene.sprites) {
+		const SpriteDraw& sprite = scene.sprites[i];
+		RenderImage *image = sprite.image;
+		if (image->texture == nullptr) {
+			SDL_Surface *surf = image->surface;
+			image->texture = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_RGBA32, SDL_TEXTUREACCESS_STATIC, surf->w, surf->h);
+			if (image->texture == nullptr) continue;
+			SDL_UpdateTexture(image->texture, NULL, surf->pixels, surf->pitch);
+			SDL_SetTextureBlendMode(image->texture, SDL_BLENDMODE_BLEND);
+			SDL_SetTextureScaleMode(image->texture, SDL_ScaleModeNearest);
+		}
+		SDL_Rect destRect = { sprite.left, sprite.top, sprite.width, sprite.height };
+		Color c = sprite.tint;
+		SDL_SetTextureColorMod(image->texture, c.r, c.g, c.b);
+		SDL_SetTextureAlphaMod(image->texture, c.a);
+		SDL_RenderCopyEx(renderer, image->texture, NULL, &destRect, -sprite.rotation, NULL, SDL_FLIP_NONE);
+	}
+}
+
+static void DrawTiles(const Scene& scene) {
+	int qtyTiles = scene.tileCols * scene.tileRows;
+	if (scene.tileWidth != tileTexWidth or scene.tileHeight != tileTexHeight or qtyTiles != tileTextures.size()) {
+		// (Re)make our tile textures to match the pixel display.
+		VecIterate(i, tileTextures) SDL_DestroyTexture(tileTextures[i]);
+		tileTextures.deleteAll();
+		tileVersions.deleteAll();
+		for (int i=0; i<qtyTiles; i++) {
+			SDL_Texture *tex = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_RGBA32, SDL_TEXTUREACCESS_STREAMING,
+				scene.tileWidth, scene.tileHeight);
+			SDL_SetTextureBlendMode(tex, SDL_BLENDMODE_BLEND);
+			tileTextures.push_back(tex);
+			tileVersions.push_back(0);
+		}
+		tileTexWidth = scene.tileWidth;
+		tileTexHeight = scene.tileHeight;
+	}
+
+	int tileWidth = scene.tileWidth, tileHeight = scene.tileHeight;
+	int windowHeight = scene.tileRows * tileHeight;
+	int i = 0;
+	for (int row=0; row < scene.tileRows; row++) {
+		int yPos = windowHeight - (row + 1) * tileHeight;
+		for (int col=0; col < scene.tileCols; col++, i++) {
+			const TileDraw& tile = scene.tiles[i];
+			SDL_Rect destRect = { col*tileWidth, yPos, tileWidth, tileHeight };
+			if (tile.pixels) {
+				if (tileVersions[i] != tile.version) {
+					void* pixels;
+					int pitch;
+					int err = SDL_LockTexture(tileTextures[i], NULL, &pixels, &pitch);
+					if (err) {
+						printf("Error in SDL_LockTexture: %s\n", SDL_GetError());
+						continue;
+					}
+					// (tile pixels are stored bottom row first)
+					Color* srcP = tile.pixels->pixels + (tileHeight - 1) * tileWidth;
+					Uint8* destP = (Uint8*)pixels;
+					int bytesToCopy = tileWidth * 4;
+					for (int y = 0; y < tileHeight; y++) {
+						memcpy(destP, srcP, bytesToCopy);
+						srcP -= tileWidth;
+						destP += pitch;
+					}
+					SDL_UnlockTexture(tileTextures[i]);
+					tileVersions[i] = tile.version;
+				}
+				SDL_RenderCopy(renderer, tileTextures[i], NULL, &destRect);
+			} else if (tile.color.a > 0) {
+				SDL_SetRenderDrawColor(renderer, tile.color.r, tile.color.g, tile.color.b, tile.color.a);
+				SDL_RenderFillRect(renderer, &destRect);
+			}
+		}
+	}
+}
+
+static void DrawText(const SimpleVector<TextDraw>& text, int windowHeight) {
+	const int srcCellWidth = 16;
+	const int srcCellHeight = 24;
+	const int destCellWidth = 14;
+	const int destCellHeight = 22;
+	VecIterate(i, text) {
+		const TextDraw& cell = text[i];
+		SDL_SetTextureColorMod(screenFontTexture, cell.color.r, cell.color.g, cell.color.b);
+		SDL_SetTextureAlphaMod(screenFontTexture, cell.color.a);
+		SDL_Rect srcRect = { (cell.character%16) * srcCellWidth, (cell.character/16) * srcCellHeight, srcCellWidth, srcCellHeight };
+		SDL_Rect destRect = { cell.column * destCellWidth, windowHeight - (cell.row+1) * destCellHeight, srcCellWidth, srcCellHeight };
+		SDL_RenderCopyEx(renderer, screenFontTexture, &srcRect, &destRect, 0, NULL, SDL_FLIP_NONE);
+	}
+}
+
+static void DrawOverlay(const Scene& scene) {
+	if (scene.overlayRects.empty() and scene.overlayText.empty()) return;
+	SDL_SetRenderDrawBlendMode(renderer, SDL_BLENDMODE_BLEND);
+	VecIterate(i, scene.overlayRects) {
+		const RectDraw& r = scene.overlayRects[i];
+		SDL_SetRenderDrawColor(renderer, r.color.r, r.color.g, r.color.b, r.color.a);
+		SDL_Rect rect = { r.left, r.top, r.width, r.height };
+		SDL_RenderFillRect(renderer, &rect);
+	}
+	SDL_SetRenderDrawBlendMode(renderer, SDL_BLENDMODE_NONE);
+	DrawText(scene.overlayText, scene.windowHeight);
+}
+
+}	// end of namespace SdlGlue
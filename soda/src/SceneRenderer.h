@@ -0,0 +1,112 @@
+//
+//  SceneRenderer.h
+//  soda
+//
+//	This module does all the actual drawing.  At the end of each frame, the
+//	main thread captures what's on screen (sprites, pixel display, text) into
+//	a Scene: a snapshot that refers only to data that won't change.  The
+//	scene is then drawn on a separate render thread, while the main thread
+//	goes on to run the script for the next frame.  We keep three scenes: one
+//	being filled in, one being drawn, and one ready to draw next.
+//
+//	Reference counts are not thread-safe, so only the main thread retains or
+//	releases anything; the render thread just reads the scene it's drawing.
+//
+
+#ifndef SCENERENDERER_H
+#define SCENERENDERER_H
+
+#include "Color.h"
+#include "SimpleVector.h"
+#include "SimpleString.h"
+#include "RefCountedStorage.h"
+
+struct SDL_Window;
+struct SDL_Texture;
+struct SDL_Surface;
+
+namespace SdlGlue {
+
+// The pixels of an Image, and the texture made from them (by the render
+// thread, on first use).  Once a scene refers to a RenderImage, it must not
+// change; so anything that draws into an image copies it first if shared.
+class RenderImage : public MiniScript::RefCountedStorage {
+public:
+	RenderImage(SDL_Surface *surf) : surface(surf), texture(nullptr) {}
+	virtual ~RenderImage();
+
+	SDL_Surface *surface;	// always 32-bit RGBA (see NewImageFromSurface)
+	SDL_Texture *texture;	// (used only by the render thread)
+};
+
+// The pixels of one tile of a PixelDisplay.  Like RenderImage, this is copied
+// before writing if any scene refers to it.
+class TilePixels : public MiniScript::RefCountedStorage {
+public:
+	TilePixels(int count) : pixels(new Color[count]) {}
+	virtual ~TilePixels() { delete[] pixels; }
+
+	Color *pixels;
+};
+
+struct SpriteDraw {
+	RenderImage *image;		// (retained)
+	int left, top, width, height;
+	float rotation;
+	Color tint;
+};
+
+struct TileDraw {
+	TilePixels *pixels;		// (retained), or null for a solid-color tile
+	unsigned long version;	// changes whenever the tile's pixels do
+	Color color;			// color of a solid tile
+};
+
+struct TextDraw {
+	int row, column;
+	Uint8 character;
+	Color color;
+};
+
+struct RectDraw {
+	int left, top, width, height;
+	Color color;
+};
+
+struct Scene {
+	int windowHeight;
+	Color backColor;
+	SimpleVector<SpriteDraw> sprites;
+	int tileCols, tileRows, tileWidth, tileHeight;
+	SimpleVector<TileDraw> tiles;
+	SimpleVector<TextDraw> text;
+	SimpleVector<RectDraw> overlayRects;	// drawn on top of everything else...
+	SimpleVector<TextDraw> overlayText;		// ...and then this
+	MiniScript::String savePath;	// if not empty, save the drawn frame to this PNG file
+
+	Scene() : windowHeight(0), tileCols(0), tileRows(0), tileWidth(0), tileHeight(0) {}
+	void Clear();		// release everything (main thread only)
+};
+
+// Start drawing to the given window, on a render thread if threaded is true
+// (otherwise, SubmitScene draws the scene itself).
+void StartRenderer(SDL_Window *window, bool threaded, bool vsync);
+
+// Or, draw with the software renderer into an offscreen surface of the given
+// size (for headless mode).  This never waits for vsync.
+void StartOffscreenRenderer(int width, int height, bool threaded);
+
+void StopRenderer();
+
+// Get the scene to fill in for this frame (cleared out), then submit it to
+// be drawn.  If the previous scene hasn't been picked up by the render thread
+// yet, SubmitScene waits for it; so the main thread stays at most one frame ahead.
+Scene *BeginScene();
+void SubmitScene();
+
+// Destroy a texture made by the render thread, once it's safe to do so.
+void ReleaseTexture(SDL_Texture *texture);
+
+}
+
+#endif // SCENERENDERER_H
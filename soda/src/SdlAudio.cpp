@@ -9,6 +9,7 @@
 #include "SdlUtils.h"
 #include "SdlGlue.h"
 #include "SdlAudio.h"
+#include "FrameStats.h"
 #include <SDL2/SDL_mixer.h>
 #include <stdlib.h>
 #include "SodaIntrinsics.h"
@@ -193,6 +194,8 @@ void StopAllSounds() {
 //--------------------------------------------------------------------------------
 
 static void AudioCallback(void *userdata, Uint8 *buffer, int bufferSize) {
+	StageTimer timer(stageAudio);
+	
 	// Here we mix and generate some samples for the buffer!
 	SDL_memset(buffer, 0, bufferSize);
 	float *samples = (float*)buffer;
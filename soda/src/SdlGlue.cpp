@@ -16,6 +16,11 @@
 #include "TextDisplay.h"
 #include "PixelDisplay.h"
 #include "Sprite.h"
+#include "FrameStats.h"
+#include "InputLog.h"
+#include "SpscRing.h"
+#include "Worker.h"
+#include "SceneRenderer.h"
 
 using namespace MiniScript;
 
@@ -23,39 +28,89 @@ namespace SdlGlue {
 
 // public data
 bool quit;
+bool uncapped = false;
+#if defined(__APPLE__)
+bool renderThreaded = false;	// (macOS wants all rendering on the main thread)
+#else
+bool renderThreaded = true;
+#endif
+bool headless = false;
+SimpleVector<long> framesToDump;
+String frameDumpPrefix = "frame";
+long maxFrames = 0;
+String frameStatsPath;
+String inputRecordPath;
+String inputReplayPath;
 Value magicHandle("_handle");
 
 
 // private data
 static SDL_Window *mainWindow;
-static SDL_Renderer *mainRenderer;
 static int windowWidth = 960;
 static int windowHeight = 640;
 static bool isFullScreen = false;
 static Color backgroundColor = Color::black;//{0, 0, 100, 255};
 static Dictionary<String, Sint32, hashString> keyNameMap;	// maps Soda key names to SDL key codes
-static Dictionary<Sint32, bool, hashInt> keyDownMap;	// makes SDL key codes to whether they are currently down
+static KeyDownMap keyDownMap;	// maps SDL key codes to whether they are currently down
 static SimpleVector<SDL_GameController*> gameControllers;
+static MouseState mouse;								// mouse state as of this frame
+static SimpleVector<ControllerState> controllers;		// state of each of gameControllers, as of this frame
+static SpscRing<std::string, 256> keyQueue;				// events waiting for key.get (filled and drained on the main thread)
+
+// frame pacing
+static Uint64 startCounter;				// performance counter at Setup
+static long frameCount = 0;				// frames submitted so far
+static double frameTime = 0;			// when the current frame was presented
+static double deltaTime = 0;			// time between the last two presents
+static double frameInterval = 1.0/60;	// display refresh interval
+static double renderTime = 0;			// recent average time Service takes before submitting a scene
+static double fixedTimestep = 0;		// if > 0, the script's clock advances this much per frame
+
+// fixed-timestep updates
+static Value updateFunc;				// function to call each step (null if not in fixed-update mode)
+static double updateStep = 0;			// seconds per step
+static double simTime = 0;				// clock time simulated so far
+static long stepCount = 0;				// steps begun so far
+static const double maxCatchUp = 0.1;	// seconds of steps we'll run at once to catch up (the rest are dropped)
+static const double minScriptTime = 0.001;	// script time per frame, even when we're behind
 
 // forward declarations of private methods:
 static int RoundToInt(double d);
-static void DrawSprites();
+static double Now();
+static double Clock();
+static void HandleEvents();
+static void CaptureScene();
+static void SampleInput();
+static void QueueKeyEvent(const std::string& event);
+static void QueueKeyDown(Sint32 keyCode);
+static void QueueText(const char *text);
+static int ControllerIndex(SDL_JoystickID instanceID);
+static void CaptureSprites(Scene *scene);
 static void SetupKeyNameMap();
 static Value NewImageFromSurface(SDL_Surface *surf);
-static double GetControllerAxis(SDL_GameController* controller, SDL_GameControllerAxis axis);
+static double GetControllerAxis(const ControllerState& controller, SDL_GameControllerAxis axis);
 void HandleWindowSizeChange(int newWidth, int newHeight);
 
 class TextureStorage : public RefCountedStorage {
 public:
-	TextureStorage(SDL_Surface *surf) : surface(surf), texture(nullptr) {}
+	TextureStorage(SDL_Surface *surf) : image(new RenderImage(surf)) {}
 	
 	virtual ~TextureStorage() {
-		SDL_FreeSurface(surface);		surface = NULL;
-		SDL_DestroyTexture(texture);	texture = NULL;
+		image->release();	image = NULL;
 	}
 	
-	SDL_Surface *surface;		// pixel buffer -- always valid
-	SDL_Texture *texture;		// texture for rendering: may be null until we render
+	// Get our image ready to change.  If a scene refers to it, it must
+	// not change under the render thread; so in that case, make a copy.
+	RenderImage *ImageForWriting() {
+		if (image->RefCount() > 1) {
+			RenderImage *copy = new RenderImage(SDL_DuplicateSurface(image->surface));
+			image->release();
+			image = copy;
+		}
+		return image;
+	}
+	
+	RenderImage *image;		// pixel buffer (and texture, once rendered) -- always valid
 };
 
 //--------------------------------------------------------------------------------
@@ -64,7 +119,17 @@ public:
 
 // Initialize SDL and get everything ready to go.
 void Setup() {
-	int init = SDL_Init(SDL_INIT_VIDEO | SDL_INIT_JOYSTICK | SDL_INIT_GAMECONTROLLER | SDL_INIT_AUDIO);
+	Uint32 subsystems = SDL_INIT_VIDEO | SDL_INIT_AUDIO;
+	if (headless) {
+		// Use the dummy video and audio drivers (unless the environment says otherwise),
+		// and don't bother with game controllers.  There's no vsync to wait for.
+		SDL_setenv("SDL_VIDEODRIVER", "dummy", 0);
+		SDL_setenv("SDL_AUDIODRIVER", "dummy", 0);
+		uncapped = true;
+	} else {
+		subsystems |= SDL_INIT_JOYSTICK | SDL_INIT_GAMECONTROLLER;
+	}
+	int init = SDL_Init(subsystems);
 	SdlAssertOK(init);
 	if (init < 0) return;
 	
@@ -78,28 +143,53 @@ void Setup() {
 		printf( "SDL_image could not initialize! SDL_image Error: %s\n", IMG_GetError());
 	}
 
-	mainWindow = SDL_CreateWindow( "Soda", SDL_WINDOWPOS_UNDEFINED, SDL_WINDOWPOS_UNDEFINED, windowWidth, windowHeight, SDL_WINDOW_SHOWN );
+	// (In headless mode, we still make a window, so that window size and such
+	// work as usual; but we draw offscreen, at the window's initial size.)
+	Uint32 windowFlags = headless ? SDL_WINDOW_HIDDEN : SDL_WINDOW_SHOWN;
+	mainWindow = SDL_CreateWindow( "Soda", SDL_WINDOWPOS_UNDEFINED, SDL_WINDOWPOS_UNDEFINED, windowWidth, windowHeight, windowFlags );
 	SdlAssertNotNull(mainWindow);
 
-	// Create renderer (hardware-accelerated and vsync'd) for the window
-	mainRenderer = SDL_CreateRenderer(mainWindow, -1, SDL_RENDERER_ACCELERATED | SDL_RENDERER_PRESENTVSYNC);
-	SdlAssertNotNull(mainRenderer);
+	// Start drawing to the window (on the render thread, unless told otherwise)
+	if (headless) StartOffscreenRenderer(windowWidth, windowHeight, renderThreaded);
+	else StartRenderer(mainWindow, renderThreaded, !uncapped);
+	
+	// Find out how often the display refreshes, for frame pacing
+	SDL_DisplayMode mode;
+	if (SDL_GetCurrentDisplayMode(SDL_GetWindowDisplayIndex(mainWindow), &mode) == 0 and mode.refresh_rate > 0) {
+		frameInterval = 1.0 / mode.refresh_rate;
+	}
+	startCounter = SDL_GetPerformanceCounter();
+	frameTime = deltaTime = 0;
+	frameCount = 0;
+	quit = false;
+	
+	// Record or replay input, if asked; either way, run the script on a fixed timestep.
+	fixedTimestep = 0;
+	updateFunc = Value::null;
+	if (!inputReplayPath.empty()) {
+		if (!StartReplay(inputReplayPath, &fixedTimestep)) quit = true;
+	} else if (!inputRecordPath.empty()) {
+		if (StartRecording(inputRecordPath, frameInterval)) fixedTimestep = frameInterval;
+	}
 	
 	SetupKeyNameMap();
+	ClearKeyBuffer();
 	for (int i=0; i<SDL_NumJoysticks(); i++) {
 		gameControllers.push_back(SDL_GameControllerOpen(i));
 		if (gameControllers[i] != nullptr) printf("Opened controller %d\n", i);
 	}
 	
+	StartFrameStats(frameStatsPath);
 	SetupAudio();
-	SetupTextDisplay(mainRenderer);
-	SetupPixelDisplay(mainRenderer);
+	SetupTextDisplay();
+	SetupPixelDisplay();
 }
 
 
 // Clean up and shut down SDL for program exit.
 void Shutdown() {
-	SDL_DestroyRenderer(mainRenderer); mainRenderer = NULL;
+	StopAllWorkers();
+	StopRenderer();
 	SDL_DestroyWindow(mainWindow); mainWindow = NULL;
 	IMG_Quit();
 	ShutdownAudio();
@@ -107,44 +197,101 @@ void Shutdown() {
 	ShutdownPixelDisplay();
 	VecIterate(i, gameControllers) SDL_GameControllerClose(gameControllers[i]);
 	gameControllers.deleteAll();
+	StopInputLog();
+	StopFrameStats();
+	updateFunc = Value::null;
 	SDL_Quit();
 }
 
 
 // Pump events and otherwise service whatever's going on in SDL land.
 void Service() {
-	// Handle events
-	SDL_Event e;
-	while (SDL_PollEvent(&e) != 0) {
-		if (e.type == SDL_QUIT) quit = true;
-		else if (e.type == SDL_KEYDOWN) {
-			Sint32 keyCode = e.key.keysym.sym;
-			if (keyCode == SDLK_KP_PERIOD) keyCode = SDLK_KP_DECIMAL;	// (normalize this inconsistency)
-			keyDownMap.SetValue(keyCode, true);
-		} else if (e.type == SDL_KEYUP) {
-			Sint32 keyCode = e.key.keysym.sym;
-			if (keyCode == SDLK_KP_PERIOD) keyCode = SDLK_KP_DECIMAL;	// (normalize this inconsistency)
-			keyDownMap.SetValue(keyCode, false);
-		} else if (e.type == SDL_WINDOWEVENT) {
-			if (e.window.event == SDL_WINDOWEVENT_RESIZED || e.window.event == SDL_WINDOWEVENT_SIZE_CHANGED) {
-				HandleWindowSizeChange(e.window.data1, e.window.data2);
-			}
-		}
-	}
+	double serviceStart = Now();
+	HandleEvents();
+	CaptureScene();
 	
-	// Update mouse position
-	// (we store mouse x and y as values, rather than functions, so they can be used
-	// in any context that needs an XY map, such as Bounds.contains)
-	mouseModule.SetValue(xStr, Value(GetMouseX()));
-	mouseModule.SetValue(yStr, Value(GetMouseY()));
+	// Note the time after submitting (which waits until the render thread
+	// is ready for it, or, when not threaded, for vsync unless uncapped)
+	double t = Now();
+	renderTime = renderTime * 0.9 + (t - serviceStart) * 0.1;
+	{
+		StageTimer timer(stageSubmit);
+		SubmitScene();
+	}
+	t = Now();
+	deltaTime = t - frameTime;
+	frameTime = t;
+	EndFrameStats(frameCount, frameTime, deltaTime);
+	if (maxFrames > 0 and frameCount >= maxFrames) quit = true;
+}
 
-	// Update screen
-	SDL_SetRenderDrawColor(mainRenderer, backgroundColor.r, backgroundColor.g, backgroundColor.b, backgroundColor.a);
-	SDL_RenderClear(mainRenderer);
-	DrawSprites();
-	mainPixelDisplay->Render();
-	RenderTextDisplay();
-	SDL_RenderPresent(mainRenderer);
+double FrameTime() {
+	if (!updateFunc.IsNull()) return simTime;
+	return Clock();
+}
+
+double DeltaTime() {
+	if (!updateFunc.IsNull()) return updateStep;
+	if (fixedTimestep > 0) return fixedTimestep;
+	return deltaTime;
+}
+
+void SetFixedUpdate(Value func, double rate) {
+	if (updateFunc.IsNull()) {
+		simTime = Clock();
+		stepCount = 0;
+	}
+	updateFunc = func;
+	updateStep = 1.0 / rate;
+}
+
+Value FixedUpdateFunc() {
+	return updateFunc;
+}
+
+int FixedStepsDue() {
+	double behind = Clock() - simTime;
+	if (behind > maxCatchUp) {
+		// We've fallen too far behind to catch up; let the game slow down instead.
+		simTime += behind - maxCatchUp;
+		behind = maxCatchUp;
+	}
+	return (int)(behind / updateStep);
+}
+
+void BeginFixedStep() {
+	// Note where each sprite is before the step, so we can draw it in between.
+	stepCount++;
+	ValueList sprites = spriteList.GetList();
+	for (long i=0; i<sprites.Count(); i++) {
+		if (sprites[i].type != ValueType::Map) continue;
+		SpriteHandleData *data = GetSpriteHandleData(sprites[i]);
+		data->prevX = data->x;
+		data->prevY = data->y;
+		data->prevScaleX = data->scaleX;
+		data->prevScaleY = data->scaleY;
+		data->prevRotation = data->rotation;
+		data->prevStep = stepCount;
+	}
+	simTime += updateStep;
+}
+
+double FrameInterval() {
+	return frameInterval;
+}
+
+long FrameCount() {
+	return frameCount;
+}
+
+double TimeToNextFrame() {
+	// Next vsync is one interval after the last; we need to start rendering
+	// a bit before that (plus a little slack) to make it.  When uncapped,
+	// there's no vsync to make, so just give the script one interval.
+	if (uncapped) return frameInterval;
+	double deadline = frameTime + frameInterval - renderTime * 1.5;
+	double result = deadline - Now();
+	return result > minScriptTime ? result : minScriptTime;
 }
 
 bool IsKeyPressed(String keyName) {
@@ -156,17 +303,16 @@ bool IsKeyPressed(String keyName) {
 		long pos = keyName.LastIndexOfB(" ");
 		int buttonNum = keyName.SubstringB(pos+1).IntValue();
 		if (buttonNum < 0 || buttonNum >= (int)SDL_CONTROLLER_BUTTON_MAX) return false;
+		Uint32 mask = 1u << buttonNum;
 		if (keyName.StartsWith("joystick button ")) { // Check all game controllers!
-			VecIterate(i, gameControllers) {
-				if (SDL_GameControllerGetButton(gameControllers[i], (SDL_GameControllerButton)buttonNum)) return true;
+			VecIterate(i, controllers) {
+				if (controllers[i].buttons & mask) return true;
 			}
 			return false;
 		}
 		int joyNum = keyName.SubstringB(9).IntValue() - 1;
-		if (joyNum < 0 || joyNum >= gameControllers.size()) return 0;
-		SDL_GameController* gc = gameControllers[joyNum];
-		if (gc == nullptr) return 0;
-		return SDL_GameControllerGetButton(gc, (SDL_GameControllerButton)buttonNum);
+		if (joyNum < 0 || joyNum >= controllers.size()) return 0;
+		return (controllers[joyNum].buttons & mask) != 0;
 	}
 	Sint32 keyCode = keyNameMap.Lookup(keyName, 0);
 	if (keyCode == 0) return false;
@@ -174,7 +320,7 @@ bool IsKeyPressed(String keyName) {
 }
 
 bool IsMouseButtonPressed(int buttonNum) {
-	int buttons = SDL_GetMouseState(NULL, NULL);
+	Uint32 buttons = mouse.buttons;
 	switch (buttonNum) {
 		case 0: return (buttons & SDL_BUTTON(SDL_BUTTON_LEFT)) != 0;
 		case 1: return (buttons & SDL_BUTTON(SDL_BUTTON_RIGHT)) != 0;
@@ -185,16 +331,27 @@ bool IsMouseButtonPressed(int buttonNum) {
 	return false;
 }
 
+bool KeyAvailable() {
+	return !keyQueue.Empty();
+}
+
+String GetKey() {
+	std::string event;
+	if (!keyQueue.Pop(&event)) return String();
+	return String(event.c_str());
+}
+
+void ClearKeyBuffer() {
+	std::string discard;
+	while (keyQueue.Pop(&discard)) {}
+}
+
 int GetMouseX() {
-	int x;
-	SDL_GetMouseState(&x, NULL);
-	return x;
+	return mouse.x;
 }
 
 int GetMouseY() {
-	int y;
-	SDL_GetMouseState(NULL, &y);
-	return windowHeight - y;
+	return windowHeight - mouse.y;
 }
 
 double GetAxis(String axisName) {
@@ -218,8 +375,8 @@ double GetAxis(String axisName) {
 		int axisNum = axisName.SubstringB(7).IntValue() - 1;
 		if (axisNum < 0 || axisNum >= (int)SDL_CONTROLLER_AXIS_MAX) return 0;
 		double result = 0;
-		VecIterate(i, gameControllers) {
-			double val = GetControllerAxis(gameControllers[i], (SDL_GameControllerAxis)axisNum);
+		VecIterate(i, controllers) {
+			double val = GetControllerAxis(controllers[i], (SDL_GameControllerAxis)axisNum);
 			if (abs(val) > abs(result)) result = val;
 		}
 		return result;
@@ -227,33 +384,32 @@ double GetAxis(String axisName) {
 	if (axisName.StartsWith("Joy") && axisName.Contains("Axis")) {
 		long p = axisName.IndexOfB("Axis");
 		int joyNum = axisName.SubstringB(3, p-3).IntValue() - 1;
-		if (joyNum < 0 || joyNum >= gameControllers.size()) return 0;
-		SDL_GameController* gc = gameControllers[joyNum];
-		if (gc == nullptr) return 0;
+		if (joyNum < 0 || joyNum >= controllers.size()) return 0;
 
 		int axisNum = axisName.SubstringB(p+4).IntValue() - 1;
 		if (axisNum < 0 || axisNum >= (int)SDL_CONTROLLER_AXIS_MAX) return 0;
 
-		return GetControllerAxis(gc, (SDL_GameControllerAxis)axisNum);
+		return GetControllerAxis(controllers[joyNum], (SDL_GameControllerAxis)axisNum);
 	}
 	return 0;
 }
 
 // Helper method to get a controller axis -- but checking the dpad for LEFTX and LEFTY
 // too, which SDL doesn't naturally do, and applying a small dead zone to analog axes.
-double GetControllerAxis(SDL_GameController* controller, SDL_GameControllerAxis axis) {
-	if (controller == nullptr) return 0;
+static int ButtonDown(const ControllerState& controller, SDL_GameControllerButton button) {
+	return (controller.buttons >> button) & 1;
+}
+
+double GetControllerAxis(const ControllerState& controller, SDL_GameControllerAxis axis) {
 	if (axis == SDL_CONTROLLER_AXIS_LEFTX) {
-	   int dpad = SDL_GameControllerGetButton(controller, SDL_CONTROLLER_BUTTON_DPAD_RIGHT)
-		        - SDL_GameControllerGetButton(controller, SDL_CONTROLLER_BUTTON_DPAD_LEFT);
+	   int dpad = ButtonDown(controller, SDL_CONTROLLER_BUTTON_DPAD_RIGHT) - ButtonDown(controller, SDL_CONTROLLER_BUTTON_DPAD_LEFT);
 	   if (dpad != 0) return dpad;
    }
    if (axis == SDL_CONTROLLER_AXIS_LEFTY) {
-	   int dpad = SDL_GameControllerGetButton(controller, SDL_CONTROLLER_BUTTON_DPAD_UP)
-				- SDL_GameControllerGetButton(controller, SDL_CONTROLLER_BUTTON_DPAD_DOWN);
+	   int dpad = ButtonDown(controller, SDL_CONTROLLER_BUTTON_DPAD_UP) - ButtonDown(controller, SDL_CONTROLLER_BUTTON_DPAD_DOWN);
 	   if (dpad != 0) return dpad;
    }
-	Sint16 value = SDL_GameControllerGetAxis(controller, axis);
+	Sint16 value = controller.axes[axis];
 	if (value > -300 && value < 300) value = 0;	// (minimal dead zone)
 	return value / 32767.0;
 }
@@ -310,6 +466,15 @@ Value NewImageFromSurface(SDL_Surface *surf) {
 	// Create and return a new Image object from the given pixel buffer.
 	if (surf == NULL) return Value::null;
 	
+	// Keep all images in one format, so the render thread can make textures
+	// straight from the pixels (without converting, which touches the surface).
+	if (surf->format->format != SDL_PIXELFORMAT_RGBA32) {
+		SDL_Surface *converted = SDL_ConvertSurfaceFormat(surf, SDL_PIXELFORMAT_RGBA32, 0);
+		SDL_FreeSurface(surf);
+		if (converted == NULL) return Value::null;
+		surf = converted;
+	}
+	
 	ValueDict inst;
 	inst.SetValue(Value::magicIsA, imageClass);
 	inst.SetValue(magicHandle, Value::NewHandle(new TextureStorage(surf)));
@@ -336,11 +501,11 @@ Value GetImagePixel(Value image, int x, int y) {
 	TextureStorage *storage = ((TextureStorage*)(textureH.data.ref));
 	if (storage == nullptr) return Value::null;
 
-	if (x >= storage->surface->w || y >= storage->surface->h) return Value::null;
-	y = storage->surface->h - 1 - y;
+	if (x >= storage->image->surface->w || y >= storage->image->surface->h) return Value::null;
+	y = storage->image->surface->h - 1 - y;
 	
-	int bpp = storage->surface->format->BytesPerPixel;
-	Uint8 *p = (Uint8 *)storage->surface->pixels + y * storage->surface->pitch + x * bpp;
+	int bpp = storage->image->surface->format->BytesPerPixel;
+	Uint8 *p = (Uint8 *)storage->image->surface->pixels + y * storage->image->surface->pitch + x * bpp;
 	Uint32 data = 0;
 	switch (bpp) {
 		case 1:
@@ -363,7 +528,7 @@ Value GetImagePixel(Value image, int x, int y) {
 	}
 
 	Color color;
-	SDL_GetRGBA(data, storage->surface->format, &color.r, &color.g, &color.b, &color.a);
+	SDL_GetRGBA(data, storage->image->surface->format, &color.r, &color.g, &color.b, &color.a);
 	return color.ToString();
 }
 	
@@ -380,14 +545,15 @@ void SetImagePixel(Value image, int x, int y, String colorStr) {
 	TextureStorage *storage = ((TextureStorage*)(textureH.data.ref));
 	if (storage == nullptr) return;
 
-	if (x >= storage->surface->w || y >= storage->surface->h) return;
-	y = storage->surface->h - 1 - y;
+	if (x >= storage->image->surface->w || y >= storage->image->surface->h) return;
+	y = storage->image->surface->h - 1 - y;
 	
 	Color color = ToColor(colorStr);
-	Uint32 data = SDL_MapRGBA(storage->surface->format, color.r, color.g, color.b, color.a);
+	SDL_Surface *surface = storage->ImageForWriting()->surface;
+	Uint32 data = SDL_MapRGBA(surface->format, color.r, color.g, color.b, color.a);
 	
-	int bpp = storage->surface->format->BytesPerPixel;
-	Uint8 *p = (Uint8 *)storage->surface->pixels + y * storage->surface->pitch + x * bpp;
+	int bpp = surface->format->BytesPerPixel;
+	Uint8 *p = (Uint8 *)surface->pixels + y * surface->pitch + x * bpp;
 	switch (bpp) {
 		case 1:
 			*p = (Uint8)data;
@@ -414,9 +580,6 @@ void SetImagePixel(Value image, int x, int y, String colorStr) {
 			*(Uint32 *)p = data;
 			break;
 	}
-	
-	// clear the texture associated with this image, if any, so it will get recreated on next use
-	SDL_DestroyTexture(storage->texture); storage->texture = nullptr;
 }
 
 Value GetSubImage(Value image, int left, int bottom, int width, int height) {
@@ -435,16 +598,16 @@ Value GetSubImage(Value image, int left, int bottom, int width, int height) {
 	// Start by creating a surface of the appropriate size.
 	SDL_Surface *newSurf = SDL_CreateRGBSurfaceWithFormat(0,
 		  width, height,
-		  SDL_BITSPERPIXEL(storage->surface->format->format),
-		  storage->surface->format->format);
+		  SDL_BITSPERPIXEL(storage->image->surface->format->format),
+		  storage->image->surface->format->format);
 	if (newSurf == nullptr) {
 		printf("GetSubImage: couldn't create sub-surface: %s\n", SDL_GetError());
 		return Value::null;
 	}
 	
 	// Then, copy the pixel data out of this one into that one.
-	SDL_Rect srcRect = {left, storage->surface->h - bottom - height, width, height};
-	SDL_BlitSurface(storage->surface, &srcRect, newSurf, NULL);
+	SDL_Rect srcRect = {left, storage->image->surface->h - bottom - height, width, height};
+	SDL_BlitSurface(storage->image->surface, &srcRect, newSurf, NULL);
 	
 	// Finally, return the new surface as an Image.
 	return NewImageFromSurface(newSurf);
@@ -542,7 +705,150 @@ int RoundToInt(double d) {
 	return (int)round(d);
 }
 
-void DrawSprites() {
+void HandleEvents() {
+	StageTimer timer(stageEvents);
+	SDL_Event e;
+	while (SDL_PollEvent(&e) != 0) {
+		if (e.type == SDL_QUIT) quit = true;
+		else if (e.type == SDL_KEYDOWN || e.type == SDL_KEYUP) {
+			if (Replaying()) continue;		// (keys come from the recording instead)
+			Sint32 keyCode = e.key.keysym.sym;
+			if (keyCode == SDLK_KP_PERIOD) keyCode = SDLK_KP_DECIMAL;	// (normalize this inconsistency)
+			bool down = (e.type == SDL_KEYDOWN);
+			keyDownMap.SetValue(keyCode, down);
+			RecordKey(keyCode, down);
+			if (down) QueueKeyDown(keyCode);
+		} else if (e.type == SDL_TEXTINPUT) {
+			if (!Replaying()) QueueText(e.text.text);
+		} else if (e.type == SDL_MOUSEBUTTONDOWN) {
+			if (Replaying()) continue;
+			switch (e.button.button) {
+				case SDL_BUTTON_LEFT:	QueueKeyEvent("mouse 0");	break;
+				case SDL_BUTTON_RIGHT:	QueueKeyEvent("mouse 1");	break;
+				case SDL_BUTTON_MIDDLE:	QueueKeyEvent("mouse 2");	break;
+				case SDL_BUTTON_X1:		QueueKeyEvent("mouse 3");	break;
+				case SDL_BUTTON_X2:		QueueKeyEvent("mouse 4");	break;
+			}
+		} else if (e.type == SDL_CONTROLLERBUTTONDOWN) {
+			if (Replaying()) continue;
+			int joyNum = ControllerIndex(e.cbutton.which) + 1;
+			if (joyNum > 0) {
+				QueueKeyEvent("joystick " + std::to_string(joyNum) + " button " + std::to_string(e.cbutton.button));
+			}
+		} else if (e.type == SDL_WINDOWEVENT) {
+			if (e.window.event == SDL_WINDOWEVENT_RESIZED || e.window.event == SDL_WINDOWEVENT_SIZE_CHANGED) {
+				HandleWindowSizeChange(e.window.data1, e.window.data2);
+			}
+		}
+	}
+	
+	// Get the mouse and controller state for this frame, from SDL or the recording
+	if (Replaying()) {
+		if (!ReplayInputFrame(keyDownMap, &mouse, &controllers, QueueKeyEvent)) {
+			printf("Replay finished after %ld frames\n", frameCount);
+			quit = true;
+		}
+	} else {
+		SampleInput();
+		RecordInputFrame(mouse, controllers);
+	}
+	
+	// Update mouse position
+	// (we store mouse x and y as values, rather than functions, so they can be used
+	// in any context that needs an XY map, such as Bounds.contains)
+	mouseModule.SetValue(xStr, Value(GetMouseX()));
+	mouseModule.SetValue(yStr, Value(GetMouseY()));
+}
+
+// Get the current mouse and controller state from SDL.
+void SampleInput() {
+	mouse.buttons = SDL_GetMouseState(&mouse.x, &mouse.y);
+	controllers.resize(gameControllers.size());
+	VecIterate(i, gameControllers) {
+		SDL_GameController *gc = gameControllers[i];
+		ControllerState& c = controllers[i];
+		c.buttons = 0;
+		for (int b=0; b<(int)SDL_CONTROLLER_BUTTON_MAX; b++) {
+			if (gc and SDL_GameControllerGetButton(gc, (SDL_GameControllerButton)b)) c.buttons |= 1u << b;
+		}
+		for (int a=0; a<(int)SDL_CONTROLLER_AXIS_MAX; a++) {
+			c.axes[a] = gc ? SDL_GameControllerGetAxis(gc, (SDL_GameControllerAxis)a) : 0;
+		}
+	}
+}
+
+// Add an event to the queue for key.get (and the recording, if any).
+// If the script isn't taking them, events past the queue size are dropped.
+void QueueKeyEvent(const std::string& event) {
+	if (!keyQueue.Push(event)) return;
+	if (!Replaying()) RecordKeyEvent(event);
+}
+
+// Queue the character for a key that doesn't produce text (arrows, return,
+// and so on), using the same codes as Mini Micro.
+void QueueKeyDown(Sint32 keyCode) {
+	char c;
+	switch (keyCode) {
+		case SDLK_LEFT:			c = 17;		break;
+		case SDLK_RIGHT:		c = 18;		break;
+		case SDLK_UP:			c = 19;		break;
+		case SDLK_DOWN:			c = 20;		break;
+		case SDLK_RETURN:
+		case SDLK_KP_ENTER:		c = 10;		break;
+		case SDLK_BACKSPACE:	c = 8;		break;
+		case SDLK_TAB:			c = 9;		break;
+		case SDLK_ESCAPE:		c = 27;		break;
+		case SDLK_DELETE:		c = 127;	break;
+		default: return;
+	}
+	QueueKeyEvent(std::string(1, c));
+}
+
+// Queue typed text (UTF-8, possibly several characters at once) one character at a time.
+void QueueText(const char *text) {
+	const char *p = text;
+	while (*p) {
+		const char *start = p++;
+		while ((*p & 0xC0) == 0x80) p++;	// (skip continuation bytes)
+		QueueKeyEvent(std::string(start, p - start));
+	}
+}
+
+// Find which of gameControllers has the given joystick instance ID; -1 if none.
+int ControllerIndex(SDL_JoystickID instanceID) {
+	VecIterate(i, gameControllers) {
+		if (gameControllers[i] == nullptr) continue;
+		if (SDL_JoystickInstanceID(SDL_GameControllerGetJoystick(gameControllers[i])) == instanceID) return (int)i;
+	}
+	return -1;
+}
+
+// Capture the screen contents into a scene, to be submitted for drawing.
+void CaptureScene() {
+	StageTimer timer(stageCapture);
+	Scene *scene = BeginScene();
+	scene->windowHeight = windowHeight;
+	scene->backColor = backgroundColor;
+	CaptureSprites(scene);
+	mainPixelDisplay->Capture(scene);
+	mainTextDisplay->Capture(scene);
+	frameCount++;
+	if (framesToDump.Contains(frameCount)) {
+		scene->savePath = frameDumpPrefix + String::Format(frameCount) + ".png";
+	}
+	if (showFrameOverlay) AddFrameOverlay(scene);
+}
+
+void CaptureSprites(Scene *scene) {
+	// In fixed-update mode, draw sprites partway from where they were before
+	// the last step to where they are now, according to how far the clock
+	// has got through that step.  (So we're drawing up to one step behind.)
+	double alpha = 1;
+	if (!updateFunc.IsNull()) {
+		alpha = (Clock() - simTime) / updateStep;
+		if (alpha < 0) alpha = 0; else if (alpha > 1) alpha = 1;
+	}
+	
 	MiniScript::ValueList sprites = spriteList.GetList();
 	for (int i=0; i<sprites.Count(); i++) {
 		Value sprite = sprites[i];
@@ -551,21 +857,16 @@ void DrawSprites() {
 		SpriteHandleData *data = GetSpriteHandleData(sprite);
 		double x = data->x, y = data->y;
 		double scaleX = data->scaleX, scaleY = data->scaleY;
-		double rotation = data->rotation;		
-// 		double x = round(sprite.Lookup("x").DoubleValue());
-// 		double y = round(sprite.Lookup("y").DoubleValue());
-// 		double scaleX = 0, scaleY = 0;
-// 		Value scaleVal = sprite.Lookup("scale");
-// 		if (scaleVal.type == ValueType::List) {
-// 			ValueList list = scaleVal.GetList();
-// 			if (list.Count() > 0) scaleX = list[0].DoubleValue();
-// 			if (list.Count() > 1) scaleY = list[1].DoubleValue();
-// 		} else {
-// 			scaleX = scaleY = scaleVal.DoubleValue();
-// 		}
-// 		double rotation = sprite.Lookup("rotation").DoubleValue();
-
-		Color c = ToColor(sprite.Lookup("tint").ToString());
+		double rotation = data->rotation;
+		if (alpha < 1 and data->prevStep == stepCount) {
+			x = data->prevX + (x - data->prevX) * alpha;
+			y = data->prevY + (y - data->prevY) * alpha;
+			scaleX = data->prevScaleX + (scaleX - data->prevScaleX) * alpha;
+			scaleY = data->prevScaleY + (scaleY - data->prevScaleY) * alpha;
+			double turn = fmod(rotation - data->prevRotation, 360);	// (turn the short way around)
+			if (turn > 180) turn -= 360; else if (turn < -180) turn += 360;
+			rotation = data->prevRotation + turn * alpha;
+		}
 
 		MiniScript::Value image = sprite.Lookup("image");
 		TextureStorage *storage = NULL;
@@ -579,22 +880,31 @@ void DrawSprites() {
 		}
 		if (storage == nullptr) continue;
 		
-		if (storage->texture == nullptr) {
-			storage->texture = SDL_CreateTextureFromSurface(mainRenderer, storage->surface);
-			if (storage->texture == nullptr) continue;
-			SDL_SetTextureBlendMode(storage->texture, SDL_BLENDMODE_BLEND);
-			SDL_SetTextureScaleMode(storage->texture, SDL_ScaleModeNearest);
-		}
-		double w = storage->surface->w * scaleX, h = storage->surface->h * scaleY;
-		
-		SDL_Rect destRect = { RoundToInt(x-w/2), windowHeight-RoundToInt(y+h/2), RoundToInt(w), RoundToInt(h) };
-
-		SDL_SetTextureColorMod(storage->texture, c.r, c.g, c.b);
-		SDL_SetTextureAlphaMod(storage->texture, c.a);
-		SDL_RenderCopyEx(mainRenderer, storage->texture, NULL, &destRect, -rotation, NULL, SDL_FLIP_NONE);
+		double w = storage->image->surface->w * scaleX, h = storage->image->surface->h * scaleY;
+		SpriteDraw draw;
+		draw.image = storage->image;
+		draw.image->retain();
+		draw.left = RoundToInt(x-w/2);
+		draw.top = windowHeight-RoundToInt(y+h/2);
+		draw.width = RoundToInt(w);
+		draw.height = RoundToInt(h);
+		draw.rotation = rotation;
+		draw.tint = ToColor(sprite.Lookup("tint").ToString());
+		scene->sprites.push_back(draw);
 	}
 }
 
+// The clock frames are paced by: real time, or with a fixed timestep (when
+// recording or replaying input), the frame count times that step.
+static double Clock() {
+	if (fixedTimestep > 0) return frameCount * fixedTimestep;
+	return frameTime;
+}
+
+static double Now() {
+	return (double)(SDL_GetPerformanceCounter() - startCounter) / SDL_GetPerformanceFrequency();
+}
+
 void HandleWindowSizeChange(int newWidth, int newHeight) {
 	mainTextDisplay->NoteWindowSizeChange(newWidth, newHeight);
 }
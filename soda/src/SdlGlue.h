@@ -13,6 +13,7 @@
 #include <stdio.h>
 #include "SdlUtils.h"
 #include "MiniScript/SimpleString.h"
+#include "MiniScript/SimpleVector.h"
 #include "MiniScript/MiniscriptTypes.h"
 
 namespace SdlGlue {
@@ -24,6 +25,13 @@ void Shutdown();
 void DoSdlTest();
 bool IsKeyPressed(MiniScript::String keyName);
 bool IsMouseButtonPressed(int buttonNum);
+
+// Key events, queued as they happen for key.get: typed characters (with
+// arrows, return, etc. as control characters), "mouse N" for mouse button
+// presses, and "joystick N button M" for game controller buttons.
+bool KeyAvailable();
+MiniScript::String GetKey();		// (empty if none available)
+void ClearKeyBuffer();
 int GetMouseX();
 int GetMouseY();
 int GetWindowWidth();
@@ -41,12 +49,56 @@ MiniScript::Value GetSubImage(MiniScript::Value image, int left, int bottom, int
 MiniScript::Value GetImagePixel(MiniScript::Value image, int x, int y);
 void SetImagePixel(MiniScript::Value image, int x, int y, MiniScript::String colorStr);
 
+// Frame pacing.  Service captures the screen and submits it to be drawn,
+// which waits for the previous frame to be picked up by the render thread
+// (or for vsync, when not threaded and not uncapped); the main loop then
+// runs the script for TimeToNextFrame seconds, to be done in time for the next.
+double FrameTime();			// time (in seconds since Setup) the current frame was submitted
+double DeltaTime();			// seconds between the last two frames
+double FrameInterval();		// display refresh interval, in seconds
+double TimeToNextFrame();	// time left for the script before we must render again
+long FrameCount();			// frames submitted so far
+
+// Fixed-timestep updates.  A script may ask (with fixedUpdate) for a function
+// to be called at a fixed rate once its main program is done.  Each frame,
+// the main loop runs that function FixedStepsDue times, calling BeginFixedStep
+// before each.  Sprites are drawn in between their last two steps, so motion
+// stays smooth whatever the frame rate.  While in this mode, frameTime is
+// the simulated time and deltaTime is the step.
+void SetFixedUpdate(MiniScript::Value func, double rate);
+MiniScript::Value FixedUpdateFunc();	// (null when not in fixed-update mode)
+int FixedStepsDue();
+void BeginFixedStep();
+
 void Print(MiniScript::String s, bool addLineBreak=true);
 void Clear();
 
 // flag set to true when the user tries to quit the app (by closing the window, cmd-Q, etc.)
 extern bool quit;
 
+// if true, present frames without waiting for vsync (for benchmarking; set before Setup)
+extern bool uncapped;
+
+// if true (the default), draw on a separate render thread (set before Setup)
+extern bool renderThreaded;
+
+// Headless mode: no display, GPU, or audio device needed.  We use SDL's dummy
+// drivers, draw into an offscreen surface, and run uncapped.  (Set before Setup.)
+extern bool headless;
+
+// Frames (counting from 1) to save as PNG files, named frameDumpPrefix + number + ".png";
+// and if maxFrames > 0, the number of frames after which to quit.
+extern SimpleVector<long> framesToDump;
+extern MiniScript::String frameDumpPrefix;
+extern long maxFrames;
+
+// if not empty, a CSV file to which to write the timing of each frame (see FrameStats.h)
+extern MiniScript::String frameStatsPath;
+
+// if not empty, a file to record input to, or replay it from (see InputLog.h)
+extern MiniScript::String inputRecordPath;
+extern MiniScript::String inputReplayPath;
+
 extern MiniScript::Value magicHandle;	// "_handle" (used for several intrinsic classes)
 
 }
@@ -17,8 +17,11 @@
 #include "MiniScript/Dictionary.h"
 #include "MiniScript/MiniscriptParser.h"
 #include "MiniScript/MiniscriptInterpreter.h"
+#include "MiniScript/MiniscriptGC.h"
+#include "MiniScript/SlabAllocator.h"
 #include "OstreamSupport.h"
 #include "MiniScript/SplitJoin.h"
+#include "CodeCache.h"
 
 #include <stdio.h>
 #if _WIN32 || _WIN64
@@ -640,17 +643,98 @@ static ValueDict& FileHandleClass() {
 	return result;
 }
 
+// Default directories to search for import modules: from the MS_IMPORT_PATH
+// environment variable if set (separated like PATH), or else . and ./lib.
+static ValueList DefaultImportPaths() {
+	ValueList result;
+	const char *envPath = getenv("MS_IMPORT_PATH");
+	if (envPath and envPath[0]) {
+#if WINDOWS
+		StringList parts = Split(envPath, ';');
+#else
+		StringList parts = Split(envPath, ':');
+#endif
+		for (long i=0; i<parts.Count(); i++) if (not parts[i].empty()) result.Add(parts[i]);
+	} else {
+		result.Add(String("."));
+#if WINDOWS
+		result.Add(String(".\\lib"));
+#else
+		result.Add(String("./lib"));
+#endif
+	}
+	return result;
+}
+
+static ValueDict& EnvMap() {
+	static ValueDict envMap;
+	if (envMap.Count() == 0) {
+		// The stdlib-supplied `environ` is a null-terminated array of char* (C strings).
+		// Each such C string is of the form NAME=VALUE.  So we need to split on the
+		// first '=' to separate this into keys and values for our env map.
+		for (char **current = environ; *current; current++) {
+			char* eqPos = strchr(*current, '=');
+			if (!eqPos) continue;	// (should never happen, but just in case)
+			String varName(*current, eqPos - *current);
+			String valueStr(eqPos+1);
+			envMap.SetValue(varName, valueStr);
+		}
+		// Also, the directories where import looks for modules (which the
+		// script may change).
+		envMap.SetValue("importPaths", DefaultImportPaths());
+	}
+	return envMap;
+}
+
+static String FullPath(String path) {
+#if WINDOWS
+	char pathBuf[512];
+	if (_fullpath(pathBuf, path.c_str(), sizeof(pathBuf)) == NULL) return path;
+#else
+	char pathBuf[PATH_MAX];
+	if (realpath(path.c_str(), pathBuf) == NULL) return path;
+#endif
+	return String(pathBuf);
+}
+
+// Modules imported so far, keyed by full path.  Each value is the module's
+// map of globals, which is shared by every script that imports it.  A module
+// is registered only once its code has run without error; one that failed
+// is loaded afresh by the next import of it.
+static ValueDict importedModules;
+
+// Modules whose code is still running, keyed the same way, so that circular
+// imports get the same (partly-filled-in) map rather than loading the module again.
+static ValueDict importsInProgress;
+
+// How many errors the interpreter running the given context has reported.
+static long ErrorCount(Context *context) {
+	Interpreter *interp = context->vm->interpreter;
+	return interp ? interp->errorCount : 0;
+}
+
+void ClearImportedModules() {
+	importedModules = ValueDict();
+	importsInProgress = ValueDict();
+}
+
 static IntrinsicResult intrinsic_import(Context *context, IntrinsicResult partialResult) {
 	if (!partialResult.Result().IsNull()) {
 		// When we're invoked with a partial result, it means that the import
 		// function has finished, and stored its result (the values that were
 		// created by the import code) in Temp 0.
 		Value importedValues = context->GetTemp(0);
+		// The partial result is [libname, full path, error count at the start];
+		// if no error was reported since then, the module is good to share.
+		ValueList importInfo = partialResult.Result().GetList();
+		String libname = importInfo[0].ToString();
+		Value fullPath = importInfo[1];
+		importsInProgress.Remove(fullPath);
+		if (ErrorCount(context) == importInfo[2].IntValue()) importedModules.SetValue(fullPath, importedValues);
 		// Now we're going to do something slightly evil.  We're going to reach
 		// up into the *parent* context, and store these imported values under
 		// the import library name.  Thus, there will always be a standard name
 		// by which you can refer to the imported stuff.
-		String libname = partialResult.Result().ToString();
 		Context *callerContext = context->parent;
 		callerContext->SetVar(libname, importedValues);
 		return IntrinsicResult::Null;
@@ -662,18 +746,19 @@ static IntrinsicResult intrinsic_import(Context *context, IntrinsicResult partia
 		RuntimeException("import: libname required").raise();
 	}
 	
-	// Figure out what directories to look for the import modules in.
+	// Figure out what directories to look for the import modules in:
+	// env.importPaths, which may be a list of paths or just one.
 	SimpleVector<String> libDirs;
-	libDirs.push_back(".");		// for now!
-#if WINDOWS
-	libDirs.push_back(".\\lib");
-#else
-	libDirs.push_back("./lib");
-#endif
-	// ToDo: other import dirs, maybe from env, or from something the user can set.
+	Value importPaths = EnvMap().Lookup(String("importPaths"), Value::null);
+	if (importPaths.type == ValueType::List) {
+		ValueList paths = importPaths.GetList();
+		for (long i=0; i<paths.Count(); i++) libDirs.push_back(paths[i].ToString());
+	} else if (not importPaths.IsNull()) {
+		libDirs.push_back(importPaths.ToString());
+	}
 	
 	// Search the lib dirs for a matching file.
-	String moduleSource;
+	String modulePath;
 	bool found = false;
 	VecIterate(i, libDirs) {
 		String path = libDirs[i];
@@ -688,8 +773,8 @@ static IntrinsicResult intrinsic_import(Context *context, IntrinsicResult partia
 		path += libname + ".ms";
 		FILE *handle = fopen(path.c_str(), "r");
 		if (handle == NULL) continue;
-		moduleSource = ReadFileHelper(handle, -1);
 		fclose(handle);
+		modulePath = path;
 		found = true;
 		break;
 	}
@@ -697,35 +782,82 @@ static IntrinsicResult intrinsic_import(Context *context, IntrinsicResult partia
 		RuntimeException("import: library not found: " + libname).raise();
 	}
 	
-	// Now, parse that code, and build a function around it that returns
+	// If this module was already imported (from here or anywhere else),
+	// just use the same module map.
+	String fullPath = FullPath(modulePath);
+	Value module = importedModules.Lookup(fullPath, Value::null);
+	if (module.IsNull()) module = importsInProgress.Lookup(fullPath, Value::null);
+	if (not module.IsNull()) {
+		context->parent->SetVar(libname, module);
+		return IntrinsicResult::Null;
+	}
+	
+	// Now, get the compiled code (from the code cache if we can, or else by
+	// parsing the source), and build a function around it that returns
 	// its own locals as its result.  Push a manual call.
 	Parser parser;
 	parser.errorContext = libname + ".ms";
-	parser.Parse(moduleSource);
+	List<TACLine> code;
+	if (CodeCache::Load(modulePath, parser.errorContext, code)) {
+		parser.output->code = code;
+	} else {
+		FILE *handle = fopen(modulePath.c_str(), "r");
+		if (handle == NULL) RuntimeException("import: unable to read " + modulePath).raise();
+		String moduleSource = ReadFileHelper(handle, -1);
+		fclose(handle);
+		parser.Parse(moduleSource);
+		CodeCache::Store(modulePath, parser.output->code);
+	}
 	FunctionStorage *import = parser.CreateImport();
+	ValueList importInfo;
+	importInfo.Add(libname);
+	importInfo.Add(fullPath);
+	importInfo.Add(ErrorCount(context));
 	context->vm->ManuallyPushCall(import, Value::Temp(0));
+	importsInProgress.SetValue(fullPath, context->vm->GetTopContext()->variables);
 	
 	// That call will not be able to run until we return from this intrinsic.
-	// So, return a partial result, with the lib name.  We'll get invoked
-	// again after the import function has finished running.
-	return IntrinsicResult(libname, false);
+	// So, return a partial result, with the lib name (and what we need to
+	// finish registering it).  We'll get invoked again after the import
+	// function has finished running.
+	return IntrinsicResult(importInfo, false);
+}
+
+// reset: clear all global variables, and forget imported modules (so the
+// next import of each reads its file again, picking up any edits).
+static IntrinsicResult intrinsic_reset(Context *context, IntrinsicResult partialResult) {
+	context->vm->GetGlobalContext()->variables = ValueDict();
+	ClearImportedModules();
+	return IntrinsicResult::Null;
 }
 
 static IntrinsicResult intrinsic_env(Context *context, IntrinsicResult partialResult) {
-	static ValueDict envMap;
-	if (envMap.Count() == 0) {
-		// The stdlib-supplied `environ` is a null-terminated array of char* (C strings).
-		// Each such C string is of the form NAME=VALUE.  So we need to split on the
-		// first '=' to separate this into keys and values for our env map.
-		for (char **current = environ; *current; current++) {
-			char* eqPos = strchr(*current, '=');
-			if (!eqPos) continue;	// (should never happen, but just in case)
-			String varName(*current, eqPos - *current);
-			String valueStr(eqPos+1);
-			envMap.SetValue(varName, valueStr);
-		}
-	}
-	return IntrinsicResult(envMap);
+	return IntrinsicResult(EnvMap());
+}
+
+static IntrinsicResult intrinsic_gc(Context *context, IntrinsicResult partialResult) {
+	ValueDict result;
+	result.SetValue("pending", CycleCollector::PendingRoots());
+	result.SetValue("freed", CycleCollector::freed);
+	result.SetValue("runs", CycleCollector::runs);
+	result.SetValue("time", CycleCollector::time);
+	result.SetValue("lastTime", CycleCollector::lastTime);
+	result.SetValue("enabled", Value::Truth(CycleCollector::enabled));
+	return IntrinsicResult(result);
+}
+
+static IntrinsicResult intrinsic_memStats(Context *context, IntrinsicResult partialResult) {
+	ValueDict result;
+	result.SetValue("allocs", SlabAllocator::Allocations());
+	result.SetValue("frees", SlabAllocator::Frees());
+	result.SetValue("live", SlabAllocator::Allocations() - SlabAllocator::Frees());
+	result.SetValue("large", SlabAllocator::LargeAllocations());
+	result.SetValue("slabBytes", SlabAllocator::SlabBytes());
+	ValueList live;		// live blocks in each size class
+	for (int i=0; i<SlabAllocator::classCount; i++) live.Add(SlabAllocator::LiveBlocks(i));
+	result.SetValue("liveBySize", live);
+	result.SetValue("slabs", Value::Truth(MINISCRIPT_SLAB_ALLOC != 0));
+	return IntrinsicResult(result);
 }
 
 static bool assignEnvVar(ValueDict& dict, Value key, Value value) {
@@ -753,6 +885,12 @@ void AddShellIntrinsics() {
 	f = Intrinsic::Create("env");
 	f->code = &intrinsic_env;
 	
+	f = Intrinsic::Create("gc");
+	f->code = &intrinsic_gc;
+	
+	f = Intrinsic::Create("memStats");
+	f->code = &intrinsic_memStats;
+	
 	f = Intrinsic::Create("input");
 	f->AddParam("prompt", "");
 	f->code = &intrinsic_input;
@@ -760,6 +898,9 @@ void AddShellIntrinsics() {
 	f = Intrinsic::Create("import");
 	f->AddParam("libname", "");
 	f->code = &intrinsic_import;
+	
+	f = Intrinsic::Create("reset");
+	f->code = &intrinsic_reset;
 
 	f = Intrinsic::Create("file");
 	f->code = &intrinsic_File;
@@ -24,4 +24,7 @@ extern MiniScript::ValueList shellArgs;
 
 void AddShellIntrinsics();
 
+// Forget all imported modules, so that the next import of each loads it afresh.
+void ClearImportedModules();
+
 #endif // SHELLINTRINSICS_H
@@ -11,6 +11,7 @@
 #include "SdlGlue.h"
 #include "TextDisplay.h"
 #include "SdlAudio.h"
+#include "Worker.h"
 #include "MiniScript/SimpleString.h"
 #include "MiniScript/UnicodeUtil.h"
 #include "MiniScript/UnitTest.h"
@@ -48,16 +49,6 @@ static IntrinsicResult intrinsic_sprites(Context *context, IntrinsicResult parti
 	return IntrinsicResult(spriteList);
 }
 
-static int GetInt(Context *context, const char *varName) {
-	Value value = context->GetVar(varName);
-	return value.IntValue();
-}
-
-static float GetFloat(Context *context, const char *varName) {
-	Value value = context->GetVar(varName);
-	return value.FloatValue();
-}
-
 static Vector2 ToVector2(Value item) {
 	Vector2 pos(0,0);
 	if (item.type == ValueType::List) {
@@ -315,6 +306,9 @@ static IntrinsicResult intrinsic_imageClass(Context *context, IntrinsicResult pa
 //--------------------------------------------------------------------------------
 static Intrinsic *i_key_pressed = nullptr;
 static Intrinsic *i_key_axis = nullptr;
+static Intrinsic *i_key_available = nullptr;
+static Intrinsic *i_key_get = nullptr;
+static Intrinsic *i_key_clear = nullptr;
 
 static IntrinsicResult intrinsic_keyModule(Context *context, IntrinsicResult partialResult) {
 	static ValueDict keyModule;
@@ -322,21 +316,40 @@ static IntrinsicResult intrinsic_keyModule(Context *context, IntrinsicResult par
 	if (keyModule.Count() == 0) {
 		keyModule.SetValue("pressed", i_key_pressed->GetFunc());
 		keyModule.SetValue("axis", i_key_axis->GetFunc());
+		keyModule.SetValue("available", i_key_available->GetFunc());
+		keyModule.SetValue("get", i_key_get->GetFunc());
+		keyModule.SetValue("clear", i_key_clear->GetFunc());
 	}
 	
 	return IntrinsicResult(keyModule);
 }
 
-static IntrinsicResult intrinsic_key_pressed(Context *context, IntrinsicResult partialResult) {
-	Value keyName = context->GetVar("keyName");
-	if (keyName.IsNull()) return IntrinsicResult::Null;
-	return IntrinsicResult(SdlGlue::IsKeyPressed(keyName.ToString()));
+static Value intrinsic_key_pressed(Context *context, const Value *args) {
+	Value keyName = args[0];
+	if (keyName.IsNull()) return Value::null;
+	return SdlGlue::IsKeyPressed(keyName.ToString());
+}
+
+static Value intrinsic_key_axis(Context *context, const Value *args) {
+	Value keyName = args[0];
+	if (keyName.IsNull()) return Value::null;
+	return SdlGlue::GetAxis(keyName.ToString());
+}
+
+static Value intrinsic_key_available(Context *context, const Value *args) {
+	return SdlGlue::KeyAvailable();
+}
+
+static IntrinsicResult intrinsic_key_get(Context *context, IntrinsicResult partialResult) {
+	if (SdlGlue::KeyAvailable()) return IntrinsicResult(SdlGlue::GetKey());
+	// Nothing yet; yield, so the frame goes on (and events get pumped), and check again next time.
+	context->vm->yielding = true;
+	return IntrinsicResult(Value::null, false);
 }
 
-static IntrinsicResult intrinsic_key_axis(Context *context, IntrinsicResult partialResult) {
-	Value keyName = context->GetVar("axisName");
-	if (keyName.IsNull()) return IntrinsicResult::Null;
-	return IntrinsicResult(SdlGlue::GetAxis(keyName.ToString()));
+static Value intrinsic_key_clear(Context *context, const Value *args) {
+	SdlGlue::ClearKeyBuffer();
+	return Value::null;
 }
 
 //--------------------------------------------------------------------------------
@@ -358,10 +371,10 @@ static IntrinsicResult intrinsic_mouseModule(Context *context, IntrinsicResult p
 	return IntrinsicResult(mouseModule);
 }
 
-static IntrinsicResult intrinsic_mouse_button(Context *context, IntrinsicResult partialResult) {
-	Value which = context->GetVar("which");
-	if (which.IsNull()) return IntrinsicResult::Null;
-	return IntrinsicResult(SdlGlue::IsMouseButtonPressed((int)which.IntValue()));
+static Value intrinsic_mouse_button(Context *context, const Value *args) {
+	Value which = args[0];
+	if (which.IsNull()) return Value::null;
+	return SdlGlue::IsMouseButtonPressed((int)which.IntValue());
 }
 
 
@@ -416,6 +429,116 @@ static IntrinsicResult intrinsic_soundClass(Context *context, IntrinsicResult pa
 	return IntrinsicResult(soundClass);
 }
 
+//--------------------------------------------------------------------------------
+// Worker class (and the parent module, which workers use to talk back)
+//--------------------------------------------------------------------------------
+ValueDict workerClass;
+static Intrinsic *i_worker_start = nullptr;
+static Intrinsic *i_worker_post = nullptr;
+static Intrinsic *i_worker_available = nullptr;
+static Intrinsic *i_worker_get = nullptr;
+static Intrinsic *i_worker_running = nullptr;
+static Intrinsic *i_worker_stop = nullptr;
+static Intrinsic *i_parent_post = nullptr;
+static Intrinsic *i_parent_available = nullptr;
+static Intrinsic *i_parent_get = nullptr;
+
+static IntrinsicResult intrinsic_worker_start(Context *context, IntrinsicResult partialResult) {
+	String path = context->GetVar("path").ToString();
+	if (path.empty()) RuntimeException("path required for Worker.start").raise();
+	return IntrinsicResult(SdlGlue::StartWorker(path));
+}
+
+static IntrinsicResult intrinsic_worker_post(Context *context, IntrinsicResult partialResult) {
+	Value self = context->GetVar("self");
+	if (!SdlGlue::WorkerRunning(self)) return IntrinsicResult::Null;
+	if (SdlGlue::PostToWorker(self, context->GetVar("message"))) return IntrinsicResult::Null;
+	// Its queue is full; give it a frame to catch up, and try again.
+	context->vm->yielding = true;
+	return IntrinsicResult(Value::null, false);
+}
+
+static IntrinsicResult intrinsic_worker_available(Context *context, IntrinsicResult partialResult) {
+	return IntrinsicResult(Value::Truth(SdlGlue::WorkerMessageAvailable(context->GetVar("self"))));
+}
+
+static IntrinsicResult intrinsic_worker_get(Context *context, IntrinsicResult partialResult) {
+	Value self = context->GetVar("self");
+	Value message;
+	if (SdlGlue::GetFromWorker(self, &message)) return IntrinsicResult(message);
+	if (!SdlGlue::WorkerRunning(self)) return IntrinsicResult::Null;	// (nothing more is coming)
+	// Nothing yet; yield, so the frame goes on, and check again next time.
+	context->vm->yielding = true;
+	return IntrinsicResult(Value::null, false);
+}
+
+static IntrinsicResult intrinsic_worker_running(Context *context, IntrinsicResult partialResult) {
+	return IntrinsicResult(Value::Truth(SdlGlue::WorkerRunning(context->GetVar("self"))));
+}
+
+static IntrinsicResult intrinsic_worker_stop(Context *context, IntrinsicResult partialResult) {
+	SdlGlue::StopWorker(context->GetVar("self"));
+	return IntrinsicResult::Null;
+}
+
+static IntrinsicResult intrinsic_workerClass(Context *context, IntrinsicResult partialResult) {
+	if (workerClass.Count() == 0) {
+		i_worker_start = Intrinsic::Create("");
+		i_worker_start->AddParam("path", Value::emptyString);
+		i_worker_start->code = &intrinsic_worker_start;
+		workerClass.SetValue("start", i_worker_start->GetFunc());
+
+		i_worker_post = Intrinsic::Create("");
+		i_worker_post->AddParam("message");
+		i_worker_post->code = &intrinsic_worker_post;
+		workerClass.SetValue("post", i_worker_post->GetFunc());
+
+		i_worker_available = Intrinsic::Create("");
+		i_worker_available->code = &intrinsic_worker_available;
+		workerClass.SetValue("available", i_worker_available->GetFunc());
+
+		i_worker_get = Intrinsic::Create("");
+		i_worker_get->code = &intrinsic_worker_get;
+		workerClass.SetValue("get", i_worker_get->GetFunc());
+
+		i_worker_running = Intrinsic::Create("");
+		i_worker_running->code = &intrinsic_worker_running;
+		workerClass.SetValue("running", i_worker_running->GetFunc());
+
+		i_worker_stop = Intrinsic::Create("");
+		i_worker_stop->code = &intrinsic_worker_stop;
+		workerClass.SetValue("stop", i_worker_stop->GetFunc());
+
+		workerClass.SetValue("_handle", Value::null);
+	}
+	return IntrinsicResult(workerClass);
+}
+
+// The parent module runs on worker threads, so everything here must be thread-safe.
+static IntrinsicResult intrinsic_parent_post(Context *context, IntrinsicResult partialResult) {
+	SdlGlue::PostToParent(context->GetVar("message"));
+	return IntrinsicResult::Null;
+}
+
+static IntrinsicResult intrinsic_parent_available(Context *context, IntrinsicResult partialResult) {
+	return IntrinsicResult(Value::Truth(SdlGlue::ParentMessageAvailable()));
+}
+
+static IntrinsicResult intrinsic_parent_get(Context *context, IntrinsicResult partialResult) {
+	return IntrinsicResult(SdlGlue::GetFromParent());
+}
+
+static IntrinsicResult intrinsic_parentModule(Context *context, IntrinsicResult partialResult) {
+	if (!SdlGlue::InWorker()) return IntrinsicResult::Null;
+	static thread_local ValueDict parentModule;		// (one per worker, as maps can't be shared)
+	if (parentModule.Count() == 0) {
+		parentModule.SetValue("post", i_parent_post->GetFunc());
+		parentModule.SetValue("available", i_parent_available->GetFunc());
+		parentModule.SetValue("get", i_parent_get->GetFunc());
+	}
+	return IntrinsicResult(parentModule);
+}
+
 //--------------------------------------------------------------------------------
 // Sprite class
 //--------------------------------------------------------------------------------
@@ -647,13 +770,12 @@ static Intrinsic *i_pixelDisplay_fillRect = nullptr;
 static Intrinsic *i_pixelDisplay_fillEllipse = nullptr;
 static Intrinsic *i_pixelDisplay_fillPoly = nullptr;
 
-static IntrinsicResult intrinsic_pixelDisplay_clear(Context *context, IntrinsicResult partialResult) {
-	Value self = context->GetVar("self");
-	Value colorStr = context->GetVar("color");
+static Value intrinsic_pixelDisplay_clear(Context *context, const Value *args) {
+	Value colorStr = args[0];
 	// Note: for now, we'll just always access the main pixel display.
 	// When we support multiple pixel displays, we'll need to be more discriminating.
 	SdlGlue::mainPixelDisplay->Clear(ToColor(colorStr.ToString()));
-	return IntrinsicResult::Null;
+	return Value::null;
 }
 
 static IntrinsicResult intrinsic_pixelDisplay_height(Context *context, IntrinsicResult partialResult) {
@@ -677,81 +799,76 @@ static IntrinsicResult intrinsic_pixelDisplay_color(Context *context, IntrinsicR
 	return IntrinsicResult(SdlGlue::mainPixelDisplay->drawColor.ToString());
 }
 
-static IntrinsicResult intrinsic_pixelDisplay_setPixel(Context *context, IntrinsicResult partialResult) {
-	Value self = context->GetVar("self");
+static Value intrinsic_pixelDisplay_setPixel(Context *context, const Value *args) {
 	// Note: for now, we'll just always access the main pixel display.
 	// When we support multiple pixel displays, we'll need to be more discriminating.
-	int x = GetInt(context, "x");
-	int y = GetInt(context, "y");
-	Value colorVal = context->GetVar("color");
+	int x = args[0].IntValue();
+	int y = args[1].IntValue();
+	Value colorVal = args[2];
 	Color color;
 	if (!colorVal.IsNull()) color = ToColor(colorVal.ToString());
 	else color = SdlGlue::mainPixelDisplay->drawColor;
 	SdlGlue::mainPixelDisplay->SetPixel(x, y, color);
-	return IntrinsicResult::Null;
+	return Value::null;
 }
 
-static IntrinsicResult intrinsic_pixelDisplay_drawLine(Context *context, IntrinsicResult partialResult) {
-	Value self = context->GetVar("self");
+static Value intrinsic_pixelDisplay_drawLine(Context *context, const Value *args) {
 	// Note: for now, we'll just always access the main pixel display.
 	// When we support multiple pixel displays, we'll need to be more discriminating.
-	int x1 = GetInt(context, "x1");
-	int y1 = GetInt(context, "y1");
-	int x2 = GetInt(context, "x2");
-	int y2 = GetInt(context, "y2");
-	float width = GetFloat(context, "width");
-	Value colorVal = context->GetVar("color");
+	int x1 = args[0].IntValue();
+	int y1 = args[1].IntValue();
+	int x2 = args[2].IntValue();
+	int y2 = args[3].IntValue();
+	float width = args[5].FloatValue();
+	Value colorVal = args[4];
 	Color color;
 	if (!colorVal.IsNull()) color = ToColor(colorVal.ToString());
 	else color = SdlGlue::mainPixelDisplay->drawColor;
 	SdlGlue::mainPixelDisplay->DrawLine(x1, y1, x2, y2, color, width);
-	return IntrinsicResult::Null;
+	return Value::null;
 }
 
-static IntrinsicResult intrinsic_pixelDisplay_fillRect(Context *context, IntrinsicResult partialResult) {
-	Value self = context->GetVar("self");
+static Value intrinsic_pixelDisplay_fillRect(Context *context, const Value *args) {
 	// Note: for now, we'll just always access the main pixel display.
 	// When we support multiple pixel displays, we'll need to be more discriminating.
-	int left = GetInt(context, "left");
-	int bottom = GetInt(context, "bottom");
-	int width = GetInt(context, "width");
-	int height = GetInt(context, "height");
-	Value colorVal = context->GetVar("color");
+	int left = args[0].IntValue();
+	int bottom = args[1].IntValue();
+	int width = args[2].IntValue();
+	int height = args[3].IntValue();
+	Value colorVal = args[4];
 	Color color;
 	if (!colorVal.IsNull()) color = ToColor(colorVal.ToString());
 	else color = SdlGlue::mainPixelDisplay->drawColor;
 	SdlGlue::mainPixelDisplay->FillRect(left, bottom, width, height, color);
-	return IntrinsicResult::Null;
+	return Value::null;
 }
 
-static IntrinsicResult intrinsic_pixelDisplay_fillEllipse(Context *context, IntrinsicResult partialResult) {
-	Value self = context->GetVar("self");
+static Value intrinsic_pixelDisplay_fillEllipse(Context *context, const Value *args) {
 	// Note: for now, we'll just always access the main pixel display.
 	// When we support multiple pixel displays, we'll need to be more discriminating.
-	int left = GetInt(context, "left");
-	int bottom = GetInt(context, "bottom");
-	int width = GetInt(context, "width");
-	int height = GetInt(context, "height");
-	Value colorVal = context->GetVar("color");
+	int left = args[0].IntValue();
+	int bottom = args[1].IntValue();
+	int width = args[2].IntValue();
+	int height = args[3].IntValue();
+	Value colorVal = args[4];
 	Color color;
 	if (!colorVal.IsNull()) color = ToColor(colorVal.ToString());
 	else color = SdlGlue::mainPixelDisplay->drawColor;
 	SdlGlue::mainPixelDisplay->FillEllipse(left, bottom, width, height, color);
-	return IntrinsicResult::Null;
+	return Value::null;
 }
 
-static IntrinsicResult intrinsic_pixelDisplay_fillPoly(Context *context, IntrinsicResult partialResult) {
-	Value self = context->GetVar("self");
+static Value intrinsic_pixelDisplay_fillPoly(Context *context, const Value *args) {
 	// Note: for now, we'll just always access the main pixel display.
 	// When we support multiple pixel displays, we'll need to be more discriminating.
 	SimpleVector<Vector2> points;
-	ToVector2List(context->GetVar("points"), &points);
-	Value colorVal = context->GetVar("color");
+	ToVector2List(args[0], &points);
+	Value colorVal = args[1];
 	Color color;
 	if (!colorVal.IsNull()) color = ToColor(colorVal.ToString());
 	else color = SdlGlue::mainPixelDisplay->drawColor;
 	SdlGlue::mainPixelDisplay->FillPolygon(points, color);
-	return IntrinsicResult::Null;
+	return Value::null;
 }
 
 static bool pixelDisplayAssignOverride(ValueDict& map, MiniScript::Value key, Value value) {
@@ -770,7 +887,7 @@ static IntrinsicResult intrinsic_pixelDisplayClass(Context *conpixel, IntrinsicR
 	if (pixelDisplayClass.Count() == 0) {
 		i_pixelDisplay_clear = Intrinsic::Create("");
 		i_pixelDisplay_clear->AddParam("color", "#00000000");
-		i_pixelDisplay_clear->code = &intrinsic_pixelDisplay_clear;
+		i_pixelDisplay_clear->fastCode = &intrinsic_pixelDisplay_clear;
 		pixelDisplayClass.SetValue("clear", i_pixelDisplay_clear->GetFunc());
 		
 		i_pixelDisplay_width = Intrinsic::Create("");
@@ -789,7 +906,7 @@ static IntrinsicResult intrinsic_pixelDisplayClass(Context *conpixel, IntrinsicR
 		i_pixelDisplay_setPixel->AddParam("x", 0);
 		i_pixelDisplay_setPixel->AddParam("y", 0);
 		i_pixelDisplay_setPixel->AddParam("color");
-		i_pixelDisplay_setPixel->code = &intrinsic_pixelDisplay_setPixel;
+		i_pixelDisplay_setPixel->fastCode = &intrinsic_pixelDisplay_setPixel;
 		pixelDisplayClass.SetValue("setPixel", i_pixelDisplay_setPixel->GetFunc());
 				
 		i_pixelDisplay_drawLine = Intrinsic::Create("");
@@ -799,7 +916,7 @@ static IntrinsicResult intrinsic_pixelDisplayClass(Context *conpixel, IntrinsicR
 		i_pixelDisplay_drawLine->AddParam("y2", 100);
 		i_pixelDisplay_drawLine->AddParam("color");
 		i_pixelDisplay_drawLine->AddParam("width", 1);
-		i_pixelDisplay_drawLine->code = &intrinsic_pixelDisplay_drawLine;
+		i_pixelDisplay_drawLine->fastCode = &intrinsic_pixelDisplay_drawLine;
 		pixelDisplayClass.SetValue("line", i_pixelDisplay_drawLine->GetFunc());
 				
 		i_pixelDisplay_fillRect = Intrinsic::Create("");
@@ -808,7 +925,7 @@ static IntrinsicResult intrinsic_pixelDisplayClass(Context *conpixel, IntrinsicR
 		i_pixelDisplay_fillRect->AddParam("width", 100);
 		i_pixelDisplay_fillRect->AddParam("height", 100);
 		i_pixelDisplay_fillRect->AddParam("color");
-		i_pixelDisplay_fillRect->code = &intrinsic_pixelDisplay_fillRect;
+		i_pixelDisplay_fillRect->fastCode = &intrinsic_pixelDisplay_fillRect;
 		pixelDisplayClass.SetValue("fillRect", i_pixelDisplay_fillRect->GetFunc());
 				
 		i_pixelDisplay_fillEllipse = Intrinsic::Create("");
@@ -817,13 +934,13 @@ static IntrinsicResult intrinsic_pixelDisplayClass(Context *conpixel, IntrinsicR
 		i_pixelDisplay_fillEllipse->AddParam("width", 100);
 		i_pixelDisplay_fillEllipse->AddParam("height", 100);
 		i_pixelDisplay_fillEllipse->AddParam("color");
-		i_pixelDisplay_fillEllipse->code = &intrinsic_pixelDisplay_fillEllipse;
+		i_pixelDisplay_fillEllipse->fastCode = &intrinsic_pixelDisplay_fillEllipse;
 		pixelDisplayClass.SetValue("fillEllipse", i_pixelDisplay_fillEllipse->GetFunc());
 
 		i_pixelDisplay_fillPoly = Intrinsic::Create("");
 		i_pixelDisplay_fillPoly->AddParam("points");
 		i_pixelDisplay_fillPoly->AddParam("color");
-		i_pixelDisplay_fillPoly->code = &intrinsic_pixelDisplay_fillPoly;
+		i_pixelDisplay_fillPoly->fastCode = &intrinsic_pixelDisplay_fillPoly;
 		pixelDisplayClass.SetValue("fillPoly", i_pixelDisplay_fillPoly->GetFunc());
 
 	}
@@ -880,6 +997,27 @@ static IntrinsicResult intrinsic_windowModule(Context *context, IntrinsicResult
 	return IntrinsicResult(windowModule);
 }
 
+//--------------------------------------------------------------------------------
+// frame timing
+//--------------------------------------------------------------------------------
+
+static IntrinsicResult intrinsic_frameTime(Context *context, IntrinsicResult partialResult) {
+	return IntrinsicResult(SdlGlue::FrameTime());
+}
+
+static IntrinsicResult intrinsic_deltaTime(Context *context, IntrinsicResult partialResult) {
+	return IntrinsicResult(SdlGlue::DeltaTime());
+}
+
+static IntrinsicResult intrinsic_fixedUpdate(Context *context, IntrinsicResult partialResult) {
+	Value func = context->GetVar("func");
+	double rate = context->GetVar("rate").DoubleValue();
+	if (!func.IsNull() and func.type != ValueType::Function) TypeException("function (or null) required for func parameter").raise();
+	if (rate <= 0) RuntimeException("rate must be greater than 0").raise();
+	SdlGlue::SetFixedUpdate(func, rate);
+	return IntrinsicResult::Null;
+}
+
 //--------------------------------------------------------------------------------
 // file module additions
 //--------------------------------------------------------------------------------
@@ -944,6 +1082,28 @@ void AddSodaIntrinsics() {
 	f = Intrinsic::Create("Sound");
 	f->code = &intrinsic_soundClass;
 	intrinsic_soundClass(nullptr, IntrinsicResult::Null);
+	
+	f = Intrinsic::Create("Worker");
+	f->code = &intrinsic_workerClass;
+	intrinsic_workerClass(nullptr, IntrinsicResult::Null);
+	
+	// (parent and its functions are used on worker threads; see Worker.h)
+	f = Intrinsic::Create("parent");
+	f->code = &intrinsic_parentModule;
+	f->threadSafe = true;
+	
+	i_parent_post = Intrinsic::Create("");
+	i_parent_post->AddParam("message");
+	i_parent_post->code = &intrinsic_parent_post;
+	i_parent_post->threadSafe = true;
+	
+	i_parent_available = Intrinsic::Create("");
+	i_parent_available->code = &intrinsic_parent_available;
+	i_parent_available->threadSafe = true;
+	
+	i_parent_get = Intrinsic::Create("");
+	i_parent_get->code = &intrinsic_parent_get;
+	i_parent_get->threadSafe = true;
 
 	f = Intrinsic::Create("TextDisplay");
 	f->code = &intrinsic_textDisplayClass;
@@ -964,21 +1124,41 @@ void AddSodaIntrinsics() {
 
 	i_key_pressed = Intrinsic::Create("");
 	i_key_pressed->AddParam("keyName");
-	i_key_pressed->code = &intrinsic_key_pressed;
+	i_key_pressed->fastCode = &intrinsic_key_pressed;
 	
 	i_key_axis = Intrinsic::Create("");
 	i_key_axis->AddParam("axisName");
-	i_key_axis->code = &intrinsic_key_axis;
+	i_key_axis->fastCode = &intrinsic_key_axis;
+	
+	i_key_available = Intrinsic::Create("");
+	i_key_available->fastCode = &intrinsic_key_available;
+	
+	i_key_get = Intrinsic::Create("");
+	i_key_get->code = &intrinsic_key_get;
+	
+	i_key_clear = Intrinsic::Create("");
+	i_key_clear->fastCode = &intrinsic_key_clear;
 	
 	f = Intrinsic::Create("mouse");
 	f->code = &intrinsic_mouseModule;
 	
 	i_mouse_button = Intrinsic::Create("");
 	i_mouse_button->AddParam("which", Value::zero);
-	i_mouse_button->code = &intrinsic_mouse_button;
+	i_mouse_button->fastCode = &intrinsic_mouse_button;
 
 	f = Intrinsic::Create("window");
 	f->code = &intrinsic_windowModule;
 	
+	f = Intrinsic::Create("frameTime");
+	f->code = &intrinsic_frameTime;
+	
+	f = Intrinsic::Create("deltaTime");
+	f->code = &intrinsic_deltaTime;
+	
+	f = Intrinsic::Create("fixedUpdate");
+	f->AddParam("func");
+	f->AddParam("rate", 120);
+	f->code = &intrinsic_fixedUpdate;
+	
 
 }
@@ -17,6 +17,7 @@ extern MiniScript::Value spriteList;
 extern MiniScript::ValueDict mouseModule;
 extern MiniScript::ValueDict imageClass;
 extern MiniScript::ValueDict soundClass;
+extern MiniScript::ValueDict workerClass;
 extern MiniScript::ValueDict window;
 
 extern MiniScript::Value white;
@@ -25,7 +25,7 @@ static bool spriteAssignOverride(ValueDict& spriteMap, MiniScript::Value key, Va
 		if (handle.type == ValueType::Handle) {
 			// ToDo: how do we be sure the data is specifically a SoundStorage?
 			// Do we need to enable RTTI, or use some common base class?
-			data = ((SpriteHandleData*)(handle.data.ref));
+			data = ((SpriteHandle*)(handle.data.ref))->data;
 		}
 		if (data) data->boundsChanged = data->transformChanged = true;
 	} else if (keyStr == "localBounds") {
@@ -35,7 +35,7 @@ static bool spriteAssignOverride(ValueDict& spriteMap, MiniScript::Value key, Va
 		if (handle.type == ValueType::Handle) {
 			// ToDo: how do we be sure the data is specifically a SpriteHandleData?
 			// Do we need to enable RTTI, or use some common base class?
-			data = ((SpriteHandleData*)(handle.data.ref));
+			data = ((SpriteHandle*)(handle.data.ref))->data;
 		}
 		if (data) data->boundsChanged = true;
 	}
@@ -54,13 +54,16 @@ SpriteHandleData* GetSpriteHandleData(MiniScript::Value spriteMap) {
 	SpriteHandleData *data = nullptr;
 	if (handle.IsNull()) {
 		data = new SpriteHandleData();
-		data->transformChanged = true;
+		data->transformChanged = data->boundsChanged = true;
+		data->lastLocalChangeCounter = -1;
+		data->prevStep = -1;
+		handle = Value::NewHandle(new SpriteHandle(data));
 		spriteMap.SetElem(SdlGlue::magicHandle, handle);
 		spriteMap.GetDict().SetAssignOverride(spriteAssignOverride);
 	} else {
 		// ToDo: how do we be sure the data is specifically a SpriteHandleData?
 		// Do we need to enable RTTI, or use some common base class?
-		data = (SpriteHandleData*)(handle.data.ref);
+		data = ((SpriteHandle*)(handle.data.ref))->data;
 	}
 	if (data->transformChanged) {
 		// Update the data with current values from the map.
@@ -29,6 +29,14 @@ public:
 	// to the values above are changed; cleared when we copy those values
 	// out (while drawing the sprite).
 	bool transformChanged;
+
+	// The transform as of the start of the latest fixed update step (see
+	// SdlGlue::BeginFixedStep), so that we can draw the sprite in between
+	// steps.  Valid only if prevStep is the number of that step.
+	float prevX, prevY;
+	float prevScaleX, prevScaleY;
+	float prevRotation;
+	long prevStep;
 	
 	// Flag also set to true when any property that affects the mapping
 	// from local to world bounds is changed.  Cleared when we update
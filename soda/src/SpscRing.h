@@ -0,0 +1,63 @@
+//
+//  SpscRing.h
+//  soda
+//
+//	A fixed-size, lock-free queue for handing items from one thread (the
+//	producer) to one other thread (the consumer).  Only the producer may
+//	call Push, and only the consumer may call Pop; each side owns one index,
+//	and publishes it with a release store after touching the slot, so
+//	neither ever has to wait on the other.
+//
+//	One slot is always left empty, to tell a full ring from an empty one;
+//	so a ring of capacity N holds at most N-1 items.
+//
+//	T is copied in and out, so it must not share state between copies behind
+//	the scenes.  (In particular, MiniScript's String is reference-counted
+//	without locking, so pass text as std::string instead.)
+//
+
+#ifndef SPSCRING_H
+#define SPSCRING_H
+
+#include <atomic>
+
+namespace SdlGlue {
+
+template <class T, unsigned capacity>
+class SpscRing {
+public:
+	SpscRing() : head(0), tail(0) {}
+
+	// Add an item to the queue.  Returns false (and does nothing) if full.
+	bool Push(const T& item) {
+		unsigned h = head.load(std::memory_order_relaxed);
+		unsigned next = (h + 1) % capacity;
+		if (next == tail.load(std::memory_order_acquire)) return false;
+		slots[h] = item;
+		head.store(next, std::memory_order_release);
+		return true;
+	}
+
+	// Take the oldest item off the queue.  Returns false if empty.
+	bool Pop(T *outItem) {
+		unsigned t = tail.load(std::memory_order_relaxed);
+		if (t == head.load(std::memory_order_acquire)) return false;
+		*outItem = slots[t];
+		slots[t] = T();		// (free the old item here, rather than on the producer's next Push)
+		tail.store((t + 1) % capacity, std::memory_order_release);
+		return true;
+	}
+
+	bool Empty() const {
+		return tail.load(std::memory_order_acquire) == head.load(std::memory_order_acquire);
+	}
+
+private:
+	T slots[capacity];
+	std::atomic<unsigned> head;		// next slot to write (owned by the producer)
+	std::atomic<unsigned> tail;		// next slot to read (owned by the consumer)
+};
+
+}
+
+#endif // SPSCRING_H
@@ -4,7 +4,7 @@
 //	using one of the built-in monospaced fonts.
 
 #include "TextDisplay.h"
-#include "compiledData/ScreenFont_png.h"
+#include "SceneRenderer.h"
 #include "SimpleVector.h"
 #include "SdlUtils.h"
 #include "SdlGlue.h"
@@ -20,10 +20,6 @@ namespace SdlGlue {
 // Public data
 TextDisplay* mainTextDisplay = nullptr;
 
-// Private data
-static SDL_Renderer* mainRenderer = nullptr;
-static SDL_Texture* screenFontTexture = nullptr;
-
 // Forward declarations
 
 
@@ -39,29 +35,14 @@ TextDisplay::TextDisplay() : rows(26), cols(68) {
 	Clear();
 }
 
-void SetupTextDisplay(SDL_Renderer *renderer) {
-	mainRenderer = renderer;
-	
-	SDL_RWops *stream = SDL_RWFromConstMem(ScreenFont_png, ScreenFont_png_len);
-	SdlAssertNotNull(stream);
-	SDL_Surface *surf = IMG_Load_RW(stream, 1);
-	SdlAssertNotNull(surf);
-	screenFontTexture = SDL_CreateTextureFromSurface(mainRenderer, surf);
-	SdlAssertNotNull(screenFontTexture);
-	SDL_SetTextureBlendMode(screenFontTexture, SDL_BLENDMODE_BLEND);
-
+void SetupTextDisplay() {
 	mainTextDisplay = new TextDisplay();
 }
 
 void ShutdownTextDisplay() {
-	SDL_DestroyTexture(screenFontTexture); screenFontTexture = nullptr;
 	delete mainTextDisplay;	mainTextDisplay = nullptr;
 }
 
-void RenderTextDisplay() {
-	mainTextDisplay->Render();
-}
-
 void TextDisplay::NoteWindowSizeChange(int newWidth, int newHeight) {
 	int prevRows = rows;
 	int prevCols = cols;
@@ -78,16 +59,13 @@ void TextDisplay::NoteWindowSizeChange(int newWidth, int newHeight) {
 	if (cursorX >= cols) cursorX = cols-1;
 }
 
-void TextDisplay::Render() {
-	int windowHeight = GetWindowHeight();
+void TextDisplay::Capture(Scene *scene) {
 	for (int row=0; row<rows; row++) {
 		for (int col=0; col<content[row].size(); col++) {
 			CellContent cc = content[row][col];
 			if (cc.character) {
-				Color c = cc.foreColor;
-				SDL_SetTextureColorMod(screenFontTexture, c.r, c.g, c.b);
-				SDL_SetTextureAlphaMod(screenFontTexture, c.a);
-				RenderCharAtPosition(cc.character, row, col, windowHeight);
+				TextDraw cell = { row, col, cc.character, cc.foreColor };
+				scene->text.push_back(cell);
 			}
 		}
 	}
@@ -166,20 +144,5 @@ void TextDisplay::Print(String s, bool addLineBreak) {
 	if (addLineBreak) PutChar(13);
 }
 
-//--------------------------------------------------------------------------------
-// Private method implementations
-//--------------------------------------------------------------------------------
-
-void TextDisplay::RenderCharAtPosition(Uint8 character, int row, int column, int windowHeight) {
-	const int srcCellWidth = 16;
-	const int srcCellHeight = 24;
-	const int destCellWidth = 14;
-	const int destCellHeight = 22;
-	SDL_Rect srcRect = { (character%16) * srcCellWidth, (character/16) * srcCellHeight, srcCellWidth, srcCellHeight };
-	SDL_Rect destRect = { column * destCellWidth, windowHeight - (row+1) * destCellHeight, srcCellWidth, srcCellHeight };
-	SDL_RenderCopyEx(mainRenderer, screenFontTexture, &srcRect, &destRect, 0, NULL, SDL_FLIP_NONE);
-}
-
-
 } // namespace SdlGlue
 
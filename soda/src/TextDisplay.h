@@ -8,13 +8,12 @@
 #include "Color.h"
 #include "SimpleVector.h"
 
-struct SDL_Renderer;
-
 namespace SdlGlue {
 
-void SetupTextDisplay(SDL_Renderer* renderer);
+struct Scene;
+
+void SetupTextDisplay();
 void ShutdownTextDisplay();
-void RenderTextDisplay();
 
 struct CellContent {
 	Uint8 character;
@@ -37,7 +36,7 @@ public:
 	void SetCharAtPosition(long unicodeChar, int row, int column);
 	void PutChar(long unicodeChar);
 	void Print(MiniScript::String s, bool addLineBreak=true);
-	void Render();
+	void Capture(Scene *scene);		// add our visible characters to the given scene
 	
 	void NoteWindowSizeChange(int newWidth, int newHeight);
 	
@@ -55,7 +54,6 @@ public:
 private:
 //	void SetStringAtPosition(const char* s, int stringBytes, int row, int column);
 //	void SetStringAtPosition(MiniScript::String s, int row, int column);
-	void RenderCharAtPosition(Uint8 character, int row, int column, int windowHeight);
 	void ScrollUp();
 	
 	int cursorX;
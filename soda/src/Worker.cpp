@@ -0,0 +1,364 @@
+//
+//  Worker.cpp
+//  soda
+//
+//	See Worker.h.  Messages are serialized as a tag byte per value, then
+//	its data (native-endian, as they never leave the process):
+//
+//		'z' null
+//		'n' number (double)
+//		's' string: length (Uint32), then its bytes
+//		'l' list: count (Uint32), then the items
+//		'm' map: count (Uint32), then each key and value
+//
+
+#include "Worker.h"
+#include "SdlUtils.h"
+#include "SdlGlue.h"
+#include "SpscRing.h"
+#include "SodaIntrinsics.h"
+#include "MiniScript/MiniscriptInterpreter.h"
+#include "MiniScript/MiniscriptIntrinsics.h"
+#include "MiniScript/MiniscriptErrors.h"
+#include "MiniScript/MiniscriptGC.h"
+#include "MiniScript/SlabAllocator.h"
+#include "MiniScript/UnitTest.h"
+#include <atomic>
+#include <fstream>
+#include <sstream>
+#include <string.h>
+
+using namespace MiniScript;
+
+namespace SdlGlue {
+
+static const int maxMessageDepth = 64;		// lists/maps nested deeper than this are assumed circular
+static const double workerSlice = 0.01;		// seconds a worker runs between checks for a stop request
+static const double workerGCBudget = 0.001;	// seconds of cycle collection between slices
+
+class WorkerData {
+public:
+	WorkerData() : thread(nullptr), stopRequested(false), finished(false) {
+		inboxPosted = SDL_CreateSemaphore(0);
+		outboxTaken = SDL_CreateSemaphore(0);
+	}
+	~WorkerData() {
+		SDL_DestroySemaphore(inboxPosted);
+		SDL_DestroySemaphore(outboxTaken);
+	}
+
+	std::string path;
+	std::string source;
+	SDL_Thread *thread;
+	SpscRing<std::string, 256> inbox;		// messages from the main script
+	SpscRing<std::string, 256> outbox;		// messages to the main script
+	SDL_sem *inboxPosted;					// posted for each message put in the inbox (and on stop)
+	SDL_sem *outboxTaken;					// posted for each message taken from the outbox (and on stop)
+	std::atomic<bool> stopRequested;
+	std::atomic<bool> finished;
+};
+
+// WorkerStorage: the handle to a worker held by its Worker object; when
+// the script lets go of that, the worker is stopped and freed.
+class WorkerStorage : public RefCountedStorage {
+public:
+	WorkerStorage(WorkerData *data) : data(data) {}
+	virtual ~WorkerStorage();
+
+	WorkerData *data;
+};
+
+// private data
+static SimpleVector<WorkerData*> workers;			// all workers not yet freed (main thread only)
+static thread_local WorkerData *currentWorker = nullptr;	// the worker this thread runs, if any
+
+// forward declarations of private methods:
+static WorkerData *GetWorkerData(Value worker);
+static void JoinWorker(WorkerData *w);
+static int WorkerThread(void *data);
+static void WorkerPrint(String s, bool addLineBreak);
+static void WorkerPrintErr(String s, bool addLineBreak);
+static void Serialize(const Value& v, std::string& out, int depth=0);
+static Value Deserialize(const std::string& data);
+
+//--------------------------------------------------------------------------------
+// Public method implementations
+//--------------------------------------------------------------------------------
+
+Value StartWorker(String path) {
+	std::ifstream infile(path.c_str());
+	if (!infile.is_open()) {
+		printf("Couldn't open %s to start a worker\n", path.c_str());
+		return Value::null;
+	}
+	Intrinsics::PrepareForThreads();
+
+	WorkerData *w = new WorkerData();
+	w->path = path.c_str();
+	std::stringstream buf;
+	buf << infile.rdbuf();
+	w->source = buf.str();
+	if (w->source.compare(0, 2, "#!") == 0) w->source.insert(0, "// ");	// (comment out a hashbang)
+	workers.push_back(w);
+	w->thread = SDL_CreateThread(WorkerThread, "Worker", w);
+
+	ValueDict inst;
+	inst.SetValue(Value::magicIsA, workerClass);
+	inst.SetValue(magicHandle, Value::NewHandle(new WorkerStorage(w)));
+	return inst;
+}
+
+void StopWorker(Value worker) {
+	WorkerData *w = GetWorkerData(worker);
+	if (w) JoinWorker(w);
+}
+
+void StopAllWorkers() {
+	VecIterate(i, workers) JoinWorker(workers[i]);
+}
+
+bool WorkerRunning(Value worker) {
+	WorkerData *w = GetWorkerData(worker);
+	return w != nullptr and !w->finished;
+}
+
+bool PostToWorker(Value worker, Value message) {
+	WorkerData *w = GetWorkerData(worker);
+	if (w == nullptr) return true;		// (nowhere to send it; drop it)
+	std::string data;
+	Serialize(message, data);
+	if (!w->inbox.Push(data)) return false;
+	SDL_SemPost(w->inboxPosted);
+	return true;
+}
+
+bool WorkerMessageAvailable(Value worker) {
+	WorkerData *w = GetWorkerData(worker);
+	return w != nullptr and !w->outbox.Empty();
+}
+
+bool GetFromWorker(Value worker, Value *outMessage) {
+	WorkerData *w = GetWorkerData(worker);
+	std::string data;
+	if (w == nullptr or !w->outbox.Pop(&data)) return false;
+	SDL_SemPost(w->outboxTaken);
+	*outMessage = Deserialize(data);
+	return true;
+}
+
+bool InWorker() {
+	return currentWorker != nullptr;
+}
+
+bool PostToParent(Value message) {
+	WorkerData *w = currentWorker;
+	if (w == nullptr) return false;
+	std::string data;
+	Serialize(message, data);
+	while (!w->outbox.Push(data)) {
+		if (w->stopRequested) return false;
+		SDL_SemWait(w->outboxTaken);
+	}
+	return true;
+}
+
+bool ParentMessageAvailable() {
+	return currentWorker != nullptr and !currentWorker->inbox.Empty();
+}
+
+Value GetFromParent() {
+	WorkerData *w = currentWorker;
+	if (w == nullptr) return Value::null;
+	std::string data;
+	while (!w->inbox.Pop(&data)) {
+		if (w->stopRequested) return Value::null;
+		SDL_SemWait(w->inboxPosted);
+	}
+	return Deserialize(data);
+}
+
+//--------------------------------------------------------------------------------
+// Private method implementations
+//--------------------------------------------------------------------------------
+
+WorkerStorage::~WorkerStorage() {
+	JoinWorker(data);
+	long idx = workers.indexOf(data);
+	if (idx >= 0) workers.deleteIdx(idx);
+	delete data;
+}
+
+// Ask the worker to stop (if it hasn't already), and wait for its thread to end.
+void JoinWorker(WorkerData *w) {
+	if (w->thread == nullptr) return;
+	w->stopRequested = true;
+	SDL_SemPost(w->inboxPosted);		// (wake it, if it's waiting for a message...
+	SDL_SemPost(w->outboxTaken);		// ...or for room to post one)
+	SDL_WaitThread(w->thread, nullptr);
+	w->thread = nullptr;
+}
+
+WorkerData *GetWorkerData(Value worker) {
+	if (worker.type != ValueType::Map) return nullptr;
+	Value handle = worker.Lookup(magicHandle);
+	if (handle.type != ValueType::Handle) return nullptr;
+	return ((WorkerStorage*)(handle.data.ref))->data;
+}
+
+int WorkerThread(void *data) {
+	WorkerData *w = (WorkerData*)data;
+	currentWorker = w;
+	Intrinsic::threadSafeOnly = true;
+	{
+		Interpreter interp(String(w->source.c_str()));
+		interp.standardOutput = &WorkerPrint;
+		interp.implicitOutput = &WorkerPrint;
+		interp.errorOutput = &WorkerPrintErr;
+		interp.Compile();
+		while (!interp.Done() and !w->stopRequested) {
+			interp.RunUntilDone(workerSlice);
+			CycleCollector::Collect(workerGCBudget);
+			// If it's waiting on something (like wait), nap rather than spin.
+			if (!interp.Done() and !interp.vm->GetTopContext()->partialResult.Done()) SDL_Delay(1);
+		}
+	}
+	CycleCollector::CollectAll();
+	SlabAllocator::ThreadEnded();		// (so the next worker can reuse this one's memory)
+	w->finished = true;
+	return 0;
+}
+
+void WorkerPrint(String s, bool addLineBreak) {
+	printf("%s%s", s.c_str(), addLineBreak ? "\n" : "");
+}
+
+void WorkerPrintErr(String s, bool addLineBreak) {
+	fprintf(stderr, "%s (in worker %s)%s", s.c_str(), currentWorker->path.c_str(), addLineBreak ? "\n" : "");
+}
+
+void Serialize(const Value& v, std::string& out, int depth) {
+	if (depth > maxMessageDepth) RuntimeException("message nested too deeply (or circular)").raise();
+	switch (v.type) {
+		case ValueType::Null:
+			out += 'z';
+			return;
+		case ValueType::Number:
+			out += 'n';
+			out.append((const char*)&v.data.number, sizeof(double));
+			return;
+		case ValueType::String:
+		{
+			String s = v.GetString();
+			Uint32 len = (Uint32)s.LengthB();
+			out += 's';
+			out.append((const char*)&len, sizeof(len));
+			out.append(s.c_str(), len);
+			return;
+		}
+		case ValueType::List:
+		{
+			ValueList list = v.GetList();
+			Uint32 count = (Uint32)list.Count();
+			out += 'l';
+			out.append((const char*)&count, sizeof(count));
+			for (long i=0; i<list.Count(); i++) Serialize(list[i], out, depth + 1);
+			return;
+		}
+		case ValueType::Map:
+		{
+			ValueDict map = ((Value&)v).GetDict();
+			Uint32 count = (Uint32)map.Count();
+			out += 'm';
+			out.append((const char*)&count, sizeof(count));
+			for (ValueDictIterator kv = map.GetIterator(); !kv.Done(); kv.Next()) {
+				Serialize(kv.Key(), out, depth + 1);
+				Serialize(kv.Value(), out, depth + 1);
+			}
+			return;
+		}
+		default:
+			RuntimeException("only null, numbers, strings, lists and maps can be sent to or from a worker").raise();
+	}
+}
+
+// Read one value from the given data, advancing pos past it.  (The data
+// came from Serialize, in this process, so we trust it.)
+static Value ReadValue(const std::string& data, size_t& pos) {
+	char tag = data[pos++];
+	switch (tag) {
+		case 'n': {
+			double d;
+			memcpy(&d, data.data() + pos, sizeof(d));
+			pos += sizeof(d);
+			return Value(d);
+		}
+		case 's': {
+			Uint32 len;
+			memcpy(&len, data.data() + pos, sizeof(len));
+			pos += sizeof(len);
+			String s(data.data() + pos, len);
+			pos += len;
+			return Value(s);
+		}
+		case 'l': {
+			Uint32 count;
+			memcpy(&count, data.data() + pos, sizeof(count));
+			pos += sizeof(count);
+			ValueList list(count);
+			for (Uint32 i=0; i<count; i++) list.Add(ReadValue(data, pos));
+			return Value(list);
+		}
+		case 'm': {
+			Uint32 count;
+			memcpy(&count, data.data() + pos, sizeof(count));
+			pos += sizeof(count);
+			ValueDict map;
+			for (Uint32 i=0; i<count; i++) {
+				Value key = ReadValue(data, pos);
+				map.SetValue(key, ReadValue(data, pos));
+			}
+			return Value(map);
+		}
+		default:
+			return Value::null;
+	}
+}
+
+Value Deserialize(const std::string& data) {
+	size_t pos = 0;
+	return ReadValue(data, pos);
+}
+
+//--------------------------------------------------------------------------------
+// Unit tests
+//--------------------------------------------------------------------------------
+
+class TestWorkerMessages : public UnitTest
+{
+public:
+	TestWorkerMessages() : UnitTest("WorkerMessages") {}
+	virtual void Run();
+};
+
+void TestWorkerMessages::Run()
+{
+	// Round-trip a nested message, and check we got a copy, not the original.
+	ValueList inner;
+	inner.Add(Value(1.5));
+	inner.Add(Value("two"));
+	inner.Add(Value::null);
+	ValueDict map;
+	map.SetValue("list", inner);
+	map.SetValue(Value(42.0), "answer");
+	std::string data;
+	Serialize(Value(map), data);
+	Value copy = Deserialize(data);
+	ErrorIf(copy.type != ValueType::Map);
+	ErrorIf(copy.data.ref == Value(map).data.ref);
+	ErrorIf(Value::Equality(copy, Value(map)) != 1);
+	ErrorIf(copy.Lookup(Value(42.0)).ToString() != "answer");
+}
+
+RegisterUnitTest(TestWorkerMessages);
+
+}	// end of namespace SdlGlue
@@ -0,0 +1,59 @@
+//
+//  Worker.h
+//	Workers: scripts that run on threads of their own, so that heavy jobs
+//	(pathfinding, level generation, compressing a save file) can use other
+//	cores without holding up the frame.  Each worker has its own Interpreter,
+//	and so its own heap; no script Value is ever shared with the main script.
+//	(Only the intrinsics are shared, and those are made immortal first, so no
+//	thread ever writes to them; see Intrinsics::PrepareForThreads.)
+//	Instead the two send each other messages: any null, number, string, list
+//	or map (nested, but without cycles or functions).  The sender serializes
+//	a message into a byte buffer, and hands the buffer over a lock-free ring
+//	(see SpscRing.h); the receiver builds its own copy from that.
+//
+//	A worker sees only the thread-safe intrinsics: the core MiniScript ones,
+//	and `parent`, for talking to the script that started it.  The display,
+//	input, sound and file APIs are for the main thread only.  A worker's
+//	print output goes straight to stdout.
+//
+//	When a worker's thread ends, the memory it allocated goes back into a
+//	shared pool, which later workers (or the main script) draw from.
+//
+
+#ifndef WORKER_H
+#define WORKER_H
+
+#include "MiniScript/MiniscriptTypes.h"
+
+namespace SdlGlue {
+
+// Start a worker running the given script file, returning a Worker object
+// (or null, after printing why, if the file can't be read).
+MiniScript::Value StartWorker(MiniScript::String path);
+
+// Ask a worker to stop, and wait until it has.
+void StopWorker(MiniScript::Value worker);
+void StopAllWorkers();
+
+// Whether a worker is still running its script.
+bool WorkerRunning(MiniScript::Value worker);
+
+// Messages from the main script to a worker, and back.  PostToWorker returns
+// false if the worker's queue is full (try again later); GetFromWorker returns
+// false if there's no message waiting.  Posting something that can't be sent
+// raises a RuntimeException.
+bool PostToWorker(MiniScript::Value worker, MiniScript::Value message);
+bool WorkerMessageAvailable(MiniScript::Value worker);
+bool GetFromWorker(MiniScript::Value worker, MiniScript::Value *outMessage);
+
+// The same, within a worker, to and from the script that started it.  These
+// block (which is fine on a worker thread) until there's room, or a message;
+// they give up, returning false or null, if the worker is asked to stop.
+bool InWorker();
+bool PostToParent(MiniScript::Value message);
+bool ParentMessageAvailable();
+MiniScript::Value GetFromParent();
+
+}
+
+#endif // WORKER_H
@@ -19,17 +19,31 @@
 #include "MiniScript/Dictionary.h"
 #include "MiniScript/MiniscriptParser.h"
 #include "MiniScript/MiniscriptInterpreter.h"
+#include "MiniScript/MiniscriptOptimizer.h"
+#include "MiniScript/MiniscriptJIT.h"
+#include "MiniScript/MiniscriptGC.h"
+#include "MiniScript/MiniscriptProfiler.h"
 #include "OstreamSupport.h"
 #include "MiniScript/SplitJoin.h"
 #include "ShellIntrinsics.h"
 #include "SodaIntrinsics.h"
 #include "SdlGlue.h"
+#include "FrameStats.h"
+#include "CodeCache.h"
+#include "SpscRing.h"
 
 using namespace MiniScript;
 
 bool printHeaderInfo = true;
 
 static bool dumpTAC = false;
+static bool icStats = false;
+static String profilePath;		// where to write collapsed stacks, if profiling
+static String benchBaselinePath;	// benchmark results to compare against, if any
+static String benchOutPath;		// where to write benchmark results (default: stdout)
+static double benchTolerance = 0.1;	// fractional slowdown counted as a regression
+static const long benchDefaultFrames = 300;
+static const double gcFrameBudget = 0.002;	// seconds per frame for the cycle collector
 
 static void Print(String s, bool addLineBreak=true) {
 	std::cout << s.c_str();
@@ -65,34 +79,117 @@ static void PrintHelp(String cmdPath) {
 	Print(String("usage: ") + cmdPath + " [option] ... [-c cmd | file | -]");
 	Print("Options and arguments:");
 	Print("-c cmd : program passed in as String (terminates option list)");
+	Print("--compile file ... : compile script files into the code cache, and exit");
+	Print("--no-cache : don't use (read or write) the code cache");
+	Print("--no-gc : don't collect garbage cycles (they will leak)");
+	Print("--uncapped : don't wait for vsync between frames (run as fast as possible)");
+	Print("--no-render-thread : draw each frame on the main thread, in between running the script");
+	Print("--headless : run without a display or GPU (dummy drivers, offscreen software rendering, uncapped)");
+	Print("--dump-frames n,... : save the given frames (counting from 1) as PNG files");
+	Print("--dump-prefix path : start of the saved frame file names (default \"frame\")");
+	Print("--frames n : quit after drawing n frames");
+	Print("--frame-stats file.csv : write the time taken by each stage of each frame to a CSV file");
+	Print("--frame-overlay : show recent frame times, percentiles, and time per stage on screen");
+	Print("--record file : record all input (keys, mouse, controllers) and the random seed to file,");
+	Print("         running the script on a fixed timestep");
+	Print("--replay file : replay input recorded with --record, and quit at the end of it");
+	Print("--profile file : sample where the script spends its time; at exit, write collapsed stacks");
+	Print("         (for flame graphs) to file, and print the hottest lines and functions");
+	Print("--bench file ... : run benchmark scripts headless for a fixed number of frames (see --frames,");
+	Print("         default 300), and print ops/sec and frame times as JSON (terminates option list)");
+	Print("--bench-out file.json : write benchmark results to a file instead of stdout");
+	Print("--bench-baseline file.json : compare benchmark results with earlier ones, and fail on regressions");
+	Print("--bench-tolerance pct : slowdown (in percent) counted as a regression (default 10)");
+	Print("--jit  : compile hot numeric functions to native code (where supported)");
+	Print("--jit-check : like --jit, but also run each native call in the interpreter and report differences");
+	Print("--jit-threshold n : calls to a function before the JIT compiles it (default 2)");
 	Print("-h     : print this help message and exit (also -? or --help)");
 	Print("file   : program read from script file");
 	Print("-      : program read from stdin (default; interactive mode if a tty)");
 }
 
+static void WriteProfile(Interpreter &interp) {
+	if (!Profiler::enabled) return;
+	if (!Profiler::WriteCollapsedStacks(profilePath, interp.vm)) {
+		std::cerr << "Couldn't write profile to " << profilePath.c_str() << std::endl;
+	}
+	std::cerr << Profiler::Report(interp.vm).c_str();
+}
+
+// Collect garbage cycles for a little while (in between frames).
+static void CollectGarbage() {
+	SdlGlue::StageTimer timer(SdlGlue::stageGC);
+	CycleCollector::Collect(gcFrameBudget);
+}
+
+// Whether the program still has anything to do: its main code, or (once that's
+// done) fixed-timestep updates.
+static bool StillRunning(Interpreter &interp) {
+	return !interp.Done() or !SdlGlue::FixedUpdateFunc().IsNull();
+}
+
+// If the script has reported an error since errorsBefore, stop it for good,
+// fixed-update function and all (an error ends the run, wherever it happens).
+// Returns whether it did so.
+static bool StopOnError(Interpreter &interp, long errorsBefore) {
+	if (interp.errorCount == errorsBefore) return false;
+	SdlGlue::SetFixedUpdate(Value::null, 1);	// (rate is moot when clearing)
+	interp.Stop();
+	return true;
+}
+
+// Run the script for up to timeLimit seconds.  Once the main program is done,
+// that means calling the fixed-update function (if it set one) for each step
+// that's due; a step that doesn't finish in time carries on next frame.
+static void RunFrame(Interpreter &interp, double timeLimit) {
+	SdlGlue::StageTimer timer(SdlGlue::stageScript);
+	long errorsBefore = interp.errorCount;
+	if (!interp.Done()) {
+		interp.RunUntilDone(timeLimit, true);
+		StopOnError(interp, errorsBefore);
+		return;
+	}
+	Value func = SdlGlue::FixedUpdateFunc();
+	if (func.type != ValueType::Function) return;
+	Uint64 start = SDL_GetPerformanceCounter();
+	for (int steps = SdlGlue::FixedStepsDue(); steps > 0; steps--) {
+		double timeLeft = timeLimit - (double)(SDL_GetPerformanceCounter() - start) / SDL_GetPerformanceFrequency();
+		if (timeLeft <= 0) break;
+		SdlGlue::BeginFixedStep();
+		interp.vm->ManuallyPushCall((FunctionStorage*)func.data.ref);
+		interp.RunUntilDone(timeLeft, true);
+		if (StopOnError(interp, errorsBefore) or !interp.Done()) break;
+	}
+}
+
 void ConfigInterpreter(Interpreter &interp) {
 	interp.standardOutput = &Print;
 	interp.errorOutput = &PrintErr;
 	interp.implicitOutput = &Print;
 }
 
-static SimpleVector<String> userInput;
-static SDL_mutex* userInputMutex = nullptr;
-static bool interpreterBusy = false;
+// Lines typed at the REPL, handed from the REPL thread to the main thread.
+static SdlGlue::SpscRing<std::string, 64> replInput;
+static SDL_sem* promptReady = nullptr;		// posted when the REPL wants another line
+
+static void PushInput(const std::string& input) {
+	// The ring only fills if the main thread stops taking input (which it
+	// does only while it's busy, and then we're not reading lines anyway).
+	while (!replInput.Push(input)) SDL_Delay(1);
+}
 
 static int ReplThread(void *interpreter) {
 	Interpreter *interp = (Interpreter*)interpreter;
 	
 	// Run a thread to process the terminal input.  But note that it's not safe
 	// to do many SDL things (like resizing the window) from a secondary thread.
-	// So, we'll just put the user input onto the given vector, and let the
-	// main thread pull it off and process it.  (We only need to be careful about
-	// locking that vector when we modify it.)
+	// So, we'll just push the user input onto the replInput ring, and let the
+	// main thread pull it off and process it.  The main thread posts promptReady
+	// when it's done with the previous line (and anything it started), so we
+	// know which prompt to show without polling.
 	while (true) {
-		if (!interp->Done()) {
-			SDL_Delay(100);
-			continue;
-		}
+		SDL_SemWait(promptReady);
+		if (exitASAP) return exitResult;
 
 		const char *prompt = (interp->NeedMoreInput() ? ">>> " : "> ");
 		#if useEditline
@@ -102,12 +199,8 @@ static int ReplThread(void *interpreter) {
 				exitASAP = true;
 				return 0;
 			}
-			String input(buf);
-			SDL_LockMutex(userInputMutex);
-			userInput.push_back(input);
-			SDL_UnlockMutex(userInputMutex);
+			PushInput(buf);
 			free(buf);
-			SDL_Delay(100);	// (gives main thread a chance to feed this to the REPL, so we can show the right prompt)
 		#else
 			// Standard C++ I/O:
 			char buf[1024];
@@ -117,10 +210,7 @@ static int ReplThread(void *interpreter) {
 				if (std::cin.eof()) exitASAP = true;	// Ctrl-D
 				return 0;
 			}
-			String input(buf);
-			SDL_LockMutex(userInputMutex);
-			userInput.push_back(input);
-			SDL_UnlockMutex(userInputMutex);
+			PushInput(buf);
 		#endif
 		
 		if (exitASAP) {
@@ -140,12 +230,14 @@ static int DoREPL() {
 	Interpreter interp;
 	ConfigInterpreter(interp);
 	
-	userInputMutex = SDL_CreateMutex();
+	promptReady = SDL_CreateSemaphore(1);
 	SDL_Thread* thread = SDL_CreateThread(ReplThread, "ReplThread", (void*)(&interp));
+	bool awaitingPrompt = false;		// true when we've taken a line, but not yet asked for the next
 	
 	while (!exitASAP) {
 		// Service SDL
 		SdlGlue::Service();
+		CollectGarbage();
 		if (SdlGlue::quit) {
 			exitASAP = true;
 			SDL_DetachThread(thread);
@@ -155,48 +247,43 @@ static int DoREPL() {
 		if (!interp.Done()) {
 			// Still processing some previous input.  Keep working!
 			try {
-				interp.RunUntilDone(0.1);
+				SdlGlue::StageTimer timer(SdlGlue::stageScript);
+				interp.RunUntilDone(SdlGlue::TimeToNextFrame());
 			} catch (MiniscriptException& mse) {
 				std::cerr << "Runtime Exception: " << mse.message << std::endl;
 				interp.vm->Stop();
 			}
 		} else {
-			// Grab input from the user, if any....
-			String inp;
-			SDL_LockMutex(userInputMutex);
-			if (userInput.size() > 0) {
-				inp = userInput[0];
-				userInput.deleteIdx(0);
-			}
-			SDL_UnlockMutex(userInputMutex);
-			// and feed it to the REPL
-			if (!inp.empty()) {
-				interpreterBusy = true;
-				try {
-					interp.REPL(inp, 0.1);
+			// Grab input from the user, if any, and feed it to the REPL
+			std::string inp;
+			if (replInput.Pop(&inp)) {
+				awaitingPrompt = true;
+				if (!inp.empty()) try {
+					SdlGlue::StageTimer timer(SdlGlue::stageScript);
+					interp.REPL(String(inp.c_str()), SdlGlue::TimeToNextFrame());
 				} catch (MiniscriptException& mse) {
 					std::cerr << "Runtime Exception: " << mse.message << std::endl;
 					interp.vm->Stop();
 				}
-				interpreterBusy = false;
 			}
 		}
+		if (awaitingPrompt and interp.Done() and !exitASAP) {
+			awaitingPrompt = false;
+			SDL_SemPost(promptReady);
+		}
 	}
 	SdlGlue::Shutdown();
-	int threadResult;
-	SDL_WaitThread(thread, &threadResult);
-	SDL_DestroyMutex(userInputMutex); userInputMutex = nullptr;
+	WriteProfile(interp);
+	if (thread) {
+		SDL_SemPost(promptReady);		// (so the REPL thread wakes up to see we're exiting)
+		int threadResult;
+		SDL_WaitThread(thread, &threadResult);
+		SDL_DestroySemaphore(promptReady); promptReady = nullptr;
+	}
 	return exitResult;
 }
 
-static int DoCommand(String cmd) {
-	Interpreter interp;
-	ConfigInterpreter(interp);
-	interp.Reset(cmd);
-	interp.Compile();
-	
-//	std::cout << cmd << std::endl;
-	
+static int RunProgram(Interpreter &interp) {
 	if (dumpTAC) {
 		Context *c = interp.vm->GetGlobalContext();
 		for (long i=0; i<c->code.Count(); i++) {
@@ -206,10 +293,11 @@ static int DoCommand(String cmd) {
 
 	SdlGlue::Setup();
 
-	while (!interp.Done() && !SdlGlue::quit) {
+	while (StillRunning(interp) && !SdlGlue::quit) {
 		SdlGlue::Service();
+		CollectGarbage();
 		try {
-			interp.RunUntilDone(0.01, true);
+			RunFrame(interp, SdlGlue::TimeToNextFrame());
 		} catch (MiniscriptException& mse) {
 			std::cerr << "Runtime Exception: " << mse.message << std::endl;
 			interp.vm->Stop();
@@ -219,16 +307,41 @@ static int DoCommand(String cmd) {
 	}
 
 	SdlGlue::Shutdown();
+	WriteProfile(interp);
+	
+	if (icStats) {
+		long total = InlineCache::totalHits + InlineCache::totalMisses;
+		std::cout << "Inline caches: " << InlineCache::totalHits << " hits, "
+			<< InlineCache::totalMisses << " misses";
+		if (total > 0) std::cout << " (" << (100.0 * InlineCache::totalHits / total) << "% hit rate)";
+		std::cout << std::endl;
+	}
+	if (JIT::check) {
+		std::cerr << "JIT: " << JIT::compiledCount << " functions compiled; "
+			<< JIT::nativeCalls << " native calls (" << JIT::checkedCalls << " checked, "
+			<< JIT::mismatches << " mismatches); " << JIT::bailouts << " handed back to the interpreter" << std::endl;
+		if (JIT::mismatches > 0) exitResult = -1;
+	}
 	return exitResult;
 }
 
-static int DoScriptFile(String path) {
-	// Read the file
-	List<String> source;
+static int DoCommand(String cmd) {
+	Interpreter interp;
+	ConfigInterpreter(interp);
+	interp.Reset(cmd);
+	interp.Compile();
+	
+//	std::cout << cmd << std::endl;
+	
+	return RunProgram(interp);
+}
+
+// Read the lines of a script file (commenting out any hashbang line).
+static bool ReadScriptFile(String path, List<String>& source) {
 	std::ifstream infile(path.c_str());
 	if (!infile.is_open()) {
 		std::cerr << "Error opening file: " << path.c_str() << std::endl;
-		return -1;
+		return false;
 	}
 	char buf[1024];
 	while (infile.getline(buf, sizeof(buf))) {
@@ -238,9 +351,31 @@ static int DoScriptFile(String path) {
 
 	// Comment out the first line, if it's a hashbang
 	if (source.Count() > 0 and source[0].StartsWith("#!")) source[0] = "// " + source[0];
+	return true;
+}
+
+static int DoScriptFile(String path) {
+	// If the code cache has up-to-date compiled code for this file, just run that.
+	List<TACLine> code;
+	if (CodeCache::Load(path, "", code)) {
+		Interpreter interp;
+		ConfigInterpreter(interp);
+		interp.Compile(code);
+		return RunProgram(interp);
+	}
+
+	// Otherwise, read the file
+	List<String> source;
+	if (!ReadScriptFile(path, source)) return -1;
 	
-	// Concatenate and execute the code.
-	return DoCommand(Join("\n", source));
+	// Concatenate and compile the code (saving it in the cache for next time),
+	// then execute it.
+	Interpreter interp;
+	ConfigInterpreter(interp);
+	interp.Reset(Join("\n", source));
+	interp.Compile();
+	if (interp.vm) CodeCache::Store(path, interp.vm->GetGlobalContext()->code);
+	return RunProgram(interp);
 }
 
 static List<String> testOutput;
@@ -321,6 +456,225 @@ void RunIntegrationTests(String path) {
 	Print("\nIntegration tests complete.\n");
 }
 
+//--------------------------------------------------------------------------------
+// Benchmarks: each script (see bench/interp.ms) runs headless for a fixed number
+// of frames, counting the work it does in a global "ops".
+
+struct BenchResult {
+	String name;
+	String error;			// why it didn't run to the end (empty if it did)
+	long frames;
+	double seconds;			// wall-clock time for all frames
+	double scriptSeconds;	// time spent running the script
+	double ops;
+	double frameMs[4];		// frame time percentiles (see benchPercentiles)
+	double stageMs[SdlGlue::stageCount];	// average time per frame in each stage
+};
+
+static const double benchPercentiles[4] = { 0.5, 0.95, 0.99, 1 };
+static const char *benchPercentileNames[4] = { "p50", "p95", "p99", "max" };
+
+static double SecondsSince(Uint64 counter) {
+	return (double)(SDL_GetPerformanceCounter() - counter) / SDL_GetPerformanceFrequency();
+}
+
+static String BenchName(String path) {
+	long pos = path.LastIndexOfB("/");
+	if (pos >= 0) path = path.SubstringB(pos + 1);
+	if (path.EndsWith(".ms")) path = path.SubstringB(0, path.LengthB() - 3);
+	return path;
+}
+
+static BenchResult RunBenchmark(String path, long frames) {
+	BenchResult r;
+	r.name = BenchName(path);
+	r.frames = 0;
+	r.seconds = r.scriptSeconds = r.ops = 0;
+	for (int i=0; i<4; i++) r.frameMs[i] = 0;
+	for (int i=0; i<SdlGlue::stageCount; i++) r.stageMs[i] = 0;
+
+	List<String> source;
+	if (!ReadScriptFile(path, source)) {
+		r.error = "couldn't read " + path;
+		return r;
+	}
+	// (Script output goes to stderr, to keep stdout clean for the results.)
+	Interpreter interp;
+	interp.standardOutput = interp.errorOutput = interp.implicitOutput = &PrintErr;
+	interp.Reset(Join("\n", source));
+	interp.Compile();
+	
+	// Start each benchmark with a fresh display and no sprites.
+	spriteList = ValueList();
+	exitASAP = false;
+	SdlGlue::maxFrames = frames;
+	SdlGlue::Setup();
+	Uint64 start = SDL_GetPerformanceCounter();
+	while (StillRunning(interp) && !SdlGlue::quit) {
+		SdlGlue::Service();
+		CollectGarbage();
+		Uint64 scriptStart = SDL_GetPerformanceCounter();
+		try {
+			RunFrame(interp, SdlGlue::TimeToNextFrame());
+		} catch (MiniscriptException& mse) {
+			r.error = "Runtime Exception: " + mse.message;
+			break;
+		}
+		r.scriptSeconds += SecondsSince(scriptStart);
+	}
+	r.seconds = SecondsSince(start);
+	r.frames = SdlGlue::FrameCount();
+	for (int i=0; i<4; i++) r.frameMs[i] = SdlGlue::FrameTimePercentile(benchPercentiles[i]) * 1000;
+	for (int i=0; i<SdlGlue::stageCount; i++) r.stageMs[i] = SdlGlue::StageAverage((SdlGlue::FrameStage)i) * 1000;
+	r.ops = interp.GetGlobalValue("ops").DoubleValue();
+	SdlGlue::Shutdown();
+	spriteList = ValueList();
+
+	if (r.error.empty() and r.frames < frames) {
+		r.error = "stopped after " + String::Format(r.frames) + " frames";
+	}
+	return r;
+}
+
+static String JsonString(String s) {
+	s.Replace("\\", "\\\\");
+	s.Replace("\"", "\\\"");
+	return "\"" + s + "\"";
+}
+
+// Format the results as JSON, one benchmark per line (which is what
+// ReadBenchBaseline expects).
+static String BenchJson(const SimpleVector<BenchResult>& results) {
+	String json = "{\"benchmarks\": [\n";
+	for (long i=0; i<results.size(); i++) {
+		const BenchResult& r = results[i];
+		json += "  {\"name\": " + JsonString(r.name);
+		if (!r.error.empty()) json += ", \"error\": " + JsonString(r.error);
+		json += ", \"frames\": " + String::Format(r.frames)
+			+ ", \"seconds\": " + String::Format(r.seconds, "%.4f")
+			+ ", \"scriptSeconds\": " + String::Format(r.scriptSeconds, "%.4f")
+			+ ", \"ops\": " + String::Format(r.ops, "%.0f")
+			+ ", \"opsPerSec\": " + String::Format(r.scriptSeconds > 0 ? r.ops / r.scriptSeconds : 0, "%.1f");
+		json += ", \"frameMs\": {";
+		for (int j=0; j<4; j++) {
+			if (j) json += ", ";
+			json += "\"" + String(benchPercentileNames[j]) + "\": " + String::Format(r.frameMs[j], "%.3f");
+		}
+		json += "}, \"stageMs\": {";
+		for (int j=0; j<SdlGlue::stageCount; j++) {
+			if (j) json += ", ";
+			json += "\"" + String(SdlGlue::StageName((SdlGlue::FrameStage)j)) + "\": " + String::Format(r.stageMs[j], "%.3f");
+		}
+		json += "}}";
+		if (i + 1 < results.size()) json += ",";
+		json += "\n";
+	}
+	json += "]}\n";
+	return json;
+}
+
+// Find the value of the given key in a line of our JSON output; returns
+// false if it's not there.
+static bool JsonValue(const String& line, const char *key, String *outValue) {
+	String tag = "\"" + String(key) + "\": ";
+	long pos = line.IndexOfB(tag);
+	if (pos < 0) return false;
+	pos += tag.LengthB();
+	long end = pos;
+	if (line[pos] == '"') {
+		end = line.IndexOfB("\"", pos + 1);
+		*outValue = line.SubstringB(pos + 1, end - pos - 1);
+	} else {
+		while (end < line.LengthB() and line[end] != ',' and line[end] != '}') end++;
+		*outValue = line.SubstringB(pos, end - pos);
+	}
+	return true;
+}
+
+// Read benchmark results written by BenchJson: the ops/sec and 95th
+// percentile frame time of each benchmark, by name.
+static bool ReadBenchBaseline(String path, SimpleVector<BenchResult>& results) {
+	std::ifstream infile(path.c_str());
+	if (!infile.is_open()) return false;
+	char buf[2048];
+	String value;
+	while (infile.getline(buf, sizeof(buf))) {
+		String line(buf);
+		BenchResult r;
+		if (!JsonValue(line, "name", &r.name) or JsonValue(line, "error", &value)) continue;
+		r.ops = JsonValue(line, "opsPerSec", &value) ? value.DoubleValue() : 0;
+		r.frameMs[1] = JsonValue(line, "p95", &value) ? value.DoubleValue() : 0;
+		results.push_back(r);
+	}
+	return true;
+}
+
+static String PercentChange(double now, double before) {
+	if (before <= 0) return "     n/a";
+	return String::Format((now / before - 1) * 100, "%+7.1f") + "%";
+}
+
+// Compare results with the baseline (printing to stderr); return how many
+// benchmarks got slower (fewer ops/sec, or a longer p95 frame time) by more
+// than the tolerance.
+static int CompareWithBaseline(const SimpleVector<BenchResult>& results, const SimpleVector<BenchResult>& baseline) {
+	int regressions = 0;
+	std::cerr << "Compared with " << benchBaselinePath.c_str() << " (tolerance "
+		<< benchTolerance * 100 << "%):" << std::endl;
+	for (long i=0; i<results.size(); i++) {
+		const BenchResult& r = results[i];
+		if (!r.error.empty()) continue;
+		const BenchResult *base = nullptr;
+		for (long j=0; j<baseline.size(); j++) if (baseline[j].name == r.name) base = &baseline[j];
+		if (base == nullptr) {
+			std::cerr << "  " << r.name.c_str() << ": not in baseline" << std::endl;
+			continue;
+		}
+		double opsPerSec = r.scriptSeconds > 0 ? r.ops / r.scriptSeconds : 0;
+		bool slower = (base->ops > 0 and opsPerSec < base->ops * (1 - benchTolerance))
+			or (base->frameMs[1] > 0 and r.frameMs[1] > base->frameMs[1] * (1 + benchTolerance));
+		if (slower) regressions++;
+		std::cerr << "  " << r.name.c_str() << ": ops/sec " << PercentChange(opsPerSec, base->ops).c_str()
+			<< ", p95 frame " << PercentChange(r.frameMs[1], base->frameMs[1]).c_str()
+			<< (slower ? "  REGRESSION" : "") << std::endl;
+	}
+	return regressions;
+}
+
+static int DoBenchmarks(SimpleVector<String> paths) {
+	long frames = SdlGlue::maxFrames > 0 ? SdlGlue::maxFrames : benchDefaultFrames;
+	SdlGlue::headless = true;
+	int result = 0;
+	SimpleVector<BenchResult> results;
+	for (long i=0; i<paths.size(); i++) {
+		BenchResult r = RunBenchmark(paths[i], frames);
+		if (r.error.empty()) {
+			std::cerr << r.name.c_str() << ": " << String::Format(r.scriptSeconds > 0 ? r.ops / r.scriptSeconds : 0, "%.0f").c_str()
+				<< " ops/sec, p50 " << String::Format(r.frameMs[0], "%.2f").c_str()
+				<< " ms, p95 " << String::Format(r.frameMs[1], "%.2f").c_str() << " ms" << std::endl;
+		} else {
+			std::cerr << r.name.c_str() << ": " << r.error.c_str() << std::endl;
+			result = -1;
+		}
+		results.push_back(r);
+	}
+
+	String json = BenchJson(results);
+	if (benchOutPath.empty()) std::cout << json.c_str();
+	else {
+		std::ofstream out(benchOutPath.c_str());
+		out << json.c_str();
+		if (!out.good()) return ReturnErr("Couldn't write " + benchOutPath);
+	}
+
+	if (!benchBaselinePath.empty()) {
+		SimpleVector<BenchResult> baseline;
+		if (!ReadBenchBaseline(benchBaselinePath, baseline)) return ReturnErr("Couldn't read " + benchBaselinePath);
+		if (CompareWithBaseline(results, baseline) > 0) result = -1;
+	}
+	return result;
+}
+
 #if _WIN32 || _WIN64
 	void PrepareShellArgs(int argc, char* argv[], int startingAt) {
 #else
@@ -380,6 +734,90 @@ void RunIntegrationTests(String path) {
 			return DoCommand(cmd);
 		} else if (arg == "--dumpTAC") {
 			dumpTAC = true;
+		} else if (arg == "--icstats") {
+			icStats = true;
+		} else if (arg == "--optstats") {
+			Optimizer::report = &PrintErr;
+		} else if (arg == "--no-optimize") {
+			Optimizer::enabled = false;
+		} else if (arg == "--no-gc") {
+			CycleCollector::enabled = false;
+		} else if (arg == "--uncapped") {
+			SdlGlue::uncapped = true;
+		} else if (arg == "--no-render-thread") {
+			SdlGlue::renderThreaded = false;
+		} else if (arg == "--headless") {
+			SdlGlue::headless = true;
+		} else if (arg == "--dump-frames") {
+			i++;
+			if (i >= argc) return ReturnErr("Frame numbers expected after --dump-frames option");
+			StringList frames = Split(argv[i], ',');
+			for (long j=0; j<frames.Count(); j++) SdlGlue::framesToDump.push_back(frames[j].IntValue());
+		} else if (arg == "--dump-prefix") {
+			i++;
+			if (i >= argc) return ReturnErr("Path expected after --dump-prefix option");
+			SdlGlue::frameDumpPrefix = argv[i];
+		} else if (arg == "--frame-stats") {
+			i++;
+			if (i >= argc) return ReturnErr("File path expected after --frame-stats option");
+			SdlGlue::frameStatsPath = argv[i];
+		} else if (arg == "--frame-overlay") {
+			SdlGlue::showFrameOverlay = true;
+		} else if (arg == "--frames") {
+			i++;
+			if (i >= argc) return ReturnErr("Number expected after --frames option");
+			SdlGlue::maxFrames = atol(argv[i]);
+		} else if (arg == "--record") {
+			i++;
+			if (i >= argc) return ReturnErr("File path expected after --record option");
+			SdlGlue::inputRecordPath = argv[i];
+		} else if (arg == "--replay") {
+			i++;
+			if (i >= argc) return ReturnErr("File path expected after --replay option");
+			SdlGlue::inputReplayPath = argv[i];
+		} else if (arg == "--profile") {
+			i++;
+			if (i >= argc) return ReturnErr("File path expected after --profile option");
+			Profiler::enabled = true;
+			profilePath = argv[i];
+		} else if (arg == "--bench") {
+			// Run each of the following files as a benchmark.
+			if (i+1 >= argc) return ReturnErr("Script file(s) expected after --bench option");
+			SimpleVector<String> paths;
+			for (i++; i < argc; i++) paths.push_back(argv[i]);
+			return DoBenchmarks(paths);
+		} else if (arg == "--bench-out") {
+			i++;
+			if (i >= argc) return ReturnErr("File path expected after --bench-out option");
+			benchOutPath = argv[i];
+		} else if (arg == "--bench-baseline") {
+			i++;
+			if (i >= argc) return ReturnErr("File path expected after --bench-baseline option");
+			benchBaselinePath = argv[i];
+		} else if (arg == "--bench-tolerance") {
+			i++;
+			if (i >= argc) return ReturnErr("Percentage expected after --bench-tolerance option");
+			benchTolerance = atof(argv[i]) / 100;
+		} else if (arg == "--jit") {
+			JIT::enabled = true;
+		} else if (arg == "--jit-check") {
+			JIT::enabled = JIT::check = true;
+			JIT::report = &PrintErr;
+		} else if (arg == "--jit-threshold") {
+			i++;
+			if (i >= argc) return ReturnErr("Number expected after --jit-threshold option");
+			JIT::threshold = atol(argv[i]);
+		} else if (arg == "--no-cache") {
+			CodeCache::enabled = false;
+		} else if (arg == "--compile") {
+			// Compile each of the following files into the code cache.
+			if (i+1 >= argc) return ReturnErr("Script file(s) expected after --compile option");
+			int result = 0;
+			for (i++; i < argc; i++) {
+				if (CodeCache::Compile(argv[i])) Print(String("Compiled ") + argv[i]);
+				else result = -1;
+			}
+			return result;
 		} else if (arg == "--itest") {
 			PrintHeaderInfo();
 			i++;